@@ -90,6 +90,8 @@ set_option compiler.extract_closed false in
 
 @[extern "lean_io_timeit"] constant timeit (msg : @& String) (fn : IO α) : IO α
 @[extern "lean_io_allocprof"] constant allocprof (msg : @& String) (fn : IO α) : IO α
+/-- Write the allocation profile recorded when `LEAN_HEAPPROF=<n>` is set to `fname` in pprof format. -/
+@[extern "lean_io_heapprof_dump"] constant heapProfDump (fname : @& String) : IO Unit
 
 /- Programs can execute IO actions during initialization that occurs before
    the `main` function is executed. The attribute `[init <action>]` specifies
@@ -130,6 +130,7 @@ def isExternC (env : Environment) (fn : Name) : Bool :=
   | some { entries := [ ExternEntry.standard `all _ ], .. } => true
   | _ => false
 
+@[export lean_get_extern_name_for]
 def getExternNameFor (env : Environment) (backend : Name) (fn : Name) : Option String := OptionM.run do
   let data ← getExternAttrData env fn
   let entry ← getExternEntryFor data backend
@@ -95,6 +95,17 @@ builtin_initialize declMapExt : SimplePersistentEnvExtension Decl DeclMap ←
 def findEnvDecl (env : Environment) (n : Name) : Option Decl :=
   (declMapExt.getState env).find? n
 
+/-- Return `true` if the declaration `n` was imported, and is therefore the same in all environments with the same imports. -/
+@[export lean_ir_is_imported_decl]
+def isImportedEnvDecl (env : Environment) (n : Name) : Bool :=
+  let s := declMapExt.getState env
+  !s.stage₁ && s.map₁.contains n && !s.map₂.contains n
+
+/-- Number of symbol lookups of the interpreter answered by the cache of imported declarations shared by all
+interpreters with the same imports. -/
+@[extern "lean_ir_interpreter_shared_cache_hits"]
+constant getInterpreterSharedCacheHits : IO Nat
+
 def findDecl (n : Name) : CompilerM (Option Decl) :=
   return findEnvDecl (← get).env n
 
@@ -282,6 +282,16 @@ partial def elabCommand (stx : Syntax) : CommandElabM Unit := do
           | elabFns => elabCommandUsing s stx elabFns
     | _ => throwError "unexpected command"
 
+/--
+Wait for the values of theorems type checked in parallel (see `kernel.parallelTheorems`), and log the kernel errors
+at the corresponding declarations.
+-/
+def waitTheoremChecks : CommandElabM Unit := do
+  let (env, failures) := (← getEnv).waitTheoremChecks
+  setEnv env
+  for (check, ex) in failures do
+    withRef check.ref <| logError (ex.toMessageData (← getOptions))
+
 /--
 `elabCommand` wrapper that should be used for the initial invocation, not for recursive calls after
 macro expansion etc.
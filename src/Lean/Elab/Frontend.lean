@@ -63,6 +63,7 @@ def processCommand : FrontendM Bool := do
     setParserState ps
     setMessages messages
     if Parser.isEOI cmd || Parser.isExitCommand cmd then
+      runCommandElabM Command.waitTheoremChecks
       pure true -- Done
     else
       profileitM IO.Error "elaboration" scope.opts <| elabCommandAtFrontend cmd
@@ -69,11 +69,26 @@ structure EnvironmentHeader where
 
 open Std (HashMap)
 
+/- Opaque result of type checking the value of a theorem in a separate task, see `Environment.addDeclDeferringTheorems`.
+   It is an `Except KernelException Unit`, which cannot be used here because `KernelException` refers to `Environment`. -/
+constant TheoremCheckResultSpec : NonemptyType.{0}
+def TheoremCheckResult : Type := TheoremCheckResultSpec.type
+instance : Nonempty TheoremCheckResult := TheoremCheckResultSpec.property
+
+/- A theorem whose value is type checked in a separate task, see `Environment.addDeclDeferringTheorems`. -/
+structure TheoremCheck where
+  declName : Name
+  /- Syntax at which a kernel error is reported, set by `Lean.addDecl` -/
+  ref      : Syntax := Syntax.missing
+  task     : Task TheoremCheckResult
+
 structure Environment where
   const2ModIdx : HashMap Name ModuleIdx
   constants    : ConstMap
   extensions   : Array EnvExtensionState
   header       : EnvironmentHeader := {}
+  /- Pending type checks of theorem values, most recent first. See `addDeclDeferringTheorems`. -/
+  theoremChecks : List TheoremCheck := []
   deriving Inhabited
 
 namespace Environment
@@ -118,6 +133,21 @@ private def getTrustLevel (env : Environment) : UInt32 :=
 def getModuleIdxFor? (env : Environment) (declName : Name) : Option ModuleIdx :=
   env.const2ModIdx.find? declName
 
+@[export lean_environment_is_imported_const]
+private def isImportedConst (env : Environment) (declName : Name) : Bool :=
+  env.const2ModIdx.contains declName
+
+/- Move the constant map to its persistent stage, so that adding constants to an environment that is still
+   referenced elsewhere does not copy the whole map. Used by `leanchecker`, which keeps one environment per
+   declaration. -/
+@[export lean_environment_switch_constants]
+private def switchConstants (env : Environment) : Environment :=
+  { env with constants := env.constants.switch }
+
+@[export lean_environment_has_imports]
+private def hasImports (env : Environment) : Bool :=
+  !env.header.moduleNames.isEmpty
+
 def isConstructor (env : Environment) (declName : Name) : Bool :=
   match env.find? declName with
   | ConstantInfo.ctorInfo _ => true
@@ -156,6 +186,35 @@ def addAndCompile (env : Environment) (opt : Options) (decl : Declaration) : Exc
   let env ← addDecl env decl
   compileDecl env opt decl
 
+/- Like `addDecl`, but the value of a theorem is type checked in a separate task after its header has been checked
+   and the theorem has been added. The task is stored in the environment, see `waitTheoremChecks`. -/
+@[extern "lean_add_decl_deferring_theorems"]
+constant addDeclDeferringTheorems (env : Environment) (decl : @& Declaration) : Except KernelException Environment
+
+@[export lean_environment_add_theorem_check]
+private def addTheoremCheck (env : Environment) (declName : Name) (task : Task TheoremCheckResult) : Environment :=
+  { env with theoremChecks := { declName, task } :: env.theoremChecks }
+
+/- Set the syntax of the theorem checks added since the last call, i.e., of the most recent checks without syntax. -/
+def setTheoremChecksRef (env : Environment) (ref : Syntax) : Environment :=
+  let rec go : List TheoremCheck → List TheoremCheck
+    | c :: cs => if c.ref.isMissing then { c with ref } :: go cs else c :: cs
+    | []      => []
+  { env with theoremChecks := go env.theoremChecks }
+
+private unsafe def waitTheoremChecksImp (env : Environment) : Environment × List (TheoremCheck × KernelException) :=
+  let failures := env.theoremChecks.reverse.filterMap fun check =>
+    match (unsafeCast check.task.get : Except KernelException Unit) with
+    | Except.error ex => some (check, ex)
+    | Except.ok _     => none
+  ({ env with theoremChecks := [] }, failures)
+
+/- Wait for all pending theorem checks (see `addDeclDeferringTheorems`) and return the rejected theorems in the
+   order they were added. -/
+@[implementedBy waitTheoremChecksImp]
+def waitTheoremChecks (env : Environment) : Environment × List (TheoremCheck × KernelException) :=
+  ({ env with theoremChecks := [] }, [])
+
 end Environment
 
 /- Interface for managing environment extensions. -/
@@ -549,6 +608,8 @@ def mkModuleData (env : Environment) : IO ModuleData := do
 
 @[export lean_write_module]
 def writeModule (env : Environment) (fname : System.FilePath) : IO Unit := do
+  unless env.waitTheoremChecks.2.isEmpty do
+    throw <| IO.userError s!"failed to write '{fname}', the kernel rejected a theorem of the module"
   saveModuleData fname env.mainModule (← mkModuleData env)
 
 private partial def getEntriesFor (mod : ModuleData) (extId : Name) (i : Nat) : Array EnvExtensionEntry :=
@@ -611,24 +672,77 @@ structure ImportState where
   moduleData    : Array ModuleData := #[]
   regions       : Array CompactedRegion := #[]
 
+private def readModule (mod : Name) : IO (ModuleData × CompactedRegion) := do
+  let mFile ← findOLean mod
+  unless (← mFile.pathExists) do
+    throw <| IO.userError s!"object file '{mFile}' of module {mod} does not exist"
+  readModuleData mFile
+
+private abbrev ReadModulesResult := HashMap Name (Except IO.Error (ModuleData × CompactedRegion))
+
+/--
+  Read the `.olean` files of all modules reachable from `imports`. The files of each level of the import graph
+  are read in parallel. Errors are stored in the result so that `importModules` can report them in the same order
+  as a sequential traversal. -/
+private partial def readModules (imports : List Import) : IO ReadModulesResult :=
+  go (imports.filter (fun i => !i.runtimeOnly) |>.map (·.module) |>.eraseDups |>.toArray) {}
+where
+  go (mods : Array Name) (result : ReadModulesResult) : IO ReadModulesResult := do
+    if mods.isEmpty then
+      return result
+    let tasks ← mods.mapM fun mod => IO.asTask (readModule mod)
+    let mut result := result
+    for mod in mods, task in tasks do
+      result := result.insert mod task.get
+    let mut next : Array Name := #[]
+    let mut nextSet : NameSet := {}
+    for task in tasks do
+      if let Except.ok (data, _) := task.get then
+        for i in data.imports do
+          unless i.runtimeOnly || result.contains i.module || nextSet.contains i.module do
+            next    := next.push i.module
+            nextSet := nextSet.insert i.module
+    go next result
+
+private unsafe def freeCompactedRegionsUnsafe (regions : Array CompactedRegion) : IO Unit :=
+  regions.forM CompactedRegion.free
+
+/-- Free the given compacted regions. No live references to their contents may exist at the time of invocation. -/
+@[implementedBy freeCompactedRegionsUnsafe]
+private constant freeCompactedRegions (regions : Array CompactedRegion) : IO Unit
+
+private def mkConst2ModIdx (mods : Array ModuleData) (numConsts : Nat) : HashMap Name ModuleIdx := Id.run do
+  let mut modIdx : Nat := 0
+  let mut const2ModIdx : HashMap Name ModuleIdx := Std.mkHashMap (capacity := numConsts)
+  for mod in mods do
+    for cinfo in mod.constants do
+      const2ModIdx := const2ModIdx.insert cinfo.name modIdx
+    modIdx := modIdx + 1
+  return const2ModIdx
+
+/-- Return the name of the first duplicate constant if there is one. -/
+private def mkConstantMap (mods : Array ModuleData) (numConsts : Nat) : Except Name (HashMap Name ConstantInfo) := do
+  let mut constantMap : HashMap Name ConstantInfo := Std.mkHashMap (capacity := numConsts)
+  for mod in mods do
+    for cinfo in mod.constants do
+      match constantMap.insert' cinfo.name cinfo with
+      | (constantMap', replaced) =>
+        constantMap := constantMap'
+        if replaced then throw cinfo.name
+  return constantMap
+
 @[export lean_import_modules]
 partial def importModules (imports : List Import) (opts : Options) (trustLevel : UInt32 := 0) : IO Environment := profileitIO "import" opts do
   withImporting do
-    let (_, s) ← importMods imports |>.run {}
-    let mut numConsts := 0
-    for mod in s.moduleData do
-      numConsts := numConsts + mod.constants.size
-    let mut modIdx : Nat := 0
-    let mut const2ModIdx : HashMap Name ModuleIdx := Std.mkHashMap (capacity := numConsts)
-    let mut constantMap : HashMap Name ConstantInfo := Std.mkHashMap (capacity := numConsts)
-    for mod in s.moduleData do
-      for cinfo in mod.constants do
-        const2ModIdx := const2ModIdx.insert cinfo.name modIdx
-        match constantMap.insert' cinfo.name cinfo with
-        | (constantMap', replaced) =>
-          constantMap := constantMap'
-          if replaced then throw (IO.userError s!"import failed, environment already contains '{cinfo.name}'")
-       modIdx := modIdx + 1
+    let mods ← readModules imports
+    let regions := mods.fold (init := #[]) fun regions _ r => match r with
+      | Except.ok (_, region) => regions.push region
+      | Except.error _        => regions
+    /- If a module cannot be read or two modules declare the same constant, free the regions read so far.
+       `mods` is dead when the handler runs, and no other references to their contents exist. -/
+    let (s, const2ModIdx, constantMap) ← tryCatch (loadModules mods imports) fun ex => do
+      freeCompactedRegions regions
+      throw ex
     let constants : ConstMap := SMap.fromHashMap constantMap false
     let exts ← mkInitialExtensionStates
     let env : Environment := {
@@ -648,24 +762,36 @@ partial def importModules (imports : List Import) (opts : Options) (trustLevel :
     let env ← finalizePersistentExtensions env s.moduleData opts
     pure env
 where
-  importMods : List Import → StateRefT ImportState IO Unit
+  loadModules (mods : ReadModulesResult) (imports : List Import) :
+      IO (ImportState × HashMap Name ModuleIdx × HashMap Name ConstantInfo) := do
+    let (_, s) ← importMods mods imports |>.run {}
+    let mut numConsts := 0
+    for mod in s.moduleData do
+      numConsts := numConsts + mod.constants.size
+    -- The two tables are independent, build them in parallel
+    let constantMapTask := Task.spawn fun _ => mkConstantMap s.moduleData numConsts
+    let const2ModIdx := mkConst2ModIdx s.moduleData numConsts
+    match constantMapTask.get with
+    | Except.ok constantMap => pure (s, const2ModIdx, constantMap)
+    | Except.error declName => throw (IO.userError s!"import failed, environment already contains '{declName}'")
+  importMods (mods : ReadModulesResult) : List Import → StateRefT ImportState IO Unit
   | []    => pure ()
   | i::is => do
     if i.runtimeOnly || (← get).moduleNameSet.contains i.module then
-      importMods is
+      importMods mods is
     else do
       modify fun s => { s with moduleNameSet := s.moduleNameSet.insert i.module }
-      let mFile ← findOLean i.module
-      unless (← mFile.pathExists) do
-        throw <| IO.userError s!"object file '{mFile}' of module {i.module} does not exist"
-      let (mod, region) ← readModuleData mFile
-      importMods mod.imports.toList
+      let (mod, region) ← match mods.find? i.module with
+        | some (Except.ok r)    => pure r
+        | some (Except.error e) => throw e
+        | none                  => readModule i.module
+      importMods mods mod.imports.toList
       modify fun s => { s with
         moduleData  := s.moduleData.push mod
         regions     := s.regions.push region
         moduleNames := s.moduleNames.push i.module
       }
-      importMods is
+      importMods mods is
 
 /--
   Create environment object from imports and free compacted regions after calling `act`. No live references to the
@@ -712,6 +838,9 @@ def displayStats (env : Environment) : IO Unit := do
   IO.println ("direct imports:                        " ++ toString env.header.imports);
   IO.println ("number of imported modules:            " ++ toString env.header.regions.size);
   IO.println ("number of memory-mapped modules:       " ++ toString (env.header.regions.filter (·.isMemoryMapped) |>.size));
+  let relocated := env.header.moduleNames.zip env.header.regions |>.filter (fun p => !p.2.isMemoryMapped) |>.map (·.1)
+  unless relocated.isEmpty do
+    IO.println ("modules that were not memory-mapped:   " ++ toString relocated.toList)
   IO.println ("number of consts:                      " ++ toString env.constants.size);
   IO.println ("number of imported consts:             " ++ toString env.constants.stageSizes.1);
   IO.println ("number of local consts:                " ++ toString env.constants.stageSizes.2);
@@ -775,6 +904,10 @@ constant isDefEq (env : Environment) (lctx : LocalContext) (a b : Expr) : Bool
 @[extern "lean_kernel_whnf"]
 constant whnf (env : Environment) (lctx : LocalContext) (a : Expr) : Expr
 
+/-- Number of `whnf` and `infer_type` results the kernel has reused from its process-wide caches for closed terms. -/
+@[extern "lean_kernel_shared_cache_hits"]
+constant getSharedCacheHits : IO Nat
+
 end Kernel
 
 class MonadEnv (m : Type → Type) where
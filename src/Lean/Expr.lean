@@ -757,6 +757,11 @@ constant instantiateRange (e : @& Expr) (beginIdx endIdx : @& Nat) (xs : @& Arra
 @[extern "lean_expr_instantiate_rev_range"]
 constant instantiateRevRange (e : @& Expr) (beginIdx endIdx : @& Nat) (xs : @& Array Expr) : Expr
 
+/-- Same as `(e.instantiate subst).headBeta`, but only the subterms along the spine of the head are instantiated,
+    and no intermediate beta-redexes are created. -/
+@[extern "lean_expr_instantiate_head_beta"]
+constant instantiateHeadBeta (e : @& Expr) (subst : @& Array Expr) : Expr
+
 /-- Replace free variables `xs` with loose bound variables. -/
 @[extern "lean_expr_abstract"]
 constant abstract (e : @& Expr) (xs : @& Array Expr) : Expr
@@ -888,9 +893,12 @@ def isHeadBetaTargetFn (useZeta : Bool) : Expr → Bool
   | Expr.mdata _ b _    => isHeadBetaTargetFn useZeta b
   | _                   => false
 
-def headBeta (e : Expr) : Expr :=
-  let f := e.getAppFn
-  if f.isHeadBetaTargetFn false then betaRev f e.getAppRevArgs else e
+/--
+  Return the head beta normal form of `e`, i.e., beta-reduce `e` until its head is not a lambda applied to arguments.
+  Metadata around the lambdas in the head is ignored. It is implemented natively: the bodies of the intermediate
+  redexes are not instantiated, only the subterms along the spine of the head. -/
+@[extern "lean_expr_head_beta"]
+constant headBeta (e : @& Expr) : Expr
 
 def isHeadBetaTarget (e : Expr) (useZeta := false) : Bool :=
   e.getAppFn.isHeadBetaTargetFn useZeta
@@ -325,5 +325,9 @@ def toMessageData (e : KernelException) (opts : Options) : MessageData :=
   | invalidProj env lctx e              => mkCtx env lctx opts m!"(kernel) invalid projection{indentExpr e}"
   | other msg                           => m!"(kernel) {msg}"
 
+@[export lean_kernel_exception_to_string]
+private def toStringExport (e : KernelException) (opts : Options) : IO String :=
+  (e.toMessageData opts).toString
+
 end KernelException
 end Lean
@@ -440,13 +440,13 @@ partial def whnfCore (e : Expr) : MetaM Expr :=
     trace[Meta.whnf] e
     match e with
     | Expr.const ..  => pure e
-    | Expr.letE _ _ v b _ => whnfCore $ b.instantiate1 v
+    | Expr.letE _ _ v b _ => whnfCore $ b.instantiateHeadBeta #[v]
     | Expr.app f ..       =>
       let f := f.getAppFn
       let f' ← whnfCore f
       if f'.isLambda then
         let revArgs := e.getAppRevArgs
-        whnfCore <| f'.betaRev revArgs
+        whnfCore <| (mkAppRev f' revArgs).headBeta
       else if let some eNew ← whnfDelayedAssigned? f' e then
         whnfCore eNew
       else
@@ -672,6 +672,14 @@ def reduceBinNatOp (f : Nat → Nat → Nat) (a b : Expr) : MetaM (Option Expr)
   trace[Meta.isDefEq.whnf.reduceBinOp] "{a} op {b}"
   return mkRawNatLit <| f a b
 
+def reduceBinNatOpBounded (f : Nat → Nat → Nat) (a b : Expr) (maxB : Nat := 2^24) : MetaM (Option Expr) :=
+  withNatValue a fun a =>
+  withNatValue b fun b => do
+  if b > maxB then
+    return none
+  trace[Meta.isDefEq.whnf.reduceBinOp] "{a} op {b}"
+  return mkRawNatLit <| f a b
+
 def reduceBinNatPred (f : Nat → Nat → Bool) (a b : Expr) : MetaM (Option Expr) := do
   withNatValue a fun a =>
   withNatValue b fun b =>
@@ -684,6 +692,8 @@ def reduceNat? (e : Expr) : MetaM (Option Expr) :=
     | Expr.app (Expr.const fn _ _) a _                  =>
       if fn == ``Nat.succ then
         reduceUnaryNatOp Nat.succ a
+      else if fn == ``Nat.log2 then
+        reduceUnaryNatOp Nat.log2 a
       else
         return none
     | Expr.app (Expr.app (Expr.const fn _ _) a1 _) a2 _ =>
@@ -694,6 +704,14 @@ def reduceNat? (e : Expr) : MetaM (Option Expr) :=
       else if fn == ``Nat.mod then reduceBinNatOp Nat.mod a1 a2
       else if fn == ``Nat.beq then reduceBinNatPred Nat.beq a1 a2
       else if fn == ``Nat.ble then reduceBinNatPred Nat.ble a1 a2
+      else if fn == ``Nat.land then reduceBinNatOp Nat.land a1 a2
+      else if fn == ``Nat.lor then reduceBinNatOp Nat.lor a1 a2
+      else if fn == ``Nat.xor then reduceBinNatOp Nat.xor a1 a2
+      else if fn == ``Nat.shiftRight then reduceBinNatOp Nat.shiftRight a1 a2
+      else if fn == ``Nat.gcd then reduceBinNatOp Nat.gcd a1 a2
+      -- the size of the result is linear in the exponent, see `LEAN_KERNEL_MAX_NAT_EXPONENT`
+      else if fn == ``Nat.shiftLeft then reduceBinNatOpBounded Nat.shiftLeft a1 a2
+      else if fn == ``Nat.pow then reduceBinNatOpBounded Nat.pow a1 a2
       else return none
     | _ =>
       return none
@@ -29,7 +29,8 @@ def isRec [Monad m] [MonadEnv m] (declName : Name) : m Bool :=
 
 @[inline] def withoutModifyingEnv [Monad m] [MonadEnv m] [MonadFinally m] {α : Type} (x : m α) : m α := do
   let env ← getEnv
-  try x finally setEnv env
+  -- the values of theorems added by `x` must still be checked, see `kernel.parallelTheorems`
+  try x finally setEnv { env with theoremChecks := (← getEnv).theoremChecks }
 
 @[inline] def matchConst [Monad m] [MonadEnv m] (e : Expr) (failK : Unit → m α) (k : ConstantInfo → List Level → m α) : m α := do
   match e with
@@ -104,9 +105,29 @@ def getConstInfoRec [Monad m] [MonadEnv m] [MonadError m] (constName : Name) : m
         | _ => failK ()
       | _ => failK ()
 
+register_builtin_option kernel.parallelTheorems : Bool := {
+  defValue := false
+  descr    := "(kernel) type check the values of theorems in parallel, errors are reported at the end of the file, or at the end of the command in the server"
+}
+
+/-- Name used to report the kernel statistics of `decl` when `profiler` is set. -/
+private def Declaration.profileName : Declaration → Name
+  | Declaration.axiomDecl val                       => val.name
+  | Declaration.defnDecl val                        => val.name
+  | Declaration.thmDecl val                         => val.name
+  | Declaration.opaqueDecl val                      => val.name
+  | Declaration.quotDecl                            => `Quot
+  | Declaration.mutualDefnDecl (val :: _)           => val.name
+  | Declaration.inductDecl _ _ (indType :: _) _     => indType.name
+  | _                                               => Name.anonymous
+
 def addDecl [Monad m] [MonadEnv m] [MonadError m] [MonadOptions m] (decl : Declaration) : m Unit := do
-  match (← getEnv).addDecl decl with
-  | Except.ok    env => setEnv env
+  let env ← getEnv
+  let opts ← getOptions
+  let r := kernelProfileit decl.profileName opts fun _ =>
+    if kernel.parallelTheorems.get opts then env.addDeclDeferringTheorems decl else env.addDecl decl
+  match r with
+  | Except.ok    env => setEnv (env.setTheoremChecksRef (← getRef))
   | Except.error ex  => throwKernelException ex
 
 private def supportedRecursors :=
@@ -125,7 +125,8 @@ def compileNextCmd (text : FileMap) (snap : Snapshot) (hasWidgets : Bool) : IO S
     }
     let (output, _) ← IO.FS.withIsolatedStreams <| liftM (m := BaseIO) do
       Elab.Command.catchExceptions
-        (getResetInfoTrees *> Elab.Command.elabCommandTopLevel cmdStx)
+        -- report the theorems rejected by the kernel with the command, see `kernel.parallelTheorems`
+        (getResetInfoTrees *> Elab.Command.elabCommandTopLevel cmdStx *> Elab.Command.waitTheoremChecks)
         cmdCtx cmdStateRef
     let mut postCmdState ← cmdStateRef.get
     if !output.isEmpty then
@@ -11,6 +11,13 @@ namespace Lean
 @[extern "lean_profileit"]
 def profileit {α : Type} (category : @& String) (opts : @& Options) (fn : Unit → α) : α := fn ()
 
+/--
+  Like `profileit` with category `type checking`, but also print the kernel statistics collected while
+  type checking the declaration `declName` (e.g., delta unfoldings per constant) when it takes longer than
+  `profiler.threshold`. -/
+@[extern "lean_kernel_profileit"]
+def kernelProfileit {α : Type} (declName : @& Name) (opts : @& Options) (fn : Unit → α) : α := fn ()
+
 unsafe def profileitIOUnsafe {ε α : Type} (category : String) (opts : Options) (act : EIO ε α) : EIO ε α :=
   match profileit category opts fun _ => unsafeEIO act with
   | Except.ok a    => pure a
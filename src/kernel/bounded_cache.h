@@ -0,0 +1,144 @@
+/*
+Copyright (c) 2021 Microsoft Corporation. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+*/
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include "runtime/int64.h"
+#include "runtime/debug.h"
+
+namespace lean {
+/** \brief Hash table with open addressing and a bounded number of slots.
+
+    The table starts small and doubles in size until it reaches \c capacity slots (a power of two).
+    After that, inserting a key whose probe window is full evicts the entry of the oldest generation
+    in the window. The generation is advanced every `num_slots / 4` insertions, and refreshed on hits,
+    so frequently used entries survive.
+
+    \remark Pointers returned by \c find are invalidated by \c insert. */
+template<typename K, typename V, typename Hash, typename Eq>
+class bounded_cache {
+    static constexpr unsigned g_probe_length = 8;
+    static constexpr unsigned g_initial_size = 64;
+    struct entry {
+        K        m_key;
+        V        m_value;
+        unsigned m_hash;
+        /* 0 iff the slot is empty */
+        unsigned m_gen = 0;
+    };
+    std::vector<entry> m_entries;
+    unsigned           m_capacity;
+    unsigned           m_num_used{0};
+    unsigned           m_gen{1};
+    unsigned           m_gen_inserts{0};
+    uint64             m_hits{0};
+    uint64             m_misses{0};
+    uint64             m_evictions{0};
+    Hash               m_hash_fn;
+    Eq                 m_eq_fn;
+
+    unsigned mask() const { return m_entries.size() - 1; }
+
+    void next_gen() {
+        if (++m_gen_inserts >= m_entries.size() / 4) {
+            m_gen_inserts = 0;
+            if (++m_gen == 0) m_gen = 1;
+        }
+    }
+
+    /* Return the slot for an entry with key \c k and hash \c h: either the slot containing \c k, an empty one,
+       or the oldest one in the probe window. */
+    entry & find_slot(K const & k, unsigned h) {
+        unsigned i       = h & mask();
+        entry * oldest   = nullptr;
+        for (unsigned j = 0; j < g_probe_length; j++) {
+            entry & e = m_entries[(i + j) & mask()];
+            if (e.m_gen == 0 || (e.m_hash == h && m_eq_fn(e.m_key, k)))
+                return e;
+            if (!oldest || m_gen - e.m_gen > m_gen - oldest->m_gen)
+                oldest = &e;
+        }
+        return *oldest;
+    }
+
+    /* Store the entry in a table that is known to contain no entry for its key */
+    void reinsert(entry && e) {
+        entry & s = find_slot(e.m_key, e.m_hash);
+        if (s.m_gen == 0)
+            m_num_used++;
+        else
+            m_evictions++;
+        s = std::move(e);
+    }
+
+    void grow() {
+        std::vector<entry> old_entries;
+        old_entries.swap(m_entries);
+        m_entries.resize(old_entries.empty() ? std::min(g_initial_size, m_capacity) : 2 * old_entries.size());
+        m_num_used = 0;
+        for (entry & e : old_entries) {
+            if (e.m_gen != 0)
+                reinsert(std::move(e));
+        }
+    }
+
+public:
+    bounded_cache(unsigned capacity):m_capacity(capacity) {
+        lean_assert(capacity >= g_probe_length && (capacity & (capacity - 1)) == 0);
+    }
+
+    V const * find(K const & k) {
+        if (m_entries.empty()) {
+            m_misses++;
+            return nullptr;
+        }
+        unsigned h = m_hash_fn(k);
+        unsigned i = h & mask();
+        for (unsigned j = 0; j < g_probe_length; j++) {
+            entry & e = m_entries[(i + j) & mask()];
+            if (e.m_gen == 0)
+                break;
+            if (e.m_hash == h && m_eq_fn(e.m_key, k)) {
+                m_hits++;
+                e.m_gen = m_gen;
+                return &e.m_value;
+            }
+        }
+        m_misses++;
+        return nullptr;
+    }
+
+    bool contains(K const & k) { return find(k) != nullptr; }
+
+    void insert(K const & k, V const & v) {
+        if (m_entries.size() < m_capacity && 2 * (m_num_used + 1) > m_entries.size())
+            grow();
+        unsigned h = m_hash_fn(k);
+        entry & s  = find_slot(k, h);
+        if (s.m_gen == 0) {
+            m_num_used++;
+        } else if (s.m_hash != h || !m_eq_fn(s.m_key, k)) {
+            m_evictions++;
+        }
+        s.m_key   = k;
+        s.m_value = v;
+        s.m_hash  = h;
+        s.m_gen   = m_gen;
+        next_gen();
+    }
+
+    void clear() {
+        m_entries.clear();
+        m_num_used = 0;
+    }
+
+    unsigned size() const { return m_num_used; }
+    unsigned capacity() const { return m_capacity; }
+    uint64 hits() const { return m_hits; }
+    uint64 misses() const { return m_misses; }
+    uint64 evictions() const { return m_evictions; }
+};
+}
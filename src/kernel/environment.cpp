@@ -28,6 +28,9 @@ extern "C" object* lean_get_extension(object*, object*);
 extern "C" object* lean_set_extension(object*, object*, object*);
 extern "C" object* lean_environment_set_main_module(object*, object*);
 extern "C" object* lean_environment_main_module(object*);
+extern "C" object* lean_environment_add_theorem_check(object*, object*, object*);
+extern "C" uint8 lean_environment_is_imported_const(object*, object*);
+extern "C" uint8 lean_environment_has_imports(object*);
 
 environment mk_empty_environment(uint32 trust_lvl) {
     return get_io_result<environment>(lean_mk_empty_environment(trust_lvl, io_mk_world()));
@@ -171,18 +174,48 @@ environment environment::add_definition(declaration const & d, bool check) const
     }
 }
 
-environment environment::add_theorem(declaration const & d, bool check) const {
+static void check_theorem_value(environment const & env, declaration const & d, type_checker & checker) {
+    theorem_val const & v = d.to_theorem_val();
+    check_no_metavar_no_fvar(env, v.get_name(), v.get_value());
+    expr val_type = checker.check(v.get_value(), v.get_lparams());
+    if (!checker.is_def_eq(val_type, v.get_type()))
+        throw definition_type_mismatch_exception(env, d, val_type);
+}
+
+/* Closure body of the task created by `add_theorem`, returns an `Except KernelException Unit` */
+static obj_res check_theorem_value_task(obj_arg env, obj_arg d, obj_arg /* unit */) {
+    environment e(env);
+    declaration decl(d);
+    try {
+        return catch_kernel_exceptions<object_ref>([&]() {
+                type_checker checker(e);
+                check_theorem_value(e, decl, checker);
+                return object_ref(box(0));
+            });
+    } catch (throwable & ex) {
+        // `KernelException.other`, e.g. on deep recursion
+        return mk_cnstr(0, mk_cnstr(11, string_ref(ex.what()))).steal();
+    }
+}
+
+environment environment::add_theorem(declaration const & d, bool check, bool defer_value_check) const {
     theorem_val const & v = d.to_theorem_val();
     if (check) {
-        // TODO(Leo): we must add support for handling tasks here
         type_checker checker(*this);
         check_constant_val(*this, v.to_constant_val(), checker);
-        check_no_metavar_no_fvar(*this, v.get_name(), v.get_value());
-        expr val_type = checker.check(v.get_value(), v.get_lparams());
-        if (!checker.is_def_eq(val_type, v.get_type()))
-            throw definition_type_mismatch_exception(*this, d, val_type);
+        if (!defer_value_check)
+            check_theorem_value(*this, d, checker);
     }
-    return add(constant_info(d));
+    environment new_env = add(constant_info(d));
+    if (check && defer_value_check) {
+        /* The value is checked against the current environment, so that the theorem cannot refer to itself. */
+        object * c = lean_alloc_closure(reinterpret_cast<void *>(check_theorem_value_task), 3, 2);
+        lean_closure_set(c, 0, to_obj_arg());
+        lean_closure_set(c, 1, d.to_obj_arg());
+        object * t = lean_task_spawn_core(c, 0, false);
+        new_env.m_obj = lean_environment_add_theorem_check(new_env.m_obj, v.get_name().to_obj_arg(), t);
+    }
+    return new_env;
 }
 
 environment environment::add_opaque(declaration const & d, bool check) const {
@@ -232,11 +265,11 @@ environment environment::add_mutual(declaration const & d, bool check) const {
     return new_env;
 }
 
-environment environment::add(declaration const & d, bool check) const {
+environment environment::add(declaration const & d, bool check, bool defer_theorem_checks) const {
     switch (d.kind()) {
     case declaration_kind::Axiom:            return add_axiom(d, check);
     case declaration_kind::Definition:       return add_definition(d, check);
-    case declaration_kind::Theorem:          return add_theorem(d, check);
+    case declaration_kind::Theorem:          return add_theorem(d, check, defer_theorem_checks);
     case declaration_kind::Opaque:           return add_opaque(d, check);
     case declaration_kind::MutualDefinition: return add_mutual(d, check);
     case declaration_kind::Quot:             return add_quot();
@@ -251,6 +284,20 @@ extern "C" LEAN_EXPORT object * lean_add_decl(object * env, object * decl) {
         });
 }
 
+extern "C" LEAN_EXPORT object * lean_add_decl_deferring_theorems(object * env, object * decl) {
+    return catch_kernel_exceptions<environment>([&]() {
+            return environment(env).add(declaration(decl, true), true, true);
+        });
+}
+
+bool environment::is_imported(name const & n) const {
+    return lean_environment_is_imported_const(to_obj_arg(), n.to_obj_arg()) != 0;
+}
+
+bool environment::has_imports() const {
+    return lean_environment_has_imports(to_obj_arg()) != 0;
+}
+
 void environment::for_each_constant(std::function<void(constant_info const & d)> const & f) const {
     smap_foreach(cnstr_get(raw(), 1), [&](object *, object * v) {
             constant_info cinfo(v, true);
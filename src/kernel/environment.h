@@ -40,7 +40,7 @@ class environment : public object_ref {
     environment add(constant_info const & info) const;
     environment add_axiom(declaration const & d, bool check) const;
     environment add_definition(declaration const & d, bool check) const;
-    environment add_theorem(declaration const & d, bool check) const;
+    environment add_theorem(declaration const & d, bool check, bool defer_value_check) const;
     environment add_opaque(declaration const & d, bool check) const;
     environment add_mutual(declaration const & d, bool check) const;
     environment add_quot() const;
@@ -71,8 +71,21 @@ public:
     /** \brief Return information for the constant with name \c n. Throws and exception if constant declaration does not exist in this environment. */
     constant_info get(name const & n) const;
 
-    /** \brief Extends the current environment with the given declaration */
-    environment add(declaration const & d, bool check = true) const;
+    /** \brief Return true iff the constant \c n was imported from another module. */
+    bool is_imported(name const & n) const;
+
+    /** \brief Return true iff at least one module was imported into this environment. */
+    bool has_imports() const;
+
+    /** \brief Return an object that is shared by all environments built on top of the same set of imported
+        modules (the table of imported constants). Imported constants are never redefined, so results computed
+        from them can be reused by any environment with the same imports. */
+    b_obj_res get_imports_key() const { return cnstr_get(raw(), 0); }
+
+    /** \brief Extends the current environment with the given declaration.
+        If \c defer_theorem_checks is true, the value of a theorem is type checked in a separate task
+        (see `Environment.addDeclDeferringTheorems`). */
+    environment add(declaration const & d, bool check = true, bool defer_theorem_checks = false) const;
 
     /** \brief Apply the function \c f to each constant */
     void for_each_constant(std::function<void(constant_info const & d)> const & f) const;
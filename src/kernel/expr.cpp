@@ -27,6 +27,10 @@ literal::literal(char const * v):
     object_ref(mk_cnstr(static_cast<unsigned>(literal_kind::String), mk_string(v))) {
 }
 
+literal::literal(string_ref const & v):
+    object_ref(mk_cnstr(static_cast<unsigned>(literal_kind::String), v)) {
+}
+
 literal::literal(unsigned v):
     object_ref(mk_cnstr(static_cast<unsigned>(literal_kind::Nat), mk_nat_obj(v))) {
 }
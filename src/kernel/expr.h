@@ -46,6 +46,7 @@ class literal : public object_ref {
     explicit literal(b_obj_arg o, bool b):object_ref(o, b) {}
 public:
     explicit literal(char const * v);
+    explicit literal(string_ref const & v);
     explicit literal(unsigned v);
     explicit literal(mpz const & v);
     explicit literal(nat const & v);
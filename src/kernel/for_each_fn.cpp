@@ -11,40 +11,26 @@ Author: Leonardo de Moura
 #include "runtime/flet.h"
 #include "kernel/for_each_fn.h"
 #include "kernel/cache_stack.h"
+#include "kernel/traversal_cache.h"
 
 #ifndef LEAN_DEFAULT_FOR_EACH_CACHE_CAPACITY
 #define LEAN_DEFAULT_FOR_EACH_CACHE_CAPACITY 1024*8
 #endif
 
+#ifndef LEAN_MAX_FOR_EACH_CACHE_CAPACITY
+#define LEAN_MAX_FOR_EACH_CACHE_CAPACITY 1024*1024
+#endif
+
 namespace lean {
-struct for_each_cache {
-    struct entry {
-        object const *    m_cell;
-        unsigned          m_offset;
-        entry():m_cell(nullptr) {}
-    };
-    unsigned              m_capacity;
-    std::vector<entry>    m_cache;
-    std::vector<unsigned> m_used;
-    for_each_cache(unsigned c):m_capacity(c), m_cache(c) {}
+struct for_each_cache : public traversal_cache<bool> {
+    for_each_cache(unsigned c):traversal_cache<bool>(c, LEAN_MAX_FOR_EACH_CACHE_CAPACITY) {}
 
+    /* Return true if `(e, offset)` has already been visited, and mark it as visited otherwise. */
     bool visited(expr const & e, unsigned offset) {
-        unsigned i = hash(hash(e), offset) % m_capacity;
-        if (m_cache[i].m_cell == e.raw() && m_cache[i].m_offset == offset) {
+        if (find(e.raw(), offset))
             return true;
-        } else {
-            if (m_cache[i].m_cell == nullptr)
-                m_used.push_back(i);
-            m_cache[i].m_cell   = e.raw();
-            m_cache[i].m_offset = offset;
-            return false;
-        }
-    }
-
-    void clear() {
-        for (unsigned i : m_used)
-            m_cache[i].m_cell = nullptr;
-        m_used.clear();
+        insert(e.raw(), offset, true);
+        return false;
     }
 };
 
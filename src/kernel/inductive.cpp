@@ -1166,9 +1166,14 @@ environment environment::add_inductive(declaration const & d) const {
     }
 }
 
+#ifndef LEAN_STRING_LIT_CHUNK_SIZE
+#define LEAN_STRING_LIT_CHUNK_SIZE 64
+#endif
+
 static expr * g_nat_zero       = nullptr;
 static expr * g_nat_succ       = nullptr;
 static expr * g_string_mk      = nullptr;
+static name * g_string         = nullptr;
 static expr * g_list_cons_char = nullptr;
 static expr * g_list_nil_char  = nullptr;
 static expr * g_char_of_nat    = nullptr;
@@ -1196,6 +1201,27 @@ expr string_lit_to_constructor(expr const & e) {
     return mk_app(*g_string_mk, r);
 }
 
+expr string_lit_to_constructor_head(expr const & e) {
+    lean_assert(is_string_lit(e));
+    string_ref const & s = lit_value(e).get_string();
+    size_t sz = s.num_bytes();
+    /* Expose at least `LEAN_STRING_LIT_CHUNK_SIZE` characters and at least half of the bytes. The remaining literal,
+       which is copied, is then at most half as long as `s`, so that walking the whole string takes linear time and
+       memory instead of copying every suffix. */
+    buffer<unsigned> cs;
+    size_t i = 0;
+    while (i < sz && (cs.size() < LEAN_STRING_LIT_CHUNK_SIZE || 2 * i < sz))
+        cs.push_back(next_utf8(s.data(), sz, i));
+    expr r;
+    if (i == sz)
+        r = *g_list_nil_char;
+    else
+        r = mk_proj(*g_string, 0, mk_lit(literal(string_ref(std::string(s.data() + i, sz - i)))));
+    for (unsigned j = cs.size(); j > 0; j--)
+        r = mk_app(*g_list_cons_char, mk_app(*g_char_of_nat, mk_lit(literal(cs[j - 1]))), r);
+    return mk_app(*g_string_mk, r);
+}
+
 
 void initialize_inductive() {
     g_nested         = new name("_nested");
@@ -1210,6 +1236,8 @@ void initialize_inductive() {
     mark_persistent(g_nat_succ->raw());
     g_string_mk      = new expr(mk_constant(name{"String", "mk"}));
     mark_persistent(g_string_mk->raw());
+    g_string         = new name("String");
+    mark_persistent(g_string->raw());
     expr char_type   = mk_constant(name{"Char"});
     g_list_cons_char = new expr(mk_app(mk_constant(name{"List", "cons"}, {level()}), char_type));
     mark_persistent(g_list_cons_char->raw());
@@ -1228,6 +1256,7 @@ void finalize_inductive() {
     delete g_nat_succ;
     delete g_nat_zero;
     delete g_string_mk;
+    delete g_string;
     delete g_list_cons_char;
     delete g_list_nil_char;
 }
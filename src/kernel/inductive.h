@@ -53,6 +53,10 @@ optional<recursor_rule> get_rec_rule_for(recursor_val const & rec_val, expr cons
 
 expr nat_lit_to_constructor(expr const & e);
 expr string_lit_to_constructor(expr const & e);
+/* Similar to `string_lit_to_constructor`, but only a prefix of the string is exposed:
+   `String.mk (c_1 :: ... :: c_k :: String.data s')` where `s'` is the remaining string literal. The prefix contains at
+   least `LEAN_STRING_LIT_CHUNK_SIZE` characters and at least half of the string. */
+expr string_lit_to_constructor_head(expr const & e);
 
 /* Auxiliary method for \c to_cnstr_when_structure, convert `e` into `mk e.1 ... e.n` */
 expr expand_eta_struct(environment const & env, expr const & e_type, expr const & e);
@@ -90,7 +94,7 @@ inline optional<expr> inductive_reduce_rec(environment const & env, expr const &
     if (is_nat_lit(major))
         major = nat_lit_to_constructor(major);
     else if (is_string_lit(major))
-        major = string_lit_to_constructor(major);
+        major = string_lit_to_constructor_head(major);
     else
         major = to_cnstr_when_structure(env, rec_val.get_induct(), major, whnf, infer_type);
     optional<recursor_rule> rule = get_rec_rule_for(rec_val, major);
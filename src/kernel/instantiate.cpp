@@ -6,6 +6,7 @@ Author: Leonardo de Moura
 */
 #include <algorithm>
 #include <limits>
+#include "runtime/interrupt.h"
 #include "kernel/replace_fn.h"
 #include "kernel/declaration.h"
 #include "kernel/instantiate.h"
@@ -180,15 +181,95 @@ expr apply_beta(expr f, unsigned num_args, expr const * args) {
     }
 }
 
+/* Compute the head beta normal form of `mk_rev_app(instantiate_rev(e, ctx), rev_args)`.
+
+   Instead of instantiating the whole body of each lambda and then building the application, we only
+   traverse the spine of `e`. The arguments found along the way are instantiated (`instantiate_rev` returns
+   them unchanged if they do not contain loose bound variables), the lambdas consume the pending arguments by
+   pushing them on `ctx`, and a head that is a bound variable in `ctx` is replaced with its value. Thus, the
+   bodies of intermediate redexes are never copied. Metadata in the head is ignored when there are pending
+   arguments. */
+static expr head_beta_core(expr e, buffer<expr> & ctx, buffer<expr> & rev_args) {
+    while (true) {
+        check_system("head beta reduction");
+        switch (e.kind()) {
+        case expr_kind::App:
+            /* The arguments of `e` precede the pending ones, so they go at the end of `rev_args` */
+            while (is_app(e)) {
+                rev_args.push_back(instantiate_rev(app_arg(e), ctx.size(), ctx.data()));
+                e = app_fn(e);
+            }
+            break;
+        case expr_kind::Lambda:
+            if (rev_args.empty())
+                return instantiate_rev(e, ctx.size(), ctx.data());
+            ctx.push_back(rev_args.back());
+            rev_args.pop_back();
+            e = binding_body(e);
+            break;
+        case expr_kind::MData:
+            if (rev_args.empty())
+                return instantiate_rev(e, ctx.size(), ctx.data());
+            e = mdata_expr(e);
+            break;
+        case expr_kind::BVar: {
+            nat const & vidx = bvar_idx(e);
+            if (vidx.is_small() && vidx.get_small_value() < ctx.size()) {
+                /* The value does not contain references to `ctx` */
+                e = ctx[ctx.size() - vidx.get_small_value() - 1];
+                ctx.clear();
+            } else {
+                return mk_bvar(vidx - nat(ctx.size()));
+            }
+            break;
+        }
+        default:
+            return instantiate_rev(e, ctx.size(), ctx.data());
+        }
+    }
+}
+
+expr head_beta_instantiate(expr const & e, unsigned n, expr const * subst, unsigned num_rev_args, expr const * rev_args) {
+    if (num_rev_args == 0 && !is_app(e) && !is_bvar(e))
+        return instantiate(e, n, subst);
+    buffer<expr> ctx;
+    for (unsigned i = n; i > 0; i--)
+        ctx.push_back(subst[i - 1]);
+    buffer<expr> args;
+    args.append(num_rev_args, rev_args);
+    expr f = head_beta_core(e, ctx, args);
+    return mk_rev_app(f, args.size(), args.data());
+}
+
 expr head_beta_reduce(expr const & t) {
-    if (!is_head_beta(t)) {
+    if (!is_head_beta(t))
         return t;
-    } else {
-        buffer<expr> args;
-        expr const & f = get_app_rev_args(t, args);
-        lean_assert(is_lambda(f));
-        return head_beta_reduce(apply_beta(f, args.size(), args.data()));
+    return head_beta_instantiate(t, 0, nullptr, 0, nullptr);
+}
+
+/* Like `is_head_beta`, but ignores metadata around the head (see `Expr.isHeadBetaTarget`) */
+static bool is_head_beta_target(expr const & e) {
+    if (!is_app(e))
+        return false;
+    expr f = get_app_fn(e);
+    while (is_mdata(f))
+        f = mdata_expr(f);
+    return is_lambda(f);
+}
+
+extern "C" LEAN_EXPORT object * lean_expr_head_beta(b_obj_arg e0) {
+    expr const & e = TO_REF(expr, e0);
+    if (!is_head_beta_target(e)) {
+        lean_inc(e0);
+        return e0;
     }
+    return head_beta_instantiate(e, 0, nullptr, 0, nullptr).steal();
+}
+
+extern "C" LEAN_EXPORT object * lean_expr_instantiate_head_beta(b_obj_arg e0, b_obj_arg subst) {
+    expr const & e = TO_REF(expr, e0);
+    usize n = lean_array_size(subst);
+    return head_beta_instantiate(e, n, reinterpret_cast<expr const *>(lean_array_cptr(subst)), 0, nullptr).steal();
 }
 
 expr cheap_beta_reduce(expr const & e) {
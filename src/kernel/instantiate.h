@@ -26,6 +26,14 @@ inline expr instantiate_rev(expr const & e, buffer<expr> const & s) {
 
 expr apply_beta(expr f, unsigned num_rev_args, expr const * rev_args);
 bool is_head_beta(expr const & t);
+/** \brief Return the head beta normal form of `mk_rev_app(instantiate(e, n, subst), num_rev_args, rev_args)`.
+    Only the subterms along the spine of the head are instantiated, and no intermediate redexes are built. */
+expr head_beta_instantiate(expr const & e, unsigned n, expr const * subst, unsigned num_rev_args, expr const * rev_args);
+inline expr head_beta_instantiate(expr const & e, expr const & s) { return head_beta_instantiate(e, 1, &s, 0, nullptr); }
+/** \brief Return the head beta normal form of `mk_rev_app(f, num_rev_args, rev_args)`. */
+inline expr head_beta_apply(expr const & f, unsigned num_rev_args, expr const * rev_args) {
+    return head_beta_instantiate(f, 0, nullptr, num_rev_args, rev_args);
+}
 expr head_beta_reduce(expr const & t);
 /* If `e` is of the form `(fun x, t) a` return `head_beta_const_fn(t)` if `t` does not depend on `x`,
    and `e` otherwise. We also reduce `(fun x_1 ... x_n, x_i) a_1 ... a_n` into `a_[n-i-1]` */
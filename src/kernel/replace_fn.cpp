@@ -8,48 +8,21 @@ Author: Leonardo de Moura
 #include <memory>
 #include "kernel/replace_fn.h"
 #include "kernel/cache_stack.h"
+#include "kernel/traversal_cache.h"
 
 #ifndef LEAN_DEFAULT_REPLACE_CACHE_CAPACITY
 #define LEAN_DEFAULT_REPLACE_CACHE_CAPACITY 1024*8
 #endif
 
-namespace lean {
-struct replace_cache {
-    struct entry {
-        object  *  m_cell;
-        unsigned   m_offset;
-        expr       m_result;
-        entry():m_cell(nullptr) {}
-    };
-    unsigned              m_capacity;
-    std::vector<entry>    m_cache;
-    std::vector<unsigned> m_used;
-    replace_cache(unsigned c):m_capacity(c), m_cache(c) {}
-
-    expr * find(expr const & e, unsigned offset) {
-        unsigned i = hash(hash(e), offset) % m_capacity;
-        if (m_cache[i].m_cell == e.raw() && m_cache[i].m_offset == offset)
-            return &m_cache[i].m_result;
-        else
-            return nullptr;
-    }
-
-    void insert(expr const & e, unsigned offset, expr const & v) {
-        unsigned i = hash(hash(e), offset) % m_capacity;
-        if (m_cache[i].m_cell == nullptr)
-            m_used.push_back(i);
-        m_cache[i].m_cell   = e.raw();
-        m_cache[i].m_offset = offset;
-        m_cache[i].m_result = v;
-    }
+#ifndef LEAN_MAX_REPLACE_CACHE_CAPACITY
+#define LEAN_MAX_REPLACE_CACHE_CAPACITY 1024*1024
+#endif
 
-    void clear() {
-        for (unsigned i : m_used) {
-            m_cache[i].m_cell   = nullptr;
-            m_cache[i].m_result = expr();
-        }
-        m_used.clear();
-    }
+namespace lean {
+struct replace_cache : public traversal_cache<expr> {
+    replace_cache(unsigned c):traversal_cache<expr>(c, LEAN_MAX_REPLACE_CACHE_CAPACITY) {}
+    expr * find(expr const & e, unsigned offset) { return traversal_cache<expr>::find(e.raw(), offset); }
+    void insert(expr const & e, unsigned offset, expr const & v) { traversal_cache<expr>::insert(e.raw(), offset, v); }
 };
 
 /* CACHE_RESET: NO */
@@ -0,0 +1,128 @@
+/*
+Copyright (c) 2021 Microsoft Corporation. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+*/
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <utility>
+#include "runtime/int64.h"
+#include "runtime/object.h"
+#include "runtime/debug.h"
+
+namespace lean {
+/** \brief Set-associative cache keyed by (object pointer, offset) pairs used by expression traversals
+    (`replace`, `for_each`) to avoid visiting shared subterms more than once.
+
+    Each bucket holds `g_ways` entries, the most recently inserted first. When a traversal keeps evicting
+    entries because the term is larger, or has more sharing, than the table, the number of buckets is doubled
+    (up to \c max_capacity entries) and the live entries are rehashed. The table is cleared after each traversal,
+    and shrunk back to its initial size once `g_shrink_delay` traversals in a row only used a small fraction
+    of it. Shrinking after a single small traversal made workloads that alternate between large and small
+    terms regrow the table for every large one. */
+template<typename V>
+class traversal_cache {
+    static constexpr unsigned g_ways = 4;
+    static constexpr unsigned g_shrink_delay = 16;
+    struct entry {
+        object const * m_cell{nullptr};
+        unsigned       m_offset{0};
+        V              m_value{};
+    };
+    unsigned              m_min_buckets;
+    unsigned              m_max_buckets;
+    std::vector<entry>    m_entries;
+    /* Buckets containing at least one entry */
+    std::vector<unsigned> m_used;
+    unsigned              m_evictions{0};
+    /* Number of consecutive traversals that used less than 1/8 of the buckets of a grown table */
+    unsigned              m_small_traversals{0};
+
+    static unsigned to_buckets(unsigned capacity) {
+        unsigned r = 1;
+        while (r * g_ways < capacity)
+            r *= 2;
+        return r;
+    }
+
+    unsigned num_buckets() const { return m_entries.size() / g_ways; }
+
+    entry * get_bucket(object const * cell, unsigned offset) {
+        /* We use the address instead of the structural hash code of the expression: terms that are
+           structurally equal but not shared would be mapped to the same bucket. */
+        uint64 h = ((static_cast<uint64>(reinterpret_cast<uintptr_t>(cell)) >> 3) + offset) * 11400714819323198485ull;
+        return &m_entries[(static_cast<unsigned>(h >> 32) & (num_buckets() - 1)) * g_ways];
+    }
+
+    void insert_core(object const * cell, unsigned offset, V && v) {
+        entry * es = get_bucket(cell, offset);
+        if (es[0].m_cell == nullptr)
+            m_used.push_back((es - m_entries.data()) / g_ways);
+        else if (es[g_ways - 1].m_cell != nullptr)
+            m_evictions++;
+        for (unsigned i = g_ways - 1; i > 0; i--)
+            es[i] = std::move(es[i-1]);
+        es[0].m_cell   = cell;
+        es[0].m_offset = offset;
+        es[0].m_value  = std::move(v);
+    }
+
+    void grow() {
+        std::vector<entry> old_entries(m_entries.size() * 2);
+        old_entries.swap(m_entries);
+        std::vector<unsigned> old_used;
+        old_used.swap(m_used);
+        for (unsigned b : old_used) {
+            /* Reinsert the oldest entries first to preserve the order in the new buckets */
+            for (unsigned i = g_ways; i > 0; i--) {
+                entry & e = old_entries[b * g_ways + i - 1];
+                if (e.m_cell)
+                    insert_core(e.m_cell, e.m_offset, std::move(e.m_value));
+            }
+        }
+        m_evictions = 0;
+    }
+
+public:
+    traversal_cache(unsigned min_capacity, unsigned max_capacity):
+        m_min_buckets(to_buckets(min_capacity)), m_max_buckets(to_buckets(max_capacity)),
+        m_entries(m_min_buckets * g_ways) {
+        lean_assert(m_min_buckets <= m_max_buckets);
+    }
+
+    V * find(object const * cell, unsigned offset) {
+        entry * es = get_bucket(cell, offset);
+        for (unsigned i = 0; i < g_ways && es[i].m_cell != nullptr; i++) {
+            if (es[i].m_cell == cell && es[i].m_offset == offset)
+                return &es[i].m_value;
+        }
+        return nullptr;
+    }
+
+    void insert(object const * cell, unsigned offset, V v) {
+        insert_core(cell, offset, std::move(v));
+        if (m_evictions > num_buckets() && num_buckets() < m_max_buckets)
+            grow();
+    }
+
+    void clear() {
+        if (num_buckets() > m_min_buckets && m_used.size() < num_buckets() / 8)
+            m_small_traversals++;
+        else
+            m_small_traversals = 0;
+        if (m_small_traversals >= g_shrink_delay) {
+            std::vector<entry>(m_min_buckets * g_ways).swap(m_entries);
+            m_small_traversals = 0;
+        } else {
+            for (unsigned b : m_used) {
+                for (unsigned i = 0; i < g_ways; i++)
+                    m_entries[b * g_ways + i] = entry();
+            }
+        }
+        m_used.clear();
+        m_evictions = 0;
+    }
+
+    unsigned capacity() const { return m_entries.size(); }
+};
+}
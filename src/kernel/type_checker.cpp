@@ -6,7 +6,10 @@ Author: Leonardo de Moura
 */
 #include <utility>
 #include <vector>
+#include <cstdlib>
+#include <memory>
 #include "runtime/interrupt.h"
+#include "runtime/thread.h"
 #include "runtime/sstream.h"
 #include "runtime/flet.h"
 #include "util/lbool.h"
@@ -32,9 +35,239 @@ static expr * g_nat_mod      = nullptr;
 static expr * g_nat_div      = nullptr;
 static expr * g_nat_beq      = nullptr;
 static expr * g_nat_ble      = nullptr;
+static expr * g_nat_land     = nullptr;
+static expr * g_nat_lor      = nullptr;
+static expr * g_nat_xor      = nullptr;
+static expr * g_nat_shiftl   = nullptr;
+static expr * g_nat_shiftr   = nullptr;
+static expr * g_nat_pow      = nullptr;
+static expr * g_nat_gcd      = nullptr;
+static expr * g_nat_log2     = nullptr;
+static expr * g_string_length         = nullptr;
+static expr * g_string_utf8_byte_size = nullptr;
+static expr * g_string_append         = nullptr;
+static expr * g_string_dec_eq         = nullptr;
+static expr * g_string_type           = nullptr;
+static expr * g_bool_type             = nullptr;
+static expr * g_eq_refl_1             = nullptr;
+static expr * g_eq_1                  = nullptr;
+static expr * g_decidable_is_true     = nullptr;
+static expr * g_decidable_is_false    = nullptr;
+static expr * g_of_decide_eq_false    = nullptr;
+
+static unsigned g_cache_capacity = LEAN_DEFAULT_TYPE_CHECKER_CACHE_CAPACITY;
+
+unsigned get_type_checker_cache_capacity() { return g_cache_capacity; }
+
+void set_type_checker_cache_capacity(unsigned capacity) {
+    /* round up to a power of two */
+    unsigned c = 8;
+    while (c < capacity && c < (1u << 31)) c *= 2;
+    g_cache_capacity = c;
+}
+
+typedef type_checker_stats::cache_kind tc_cache_kind;
+static char const * g_cache_names[] = { "infer_type", "infer_type (infer only)", "whnf_core", "whnf", "failure" };
+
+struct tc_cache_stats {
+    uint64 m_hits{0};
+    uint64 m_misses{0};
+    uint64 m_evictions{0};
+};
+
+/* Counters of all `type_checker::state` objects destroyed so far. They are updated by every thread that destroys a
+   state, so they are atomic instead of being protected by a mutex. */
+struct global_tc_cache_stats {
+    atomic<uint64> m_hits{0};
+    atomic<uint64> m_misses{0};
+    atomic<uint64> m_evictions{0};
+};
+
+static global_tc_cache_stats g_cache_stats[type_checker_stats::NumCaches];
+
+template<typename C> static void add_cache_stats(type_checker_stats * stats, tc_cache_kind k, C const & c) {
+    global_tc_cache_stats & s = g_cache_stats[k];
+    s.m_hits.fetch_add(c.hits(), std::memory_order_relaxed);
+    s.m_misses.fetch_add(c.misses(), std::memory_order_relaxed);
+    s.m_evictions.fetch_add(c.evictions(), std::memory_order_relaxed);
+    if (stats) {
+        stats->m_cache_hits[k]   += c.hits();
+        stats->m_cache_misses[k] += c.misses();
+    }
+}
+
+LEAN_THREAD_PTR(type_checker_stats, g_current_stats);
+
+scoped_type_checker_stats::scoped_type_checker_stats():m_old(g_current_stats) {
+    g_current_stats = &m_stats;
+}
+
+scoped_type_checker_stats::~scoped_type_checker_stats() {
+    g_current_stats = m_old;
+    if (m_old)
+        m_old->merge(m_stats);
+}
+
+void type_checker_stats::merge(type_checker_stats const & s) {
+    m_infer_type         += s.m_infer_type;
+    m_whnf               += s.m_whnf;
+    m_whnf_core          += s.m_whnf_core;
+    m_is_def_eq          += s.m_is_def_eq;
+    m_is_def_eq_failures += s.m_is_def_eq_failures;
+    m_lazy_delta_steps   += s.m_lazy_delta_steps;
+    m_shared_cache_hits  += s.m_shared_cache_hits;
+    for (unsigned i = 0; i < NumCaches; i++) {
+        m_cache_hits[i]   += s.m_cache_hits[i];
+        m_cache_misses[i] += s.m_cache_misses[i];
+    }
+    for (auto const & p : s.m_unfolded)
+        m_unfolded[p.first] += p.second;
+}
+
+void type_checker_stats::display(std::ostream & out, unsigned max_unfolded) const {
+    out << "  kernel: " << m_infer_type << " infer_type, " << m_whnf << " whnf, " << m_whnf_core << " whnf_core, "
+        << m_is_def_eq << " is_def_eq (" << m_is_def_eq_failures << " failed), "
+        << m_lazy_delta_steps << " lazy delta steps\n";
+    out << "  kernel cache hits/misses:";
+    for (unsigned i = 0; i < NumCaches; i++)
+        out << (i > 0 ? ", " : " ") << g_cache_names[i] << " " << m_cache_hits[i] << "/" << m_cache_misses[i];
+    out << ", shared " << m_shared_cache_hits << "\n";
+    if (m_unfolded.empty())
+        return;
+    std::vector<std::pair<name, uint64>> unfolded(m_unfolded.begin(), m_unfolded.end());
+    std::sort(unfolded.begin(), unfolded.end(), [](std::pair<name, uint64> const & a, std::pair<name, uint64> const & b) {
+            return a.second > b.second || (a.second == b.second && quick_cmp(a.first, b.first) < 0);
+        });
+    uint64 total = 0;
+    for (auto const & p : unfolded)
+        total += p.second;
+    out << "  kernel delta unfoldings: " << total << " of " << unfolded.size() << " constants\n";
+    for (unsigned i = 0; i < unfolded.size() && i < max_unfolded; i++)
+        out << "    " << unfolded[i].first << " " << unfolded[i].second << "\n";
+}
+
+
+/* Process-wide cache for the `whnf` or the inferred type of closed terms which only contain imported constants.
+   Imported constants are never redefined, so these results can be reused by all declarations checked in
+   environments with the same imports, i.e., the same `environment::get_imports_key()`. The table is split
+   into shards, each one protected by its own mutex, and it only contains entries for the most recent key. */
+class shared_expr_cache {
+    struct shard {
+        mutex                                                    m_mutex;
+        object *                                                 m_imports_key = nullptr;
+        bounded_cache<expr, expr, expr_hash, std::equal_to<expr>> m_cache;
+        explicit shard(unsigned capacity):m_cache(capacity) {}
+    };
+    static constexpr unsigned g_num_shards_log2 = 5;
+    std::vector<std::unique_ptr<shard>> m_shards;
+
+    shard & get_shard(expr const & e) {
+        /* `bounded_cache` uses the low bits of the hash code, so we use the high bits of a scrambled hash code
+           to select the shard. */
+        return *m_shards[(hash(e) * 2654435761u) >> (32 - g_num_shards_log2)];
+    }
+
+public:
+    explicit shared_expr_cache(unsigned capacity) {
+        unsigned shard_capacity = 8;
+        while (shard_capacity < (capacity >> g_num_shards_log2))
+            shard_capacity *= 2;
+        for (unsigned i = 0; i < (1u << g_num_shards_log2); i++)
+            m_shards.emplace_back(new shard(shard_capacity));
+    }
+
+    ~shared_expr_cache() {
+        for (auto & s : m_shards) {
+            s->m_cache.clear();
+            if (s->m_imports_key)
+                dec_ref(s->m_imports_key);
+        }
+    }
+
+    optional<expr> find(object * imports_key, expr const & e) {
+        shard & s = get_shard(e);
+        lock_guard<mutex> lock(s.m_mutex);
+        if (s.m_imports_key != imports_key)
+            return none_expr();
+        if (expr const * r = s.m_cache.find(e))
+            return some_expr(*r);
+        return none_expr();
+    }
+
+    void insert(object * imports_key, expr const & e, expr const & r) {
+        /* The entries are shared between threads */
+        mark_mt(e.raw());
+        mark_mt(r.raw());
+        shard & s = get_shard(e);
+        lock_guard<mutex> lock(s.m_mutex);
+        if (s.m_imports_key != imports_key) {
+            s.m_cache.clear();
+            if (s.m_imports_key)
+                dec_ref(s.m_imports_key);
+            mark_mt(imports_key);
+            inc_ref(imports_key);
+            s.m_imports_key = imports_key;
+        }
+        s.m_cache.insert(e, r);
+    }
+
+    tc_cache_stats get_stats() {
+        tc_cache_stats r;
+        for (auto & s : m_shards) {
+            lock_guard<mutex> lock(s->m_mutex);
+            r.m_hits      += s->m_cache.hits();
+            r.m_misses    += s->m_cache.misses();
+            r.m_evictions += s->m_cache.evictions();
+        }
+        return r;
+    }
+};
+
+static unsigned            g_shared_cache_capacity = LEAN_DEFAULT_TYPE_CHECKER_SHARED_CACHE_CAPACITY;
+static shared_expr_cache * g_shared_whnf           = nullptr;
+static shared_expr_cache * g_shared_infer_type[2]  = { nullptr, nullptr };
+
+static void display_cache_stats(std::ostream & out, char const * name, uint64 hits, uint64 misses, uint64 evictions) {
+    out << "  " << name << ": " << hits << " hits, " << misses << " misses, " << evictions << " evictions";
+    if (hits + misses > 0)
+        out << ", hit rate " << (100 * hits / (hits + misses)) << "%";
+    out << "\n";
+}
+
+static void display_shared_cache_stats(std::ostream & out, char const * name, shared_expr_cache * c) {
+    if (!c) return;
+    tc_cache_stats s = c->get_stats();
+    display_cache_stats(out, (std::string("shared ") + name).c_str(), s.m_hits, s.m_misses, s.m_evictions);
+}
+
+void display_type_checker_cache_stats(std::ostream & out) {
+    out << "type checker caches (capacity " << g_cache_capacity << "):\n";
+    for (unsigned i = 0; i < type_checker_stats::NumCaches; i++) {
+        global_tc_cache_stats const & s = g_cache_stats[i];
+        display_cache_stats(out, g_cache_names[i], s.m_hits.load(), s.m_misses.load(), s.m_evictions.load());
+    }
+    display_shared_cache_stats(out, "infer_type", g_shared_infer_type[0]);
+    display_shared_cache_stats(out, "infer_type (infer only)", g_shared_infer_type[1]);
+    display_shared_cache_stats(out, "whnf", g_shared_whnf);
+}
+
+type_checker::state::state(environment const & env, unsigned cache_capacity):
+    m_env(env), m_ngen(*g_kernel_fresh),
+    m_infer_type{expr_cache(cache_capacity), expr_cache(cache_capacity)},
+    m_whnf_core(cache_capacity), m_whnf(cache_capacity), m_failure(cache_capacity),
+    m_imports_key(g_shared_whnf && env.has_imports() ? env.get_imports_key() : nullptr),
+    m_only_imported(cache_capacity), m_stats(g_current_stats) {}
 
 type_checker::state::state(environment const & env):
-    m_env(env), m_ngen(*g_kernel_fresh) {}
+    state(env, g_cache_capacity) {}
+
+type_checker::state::~state() {
+    add_cache_stats(m_stats, type_checker_stats::InferType, m_infer_type[0]);
+    add_cache_stats(m_stats, type_checker_stats::InferTypeOnly, m_infer_type[1]);
+    add_cache_stats(m_stats, type_checker_stats::WhnfCore, m_whnf_core);
+    add_cache_stats(m_stats, type_checker_stats::Whnf, m_whnf);
+    add_cache_stats(m_stats, type_checker_stats::Failure, m_failure);
+}
 
 /** \brief Make sure \c e "is" a sort, and return the corresponding sort.
     If \c e is not a sort, then the whnf procedure is invoked.
@@ -273,10 +506,25 @@ expr type_checker::infer_type_core(expr const & e, bool infer_only) {
 
     lean_assert(!has_loose_bvars(e));
     check_system("type checker");
-
-    auto it = m_st->m_infer_type[infer_only].find(e);
-    if (it != m_st->m_infer_type[infer_only].end())
-        return it->second;
+    if (type_checker_stats * stats = m_st->m_stats)
+        stats->m_infer_type++;
+
+    if (expr const * r = m_st->m_infer_type[infer_only].find(e))
+        return *r;
+
+    /* When checking, the result depends on the universe parameters in scope and on whether unsafe constants are
+       allowed, so we only share results for terms without universe parameters checked in safe mode. */
+    bool share =
+        g_shared_infer_type[infer_only] && !is_atomic(e) && !is_mdata(e) &&
+        (infer_only || !has_univ_param(e)) && is_shareable(e);
+    if (share) {
+        if (optional<expr> r = g_shared_infer_type[infer_only]->find(m_st->m_imports_key, e)) {
+            if (type_checker_stats * stats = m_st->m_stats)
+                stats->m_shared_cache_hits++;
+            m_st->m_infer_type[infer_only].insert(e, *r);
+            return *r;
+        }
+    }
 
     expr r;
     switch (e.kind()) {
@@ -298,7 +546,9 @@ expr type_checker::infer_type_core(expr const & e, bool infer_only) {
     case expr_kind::Let:      r = infer_let(e, infer_only);            break;
     }
 
-    m_st->m_infer_type[infer_only].insert(mk_pair(e, r));
+    m_st->m_infer_type[infer_only].insert(e, r);
+    if (share && (infer_only || m_safe_only))
+        g_shared_infer_type[infer_only]->insert(m_st->m_imports_key, e, r);
     return r;
 }
 
@@ -367,7 +617,7 @@ optional<expr> type_checker::reduce_proj(expr const & e, bool cheap) {
     else
         c = whnf(proj_expr(e));
     if (is_string_lit(c))
-        c = string_lit_to_constructor(c);
+        c = string_lit_to_constructor_head(c);
     buffer<expr> args;
     expr const & mk = get_app_args(c, args);
     if (!is_constant(mk))
@@ -415,11 +665,13 @@ expr type_checker::whnf_core(expr const & e, bool cheap) {
         break;
     }
 
+    if (type_checker_stats * stats = m_st->m_stats)
+        stats->m_whnf_core++;
+
     // check cache
     if (!cheap) {
-        auto it = m_st->m_whnf_core.find(e);
-        if (it != m_st->m_whnf_core.end())
-            return it->second;
+        if (expr const * r = m_st->m_whnf_core.find(e))
+            return *r;
     }
 
     // do the actual work
@@ -443,14 +695,7 @@ expr type_checker::whnf_core(expr const & e, bool cheap) {
         expr f0 = get_app_rev_args(e, args);
         expr f = whnf_core(f0, cheap);
         if (is_lambda(f)) {
-            unsigned m = 1;
-            unsigned num_args = args.size();
-            while (is_lambda(binding_body(f)) && m < num_args) {
-                f = binding_body(f);
-                m++;
-            }
-            lean_assert(m <= num_args);
-            r = whnf_core(mk_rev_app(instantiate(binding_body(f), m, args.data() + (num_args - m)), num_args - m, args.data()), cheap);
+            r = whnf_core(head_beta_apply(f, args.size(), args.data()), cheap);
         } else if (f == f0) {
             if (auto r = reduce_recursor(e, cheap)) {
                 /* iota-reduction and quotient reduction rules */
@@ -464,12 +709,12 @@ expr type_checker::whnf_core(expr const & e, bool cheap) {
         break;
     }
     case expr_kind::Let:
-        r = whnf_core(instantiate(let_body(e), let_value(e)), cheap);
+        r = whnf_core(head_beta_instantiate(let_body(e), let_value(e)), cheap);
         break;
     }
 
     if (!cheap) {
-        m_st->m_whnf_core.insert(mk_pair(e, r));
+        m_st->m_whnf_core.insert(e, r);
     }
     return r;
 }
@@ -489,8 +734,11 @@ optional<constant_info> type_checker::is_delta(expr const & e) const {
 optional<expr> type_checker::unfold_definition_core(expr const & e) {
     if (is_constant(e)) {
         if (auto d = is_delta(e)) {
-            if (length(const_levels(e)) == d->get_num_lparams())
+            if (length(const_levels(e)) == d->get_num_lparams()) {
+                if (type_checker_stats * stats = m_st->m_stats)
+                    stats->m_unfolded[const_name(e)]++;
                 return some_expr(instantiate_value_lparams(*d, const_levels(e)));
+            }
         }
     }
     return none_expr();
@@ -559,7 +807,30 @@ template<typename F> optional<expr> type_checker::reduce_bin_nat_op(F const & f,
     if (!is_nat_lit_ext(arg2)) return none_expr();
     nat v1 = get_nat_val(arg1);
     nat v2 = get_nat_val(arg2);
-    return some_expr(mk_lit(literal(nat(f(v1.raw(), v2.raw())))));
+    object * r = f(v1.raw(), v2.raw());
+    if (!r) return none_expr(); // result is too big, see `nat_pow_bounded`
+    return some_expr(mk_lit(literal(nat(r))));
+}
+
+#ifndef LEAN_KERNEL_MAX_NAT_EXPONENT
+#define LEAN_KERNEL_MAX_NAT_EXPONENT (1u << 24)
+#endif
+
+/* The size of the result of `Nat.pow` and `Nat.shiftLeft` is linear in the second argument.
+   We do not reduce them on huge literals, since the runtime would fail to allocate the result. */
+static obj_res nat_pow_bounded(b_obj_arg a1, b_obj_arg a2) {
+    if (!is_scalar(a2) || unbox(a2) > LEAN_KERNEL_MAX_NAT_EXPONENT) return nullptr;
+    return nat_pow(a1, a2);
+}
+
+static obj_res nat_shiftl_bounded(b_obj_arg a1, b_obj_arg a2) {
+    if (!is_scalar(a2) || unbox(a2) > LEAN_KERNEL_MAX_NAT_EXPONENT) return nullptr;
+    return nat_shiftl(a1, a2);
+}
+
+static obj_res nat_shiftr_core(b_obj_arg a1, b_obj_arg a2) {
+    if (!is_scalar(a2)) return mk_nat_obj(0u); // `a1` cannot have that many bits
+    return nat_shiftr(a1, a2);
 }
 
 template<typename F> optional<expr> type_checker::reduce_bin_nat_pred(F const & f, expr const & e) {
@@ -583,6 +854,12 @@ optional<expr> type_checker::reduce_nat(expr const & e) {
             nat v = get_nat_val(arg);
             return some_expr(mk_lit(literal(nat(v+nat(1)))));
         }
+        if (f == *g_nat_log2) {
+            expr arg = whnf(app_arg(e));
+            if (!is_nat_lit_ext(arg)) return none_expr();
+            nat v = get_nat_val(arg);
+            return some_expr(mk_lit(literal(nat(nat_log2(v.raw())))));
+        }
     } else if (nargs == 2) {
         expr const & f = app_fn(app_fn(e));
         if (!is_constant(f)) return none_expr();
@@ -593,6 +870,50 @@ optional<expr> type_checker::reduce_nat(expr const & e) {
         if (f == *g_nat_div) return reduce_bin_nat_op(nat_div, e);
         if (f == *g_nat_beq) return reduce_bin_nat_pred(nat_eq, e);
         if (f == *g_nat_ble) return reduce_bin_nat_pred(nat_le, e);
+        if (f == *g_nat_land) return reduce_bin_nat_op(nat_land, e);
+        if (f == *g_nat_lor) return reduce_bin_nat_op(nat_lor, e);
+        if (f == *g_nat_xor) return reduce_bin_nat_op(nat_lxor, e);
+        if (f == *g_nat_shiftl) return reduce_bin_nat_op(nat_shiftl_bounded, e);
+        if (f == *g_nat_shiftr) return reduce_bin_nat_op(nat_shiftr_core, e);
+        if (f == *g_nat_pow) return reduce_bin_nat_op(nat_pow_bounded, e);
+        if (f == *g_nat_gcd) return reduce_bin_nat_op(nat_gcd, e);
+    }
+    return none_expr();
+}
+
+/* Reduce `String` primitives applied to string literals without expanding them into `List Char` values. */
+optional<expr> type_checker::reduce_string(expr const & e) {
+    if (has_fvar(e)) return none_expr();
+    unsigned nargs = get_app_num_args(e);
+    if (nargs == 1) {
+        expr const & f = app_fn(e);
+        if (f != *g_string_length && f != *g_string_utf8_byte_size) return none_expr();
+        expr arg = whnf(app_arg(e));
+        if (!is_string_lit(arg)) return none_expr();
+        string_ref const & s = lit_value(arg).get_string();
+        size_t n = f == *g_string_length ? s.length() : s.num_bytes();
+        return some_expr(mk_lit(literal(nat(usize_to_nat(n)))));
+    } else if (nargs == 2) {
+        expr const & f = app_fn(app_fn(e));
+        if (f != *g_string_append && f != *g_string_dec_eq) return none_expr();
+        expr arg1 = whnf(app_arg(app_fn(e)));
+        if (!is_string_lit(arg1)) return none_expr();
+        expr arg2 = whnf(app_arg(e));
+        if (!is_string_lit(arg2)) return none_expr();
+        string_ref const & s1 = lit_value(arg1).get_string();
+        string_ref const & s2 = lit_value(arg2).get_string();
+        if (f == *g_string_append)
+            return some_expr(mk_lit(literal(string_ref(string_append(s1.to_obj_arg(), s2.raw())))));
+        /* `String.decEq a b : Decidable (a = b)`, the proofs are irrelevant */
+        expr a  = app_arg(app_fn(e));
+        expr b  = app_arg(e);
+        expr p  = mk_app(*g_eq_1, *g_string_type, a, b);
+        if (s1 == s2) {
+            return some_expr(mk_app(*g_decidable_is_true, p, mk_app(*g_eq_refl_1, *g_string_type, a)));
+        } else {
+            expr h = mk_app(*g_of_decide_eq_false, p, e, mk_app(*g_eq_refl_1, *g_bool_type, mk_bool_false()));
+            return some_expr(mk_app(*g_decidable_is_false, p, h));
+        }
     }
     return none_expr();
 }
@@ -616,28 +937,105 @@ expr type_checker::whnf(expr const & e) {
         break;
     }
 
+    if (type_checker_stats * stats = m_st->m_stats)
+        stats->m_whnf++;
+
     // check cache
-    auto it = m_st->m_whnf.find(e);
-    if (it != m_st->m_whnf.end())
-        return it->second;
+    if (expr const * r = m_st->m_whnf.find(e))
+        return *r;
+    bool share = g_shared_whnf && is_shareable(e);
+    if (share) {
+        if (optional<expr> r = g_shared_whnf->find(m_st->m_imports_key, e)) {
+            if (type_checker_stats * stats = m_st->m_stats)
+                stats->m_shared_cache_hits++;
+            m_st->m_whnf.insert(e, *r);
+            return *r;
+        }
+    }
 
     expr t = e;
+    expr r;
     while (true) {
         expr t1 = whnf_core(t);
         if (auto v = reduce_native(env(), t1)) {
-            m_st->m_whnf.insert(mk_pair(e, *v));
-            return *v;
+            r = *v;
+            break;
         } else if (auto v = reduce_nat(t1)) {
-            m_st->m_whnf.insert(mk_pair(e, *v));
-            return *v;
+            r = *v;
+            break;
+        } else if (auto v = reduce_string(t1)) {
+            r = *v;
+            break;
         } else if (auto next_t = unfold_definition(t1)) {
             t = *next_t;
         } else {
-            auto r = t1;
-            m_st->m_whnf.insert(mk_pair(e, r));
-            return r;
+            r = t1;
+            break;
         }
     }
+    m_st->m_whnf.insert(e, r);
+    if (share)
+        g_shared_whnf->insert(m_st->m_imports_key, e, r);
+    return r;
+}
+
+bool type_checker::is_imported(name const & n) {
+    auto it = m_st->m_imported.find(n);
+    if (it != m_st->m_imported.end())
+        return it->second;
+    bool r = env().is_imported(n);
+    m_st->m_imported.emplace(n, r);
+    return r;
+}
+
+/** \brief Return true iff all constants occurring in \c e are imported, and \c e does not contain free or
+    meta variables. */
+bool type_checker::only_imported_constants(expr const & e) {
+    switch (e.kind()) {
+    case expr_kind::BVar: case expr_kind::Sort: case expr_kind::Lit:
+        return true;
+    case expr_kind::FVar: case expr_kind::MVar:
+        return false;
+    default:
+        break;
+    }
+    if (bool const * r = m_st->m_only_imported.find(e))
+        return *r;
+    bool r = false;
+    switch (e.kind()) {
+    case expr_kind::BVar: case expr_kind::Sort: case expr_kind::Lit:
+    case expr_kind::FVar: case expr_kind::MVar:
+        lean_unreachable(); // LCOV_EXCL_LINE
+    case expr_kind::Const:
+        r = is_imported(const_name(e));
+        break;
+    case expr_kind::MData:
+        r = only_imported_constants(mdata_expr(e));
+        break;
+    case expr_kind::Proj:
+        r = is_imported(proj_sname(e)) && only_imported_constants(proj_expr(e));
+        break;
+    case expr_kind::App:
+        r = only_imported_constants(app_fn(e)) && only_imported_constants(app_arg(e));
+        break;
+    case expr_kind::Lambda: case expr_kind::Pi:
+        r = only_imported_constants(binding_domain(e)) && only_imported_constants(binding_body(e));
+        break;
+    case expr_kind::Let:
+        r = only_imported_constants(let_type(e)) && only_imported_constants(let_value(e)) &&
+            only_imported_constants(let_body(e));
+        break;
+    }
+    m_st->m_only_imported.insert(e, r);
+    return r;
+}
+
+/** \brief Return true iff the results of `whnf` and `infer_type` for \c e can be stored in the shared caches. */
+bool type_checker::is_shareable(expr const & e) {
+    return
+        m_st->m_imports_key != nullptr &&
+        !has_fvar(e) && !has_loose_bvars(e) &&
+        only_imported_constants(e);
 }
 
 /** \brief Given lambda/Pi expressions \c t and \c s, return true iff \c t is def eq to \c s.
@@ -804,21 +1202,21 @@ lbool type_checker::is_def_eq_proof_irrel(expr const & t, expr const & s) {
 
 bool type_checker::failed_before(expr const & t, expr const & s) const {
     if (hash(t) < hash(s)) {
-        return m_st->m_failure.find(mk_pair(t, s)) != m_st->m_failure.end();
+        return m_st->m_failure.contains(mk_pair(t, s));
     } else if (hash(t) > hash(s)) {
-        return m_st->m_failure.find(mk_pair(s, t)) != m_st->m_failure.end();
+        return m_st->m_failure.contains(mk_pair(s, t));
     } else {
         return
-            m_st->m_failure.find(mk_pair(t, s)) != m_st->m_failure.end() ||
-            m_st->m_failure.find(mk_pair(s, t)) != m_st->m_failure.end();
+            m_st->m_failure.contains(mk_pair(t, s)) ||
+            m_st->m_failure.contains(mk_pair(s, t));
     }
 }
 
 void type_checker::cache_failure(expr const & t, expr const & s) {
     if (hash(t) <= hash(s))
-        m_st->m_failure.insert(mk_pair(t, s));
+        m_st->m_failure.insert(mk_pair(t, s), true);
     else
-        m_st->m_failure.insert(mk_pair(s, t));
+        m_st->m_failure.insert(mk_pair(s, t), true);
 }
 
 /** \brief Perform one lazy delta-reduction step.
@@ -829,6 +1227,8 @@ void type_checker::cache_failure(expr const & t, expr const & s) {
 
      \remark t_n, s_n and cs are updated. */
 auto type_checker::lazy_delta_reduction_step(expr & t_n, expr & s_n) -> reduction_status {
+    if (type_checker_stats * stats = m_st->m_stats)
+        stats->m_lazy_delta_steps++;
     auto d_t = is_delta(t_n);
     auto d_s = is_delta(s_n);
     if (!d_t && !d_s) {
@@ -909,6 +1309,10 @@ lbool type_checker::lazy_delta_reduction(expr & t_n, expr & s_n) {
                 return to_lbool(is_def_eq_core(*t_v, s_n));
             } else if (auto s_v = reduce_nat(s_n)) {
                 return to_lbool(is_def_eq_core(t_n, *s_v));
+            } else if (auto t_v = reduce_string(t_n)) {
+                return to_lbool(is_def_eq_core(*t_v, s_n));
+            } else if (auto s_v = reduce_string(s_n)) {
+                return to_lbool(is_def_eq_core(t_n, *s_v));
             }
         }
 
@@ -931,7 +1335,7 @@ static expr * g_string_mk = nullptr;
 
 lbool type_checker::try_string_lit_expansion_core(expr const & t, expr const & s) {
     if (is_string_lit(t) && is_app(s) && app_fn(s) == *g_string_mk) {
-        return to_lbool(is_def_eq_core(string_lit_to_constructor(t), s));
+        return to_lbool(is_def_eq_core(string_lit_to_constructor_head(t), s));
     }
     return l_undef;
 }
@@ -1009,6 +1413,11 @@ bool type_checker::is_def_eq(expr const & t, expr const & s) {
     bool r = is_def_eq_core(t, s);
     if (r)
         m_st->m_eqv_manager.add_equiv(t, s);
+    if (type_checker_stats * stats = m_st->m_stats) {
+        stats->m_is_def_eq++;
+        if (!r)
+            stats->m_is_def_eq_failures++;
+    }
     return r;
 }
 
@@ -1064,7 +1473,25 @@ extern "C" LEAN_EXPORT lean_object * lean_kernel_whnf(lean_object * env, lean_ob
     return type_checker(environment(env), local_ctx(lctx)).whnf(expr(a)).steal();
 }
 
+extern "C" LEAN_EXPORT lean_object * lean_kernel_shared_cache_hits(lean_object *) {
+    uint64 r = 0;
+    for (shared_expr_cache * c : { g_shared_whnf, g_shared_infer_type[0], g_shared_infer_type[1] }) {
+        if (c)
+            r += c->get_stats().m_hits;
+    }
+    return lean_io_result_mk_ok(lean_uint64_to_nat(r));
+}
+
 void initialize_type_checker() {
+    if (char const * c = std::getenv("LEAN_TYPE_CHECKER_CACHE_CAPACITY"))
+        set_type_checker_cache_capacity(atoi(c));
+    if (char const * c = std::getenv("LEAN_TYPE_CHECKER_SHARED_CACHE_CAPACITY"))
+        g_shared_cache_capacity = atoi(c);
+    if (g_shared_cache_capacity > 0) {
+        g_shared_whnf          = new shared_expr_cache(g_shared_cache_capacity);
+        g_shared_infer_type[0] = new shared_expr_cache(g_shared_cache_capacity);
+        g_shared_infer_type[1] = new shared_expr_cache(g_shared_cache_capacity);
+    }
     g_dont_care    = new expr(mk_const("dontcare"));
     mark_persistent(g_dont_care->raw());
     g_kernel_fresh = new name("_kernel_fresh");
@@ -1087,6 +1514,44 @@ void initialize_type_checker() {
     mark_persistent(g_nat_beq->raw());
     g_nat_ble      = new expr(mk_constant(name{"Nat", "ble"}));
     mark_persistent(g_nat_ble->raw());
+    g_nat_land     = new expr(mk_constant(name{"Nat", "land"}));
+    mark_persistent(g_nat_land->raw());
+    g_nat_lor      = new expr(mk_constant(name{"Nat", "lor"}));
+    mark_persistent(g_nat_lor->raw());
+    g_nat_xor      = new expr(mk_constant(name{"Nat", "xor"}));
+    mark_persistent(g_nat_xor->raw());
+    g_nat_shiftl   = new expr(mk_constant(name{"Nat", "shiftLeft"}));
+    mark_persistent(g_nat_shiftl->raw());
+    g_nat_shiftr   = new expr(mk_constant(name{"Nat", "shiftRight"}));
+    mark_persistent(g_nat_shiftr->raw());
+    g_nat_pow      = new expr(mk_constant(name{"Nat", "pow"}));
+    mark_persistent(g_nat_pow->raw());
+    g_nat_gcd      = new expr(mk_constant(name{"Nat", "gcd"}));
+    mark_persistent(g_nat_gcd->raw());
+    g_nat_log2     = new expr(mk_constant(name{"Nat", "log2"}));
+    mark_persistent(g_nat_log2->raw());
+    g_string_length         = new expr(mk_constant(name{"String", "length"}));
+    mark_persistent(g_string_length->raw());
+    g_string_utf8_byte_size = new expr(mk_constant(name{"String", "utf8ByteSize"}));
+    mark_persistent(g_string_utf8_byte_size->raw());
+    g_string_append         = new expr(mk_constant(name{"String", "append"}));
+    mark_persistent(g_string_append->raw());
+    g_string_dec_eq         = new expr(mk_constant(name{"String", "decEq"}));
+    mark_persistent(g_string_dec_eq->raw());
+    g_string_type           = new expr(mk_constant(name{"String"}));
+    mark_persistent(g_string_type->raw());
+    g_bool_type             = new expr(mk_constant(name{"Bool"}));
+    mark_persistent(g_bool_type->raw());
+    g_eq_refl_1             = new expr(mk_constant(name{"Eq", "refl"}, {mk_level_one()}));
+    mark_persistent(g_eq_refl_1->raw());
+    g_eq_1                  = new expr(mk_constant(name{"Eq"}, {mk_level_one()}));
+    mark_persistent(g_eq_1->raw());
+    g_decidable_is_true     = new expr(mk_constant(name{"Decidable", "isTrue"}));
+    mark_persistent(g_decidable_is_true->raw());
+    g_decidable_is_false    = new expr(mk_constant(name{"Decidable", "isFalse"}));
+    mark_persistent(g_decidable_is_false->raw());
+    g_of_decide_eq_false    = new expr(mk_constant(name{"of_decide_eq_false"}));
+    mark_persistent(g_of_decide_eq_false->raw());
     g_string_mk    = new expr(mk_constant(name{"String", "mk"}));
     mark_persistent(g_string_mk->raw());
     g_lean_reduce_bool = new expr(mk_constant(name{"Lean", "reduceBool"}));
@@ -1097,6 +1562,9 @@ void initialize_type_checker() {
 }
 
 void finalize_type_checker() {
+    delete g_shared_whnf;
+    delete g_shared_infer_type[0];
+    delete g_shared_infer_type[1];
     delete g_dont_care;
     delete g_kernel_fresh;
     delete g_nat_succ;
@@ -1108,6 +1576,25 @@ void finalize_type_checker() {
     delete g_nat_mod;
     delete g_nat_beq;
     delete g_nat_ble;
+    delete g_nat_land;
+    delete g_nat_lor;
+    delete g_nat_xor;
+    delete g_nat_shiftl;
+    delete g_nat_shiftr;
+    delete g_nat_pow;
+    delete g_nat_gcd;
+    delete g_nat_log2;
+    delete g_string_length;
+    delete g_string_utf8_byte_size;
+    delete g_string_append;
+    delete g_string_dec_eq;
+    delete g_string_type;
+    delete g_bool_type;
+    delete g_eq_refl_1;
+    delete g_eq_1;
+    delete g_decidable_is_true;
+    delete g_decidable_is_false;
+    delete g_of_decide_eq_false;
     delete g_string_mk;
     delete g_lean_reduce_bool;
     delete g_lean_reduce_nat;
@@ -5,36 +5,96 @@ Released under Apache 2.0 license as described in the file LICENSE.
 Author: Leonardo de Moura
 */
 #pragma once
-#include <unordered_set>
+#include <iostream>
 #include <memory>
 #include <utility>
 #include <algorithm>
+#include <unordered_map>
 #include "util/lbool.h"
 #include "util/name_set.h"
+#include "util/name_hash_map.h"
 #include "util/name_generator.h"
 #include "kernel/environment.h"
 #include "kernel/local_ctx.h"
 #include "kernel/expr_maps.h"
 #include "kernel/equiv_manager.h"
+#include "kernel/bounded_cache.h"
+
+#ifndef LEAN_DEFAULT_TYPE_CHECKER_CACHE_CAPACITY
+/* Maximum number of entries in each of the caches of `type_checker::state`, must be a power of two.
+   It can be overridden using the environment variable `LEAN_TYPE_CHECKER_CACHE_CAPACITY`. */
+#define LEAN_DEFAULT_TYPE_CHECKER_CACHE_CAPACITY (1u << 18)
+#endif
+
+#ifndef LEAN_DEFAULT_TYPE_CHECKER_SHARED_CACHE_CAPACITY
+/* Maximum number of entries in each of the process-wide `whnf`/`infer_type` caches for closed terms, which are
+   shared by all `type_checker::state` objects. It can be overridden using the environment variable
+   `LEAN_TYPE_CHECKER_SHARED_CACHE_CAPACITY`, `0` disables the shared caches. */
+#define LEAN_DEFAULT_TYPE_CHECKER_SHARED_CACHE_CAPACITY (1u << 17)
+#endif
 
 namespace lean {
+/** \brief Counters collected by the `type_checker` objects created in the current thread while a
+    `scoped_type_checker_stats` object is alive. They are used to profile declarations (see `lean_kernel_profileit`). */
+struct type_checker_stats {
+    enum cache_kind { InferType, InferTypeOnly, WhnfCore, Whnf, Failure, NumCaches };
+    uint64 m_infer_type{0};
+    uint64 m_whnf{0};
+    uint64 m_whnf_core{0};
+    uint64 m_is_def_eq{0};
+    uint64 m_is_def_eq_failures{0};
+    uint64 m_lazy_delta_steps{0};
+    uint64 m_shared_cache_hits{0};
+    uint64 m_cache_hits[NumCaches] = {};
+    uint64 m_cache_misses[NumCaches] = {};
+    /* Number of delta reductions per constant */
+    std::unordered_map<name, uint64, name_hash_fn, name_eq_fn> m_unfolded;
+
+    void merge(type_checker_stats const & s);
+    /** \brief Display the counters, and the \c max_unfolded constants that were unfolded most often. */
+    void display(std::ostream & out, unsigned max_unfolded) const;
+};
+
+/** \brief Collect the statistics of the `type_checker` objects created in the current thread during the lifetime
+    of this object. */
+class scoped_type_checker_stats {
+    type_checker_stats   m_stats;
+    type_checker_stats * m_old;
+public:
+    scoped_type_checker_stats();
+    ~scoped_type_checker_stats();
+    type_checker_stats const & get() const { return m_stats; }
+};
+
 /** \brief Lean Type Checker. It can also be used to infer types, check whether a
     type \c A is convertible to a type \c B, etc. */
 class type_checker {
 public:
     class state {
-        typedef expr_map<expr> infer_cache;
-        typedef std::unordered_set<expr_pair, expr_pair_hash, expr_pair_eq> expr_pair_set;
+        typedef bounded_cache<expr, expr, expr_hash, std::equal_to<expr>> expr_cache;
+        typedef bounded_cache<expr_pair, bool, expr_pair_hash, expr_pair_eq> expr_pair_cache;
+        typedef bounded_cache<expr, bool, expr_hash, std::equal_to<expr>> expr_bool_cache;
         environment               m_env;
         name_generator            m_ngen;
-        infer_cache               m_infer_type[2];
-        expr_map<expr>            m_whnf_core;
-        expr_map<expr>            m_whnf;
+        expr_cache                m_infer_type[2];
+        expr_cache                m_whnf_core;
+        expr_cache                m_whnf;
         equiv_manager             m_eqv_manager;
-        expr_pair_set             m_failure;
+        expr_pair_cache           m_failure;
+        /* Key of the shared caches for closed terms (see `environment::get_imports_key`),
+           `nullptr` if they should not be used. */
+        object *                  m_imports_key;
+        /* Memoizes `type_checker::only_imported_constants`. */
+        expr_bool_cache           m_only_imported;
+        /* Memoizes `environment::is_imported`, which crosses the FFI boundary, for each constant name. */
+        name_hash_map<bool>       m_imported;
+        /* Statistics collector of the thread that created this object, if any (see `scoped_type_checker_stats`). */
+        type_checker_stats *      m_stats;
         friend type_checker;
     public:
+        state(environment const & env, unsigned cache_capacity);
         state(environment const & env);
+        ~state();
         environment & env() { return m_env; }
         environment const & env() const { return m_env; }
         name_generator & ngen() { return m_ngen; }
@@ -98,6 +158,10 @@ private:
     template<typename F> optional<expr> reduce_bin_nat_op(F const & f, expr const & e);
     template<typename F> optional<expr> reduce_bin_nat_pred(F const & f, expr const & e);
     optional<expr> reduce_nat(expr const & e);
+    optional<expr> reduce_string(expr const & e);
+    bool is_imported(name const & n);
+    bool only_imported_constants(expr const & e);
+    bool is_shareable(expr const & e);
 public:
     type_checker(state & st, local_ctx const & lctx, bool safe_only = true);
     type_checker(state & st, bool safe_only = true):type_checker(st, local_ctx(), safe_only) {}
@@ -147,6 +211,11 @@ public:
     optional<expr> unfold_definition(expr const & e);
 };
 
+unsigned get_type_checker_cache_capacity();
+void set_type_checker_cache_capacity(unsigned capacity);
+/** \brief Display the hit/miss/eviction counters of the caches of all `type_checker::state` objects destroyed so far. */
+void display_type_checker_cache_stats(std::ostream & out);
+
 void initialize_type_checker();
 void finalize_type_checker();
 }
@@ -27,6 +27,15 @@ optional<extern_attr_data_value> get_extern_attr_data(environment const & env, n
     return to_optional<extern_attr_data_value>(lean_get_extern_attr_data(env.to_obj_arg(), fn.to_obj_arg()));
 }
 
+extern "C" object * lean_get_extern_name_for(object * env, object * backend, object * fn);
+
+optional<std::string> get_extern_name_for(environment const & env, name const & backend, name const & c) {
+    option_ref<string_ref> r(lean_get_extern_name_for(env.to_obj_arg(), backend.to_obj_arg(), c.to_obj_arg()));
+    if (r)
+        return optional<std::string>(r.get()->to_std_string());
+    return optional<std::string>();
+}
+
 bool is_extern_constant(environment const & env, name const & c) {
     return static_cast<bool>(get_extern_attr_data(env, c));
 }
@@ -14,6 +14,9 @@ optional<expr> get_extern_constant_ll_type(environment const & env, name const &
 optional<unsigned> get_extern_constant_arity(environment const & env, name const & c);
 typedef object_ref extern_attr_data_value;
 optional<extern_attr_data_value> get_extern_attr_data(environment const & env, name const & c);
+/* Return the name of the function implementing the extern constant `c` for the given backend (e.g. `c`), unless it
+   is not an extern constant or it is implemented by an inline pattern or an ad hoc implementation. */
+optional<std::string> get_extern_name_for(environment const & env, name const & backend, name const & c);
 /* Return true if `c` is an extern constant, and store in borrowed_args and
    borrowed_res which arguments/results are marked as borrowed. */
 bool get_extern_borrowed_info(environment const & env, name const & c, buffer<bool> & borrowed_args, bool & borrowed_res);
@@ -10,24 +10,45 @@ Motivation
 ==========
 
 Even with a JIT compiler, we still have a need for a simpler interpreter on platforms LLVM JIT does not support (i.e.
-WebAssembly). Because this is mostly an edge case, we strive for simplicity instead of performance and thus reuse the
-existing compiler IR instead of inventing something like a new bytecode format.
+WebAssembly). It is also used for `#eval`, and for macros and tactics defined in files that have not been compiled.
 
 Implementation
 ==============
 
 The interpreter mainly consists of a homogeneous stack of `value`s, which are either unboxed values or pointers to boxed
 objects. The IR type system tells us which union member is active at any time. IR variables are mapped to stack
-slots by adding the current base pointer to the variable index. Further stacks are used for storing join points and call
-stack metadata. The interpreted IR is taken directly from the environment. Whenever possible, we try to switch to native
-code by checking for the mangled symbol via dlsym/GetProcAddress, which is also how we can call external functions
-(which only works if the file declaring them has already been compiled). We always call the "boxed" versions of native
-functions, which have a (relatively) homogeneous ABI that we can use without runtime code generation; see also
-`call/lookup_symbol` below.
+slots by adding the current base pointer to the variable index. A further stack is used for storing call stack metadata.
+The IR of a declaration is taken from the environment and lowered to a compact bytecode (`code`) on its first call: the
+frame size is computed in advance, join points become jump targets, `case` becomes a jump table indexed by the
+constructor tag, and call targets are resolved once per call site. Calls of `@[extern]` primitives such as `Nat.add`
+or `Array.push` are replaced by direct calls of the C functions in `lean.h` implementing them (`g_prims`), which avoids
+the boxed calling convention described next. Whenever possible, we try to switch to native code by checking for the mangled
+symbol via dlsym/GetProcAddress, which is also how we can call external functions (which only works if the file
+declaring them has already been compiled). We always call the "boxed" versions of native functions, which have a
+(relatively) homogeneous ABI that we can use without runtime code generation; see also `call/lookup_symbol` below.
+
+When the `profiler` option is set, each interpreter records a call tree with the number of calls, the time, and the
+constructor objects and closures allocated by each function (`interpreter_profile`), not counting the objects
+allocated by primitives and native code. The per-declaration totals are shown with the other cumulative profiling
+times, and the call stacks can be written for `flamegraph.pl` by setting the environment variable
+`LEAN_PROFILE_FLAMEGRAPH` to a file name.
 
 */
 #include <string>
 #include <vector>
+#include <memory>
+#include <limits>
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+#include <deque>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <fstream>
+#include <cstdlib>
+#include <type_traits>
 #ifdef LEAN_WINDOWS
 #include <windows.h>
 #undef ERROR // thanks, wingdi.h
@@ -41,10 +62,13 @@ functions, which have a (relatively) homogeneous ABI that we can use without run
 #include "runtime/io.h"
 #include "runtime/option_ref.h"
 #include "runtime/array_ref.h"
+#include "runtime/heapprof.h"
+#include "runtime/thread.h"
 #include "library/time_task.h"
 #include "library/trace.h"
 #include "library/compiler/ir.h"
 #include "library/compiler/init_attribute.h"
+#include "library/compiler/extern_attribute.h"
 #include "util/nat.h"
 #include "util/option_declarations.h"
 
@@ -192,6 +216,8 @@ static string_ref * g_mangle_prefix = nullptr;
 static string_ref * g_boxed_suffix = nullptr;
 static string_ref * g_boxed_mangled_suffix = nullptr;
 static name * g_interpreter_prefer_native = nullptr;
+// backend of the `@[extern]` implementations executed as primitives
+static name * g_c_backend = nullptr;
 
 // constants (lacking native declarations) initialized by `lean_run_init`
 static name_map<object *> * g_init_globals;
@@ -313,59 +339,894 @@ void * lookup_symbol_in_cur_exe(char const * sym) {
 #endif
 }
 
+// Primitives
+
+/* Handler of an `@[extern]` primitive function, called with the frame and the slots of the relevant arguments. It
+   follows the calling convention of the C function implementing the primitive, and must neither throw nor call back
+   into the interpreter. */
+typedef value (*prim_fn)(value const * fp, unsigned const * args);
+
+struct prim {
+    prim_fn  m_fn;
+    // number of relevant parameters
+    unsigned m_arity;
+};
+
+// handlers of primitives from `lean.h`, indexed by the name of their C function and executed in place of calls of the
+// `@[extern]` declarations implemented by them
+static std::unordered_map<std::string, prim> * g_prims = nullptr;
+
+static void add_prim(char const * c_fn, unsigned arity, prim_fn h) {
+    g_prims->emplace(c_fn, prim { h, arity });
+}
+
+#define LEAN_OBJ_PRIM1(f) add_prim(#f, 1, [](value const * fp, unsigned const * as) -> value { return f(fp[as[0]].m_obj); })
+#define LEAN_OBJ_PRIM2(f) add_prim(#f, 2, [](value const * fp, unsigned const * as) -> value { return f(fp[as[0]].m_obj, fp[as[1]].m_obj); })
+#define LEAN_OBJ_PRIM3(f) add_prim(#f, 3, [](value const * fp, unsigned const * as) -> value { return f(fp[as[0]].m_obj, fp[as[1]].m_obj, fp[as[2]].m_obj); })
+#define LEAN_NUM_PRIM1(f) add_prim(#f, 1, [](value const * fp, unsigned const * as) -> value { return f(fp[as[0]].m_num); })
+#define LEAN_NUM_PRIM2(f) add_prim(#f, 2, [](value const * fp, unsigned const * as) -> value { return f(fp[as[0]].m_num, fp[as[1]].m_num); })
+#define LEAN_FLOAT_PRIM1(f) add_prim(#f, 1, [](value const * fp, unsigned const * as) -> value { return value::from_float(f(fp[as[0]].m_float)); })
+#define LEAN_FLOAT_PRIM2(f) add_prim(#f, 2, [](value const * fp, unsigned const * as) -> value { return value::from_float(f(fp[as[0]].m_float, fp[as[1]].m_float)); })
+#define LEAN_FLOAT_PRED2(f) add_prim(#f, 2, [](value const * fp, unsigned const * as) -> value { return f(fp[as[0]].m_float, fp[as[1]].m_float); })
+
+#define LEAN_UINT_PRIMS(t)                      \
+    LEAN_NUM_PRIM2(lean_##t##_add);             \
+    LEAN_NUM_PRIM2(lean_##t##_sub);             \
+    LEAN_NUM_PRIM2(lean_##t##_mul);             \
+    LEAN_NUM_PRIM2(lean_##t##_div);             \
+    LEAN_NUM_PRIM2(lean_##t##_mod);             \
+    LEAN_NUM_PRIM2(lean_##t##_land);            \
+    LEAN_NUM_PRIM2(lean_##t##_lor);             \
+    LEAN_NUM_PRIM2(lean_##t##_xor);             \
+    LEAN_NUM_PRIM2(lean_##t##_shift_left);      \
+    LEAN_NUM_PRIM2(lean_##t##_shift_right);     \
+    LEAN_NUM_PRIM1(lean_##t##_complement);      \
+    LEAN_NUM_PRIM2(lean_##t##_dec_eq);          \
+    LEAN_NUM_PRIM2(lean_##t##_dec_lt);          \
+    LEAN_NUM_PRIM2(lean_##t##_dec_le);          \
+    LEAN_OBJ_PRIM1(lean_##t##_of_nat);          \
+    LEAN_NUM_PRIM1(lean_##t##_to_nat)
+
+static void initialize_prims() {
+    g_prims = new std::unordered_map<std::string, prim>();
+    LEAN_OBJ_PRIM2(lean_nat_add);
+    LEAN_OBJ_PRIM2(lean_nat_sub);
+    LEAN_OBJ_PRIM2(lean_nat_mul);
+    LEAN_OBJ_PRIM2(lean_nat_div);
+    LEAN_OBJ_PRIM2(lean_nat_mod);
+    LEAN_OBJ_PRIM2(lean_nat_land);
+    LEAN_OBJ_PRIM2(lean_nat_lor);
+    LEAN_OBJ_PRIM2(lean_nat_lxor);
+    LEAN_OBJ_PRIM2(lean_nat_shiftl);
+    LEAN_OBJ_PRIM2(lean_nat_shiftr);
+    LEAN_OBJ_PRIM2(lean_nat_dec_eq);
+    LEAN_OBJ_PRIM2(lean_nat_dec_le);
+    LEAN_OBJ_PRIM2(lean_nat_dec_lt);
+
+    LEAN_UINT_PRIMS(uint8);
+    LEAN_UINT_PRIMS(uint16);
+    LEAN_UINT_PRIMS(uint32);
+    LEAN_UINT_PRIMS(uint64);
+    LEAN_UINT_PRIMS(usize);
+
+    LEAN_FLOAT_PRIM2(lean_float_add);
+    LEAN_FLOAT_PRIM2(lean_float_sub);
+    LEAN_FLOAT_PRIM2(lean_float_mul);
+    LEAN_FLOAT_PRIM2(lean_float_div);
+    LEAN_FLOAT_PRIM1(lean_float_negate);
+    LEAN_FLOAT_PRED2(lean_float_beq);
+
+    LEAN_OBJ_PRIM1(lean_array_get_size);
+    LEAN_OBJ_PRIM2(lean_array_fget);
+    // the `Inhabited` instance of `Array.get!` is passed first
+    LEAN_OBJ_PRIM3(lean_array_get);
+    LEAN_OBJ_PRIM2(lean_array_push);
+    LEAN_OBJ_PRIM3(lean_array_fset);
+    LEAN_OBJ_PRIM3(lean_array_set);
+    add_prim("lean_array_uget", 2, [](value const * fp, unsigned const * as) -> value {
+        return lean_array_uget(fp[as[0]].m_obj, fp[as[1]].m_num);
+    });
+    add_prim("lean_array_uset", 3, [](value const * fp, unsigned const * as) -> value {
+        return lean_array_uset(fp[as[0]].m_obj, fp[as[1]].m_num, fp[as[2]].m_obj);
+    });
+
+    LEAN_OBJ_PRIM1(lean_string_length);
+    LEAN_OBJ_PRIM1(lean_string_utf8_byte_size);
+    LEAN_OBJ_PRIM2(lean_string_append);
+}
+
+// Bytecode
+
+/** \brief Instructions of the lowered code of a declaration. The IR variable `x_i` is stored in the frame slot `i`;
+    slot 0 always contains `box(0)` and is used for irrelevant arguments. "args" refers to a list of `m_c` slots
+    starting at `m_operands[m_b]`. */
+enum class opcode : uint8 {
+    Ctor,               // dst := ctor m_ctors[a] args
+    Const,              // dst := m_scalars[a]
+    LitObj,             // dst := m_objs[a] (owned)
+    Reset,              // dst := reset[b] a
+    Reuse,              // dst := reuse a in m_ctors[b] args at m_operands[c]
+    ReuseUpdateHeader,  // like `Reuse`, but also sets the constructor tag
+    Proj,               // dst := proj[b] a
+    UProj,              // dst := uproj[b] a
+    SProj,              // dst := sproj[offset b] a
+    Call,               // dst := m_callees[a] args
+    Prim,               // dst := m_prims[a] args, where args only contains the relevant arguments
+    TailCall,           // parameters := args; restart, arguments are assigned in order
+    TailCallPar,        // like `TailCall`, but arguments overlap with parameters and must be copied first
+    Load,               // dst := m_callees[a]
+    PAp,                // dst := pap m_callees[a] args
+    Ap,                 // dst := ap a args
+    Box,                // dst := box a, where b is the type of the unboxed value
+    Unbox,              // dst := unbox a
+    IsShared,           // dst := isShared a
+    IsTaggedPtr,        // dst := isTaggedPtr a
+    Set,                // set a[b] := c
+    SetTag,             // setTag a := b
+    USet,               // uset a[b] := c
+    SSet,               // sset a[offset b] := c
+    Inc,                // inc a, b times
+    Dec,                // dec a, b times
+    Del,                // del a
+    Case,               // jump to m_operands[b + tag of a], or to m_operands[b + c] if tag >= c
+    Ret,                // return a
+    Jmp,                // parameters of m_jps[a] := args; jump to m_jps[a]
+    JmpPar,             // like `Jmp`, but arguments overlap with parameters and must be copied first
+    Unreachable,
+    Error               // throw m_errors[a]
+};
+
+struct instr {
+    opcode   m_op;
+    // type of the result, if any
+    type     m_type;
+    unsigned m_dst;
+    unsigned m_a;
+    unsigned m_b;
+    unsigned m_c;
+};
+
+struct ctor_layout {
+    unsigned m_tag;
+    // number of boxed object fields
+    unsigned m_num_objs;
+    // byte size of the unboxed fields
+    unsigned m_scalar_sz;
+    unsigned m_num_args;
+};
+
+struct join_point {
+    unsigned m_pc;
+    // offset of the parameter slots in `m_operands`
+    unsigned m_params;
+};
+
+// marks missing `Case` targets
+static constexpr unsigned g_no_target = std::numeric_limits<unsigned>::max();
+
+struct symbol_cache_entry;
+
+/** \brief Lowered code of an IR declaration. Frame sizes, join point targets and jump tables are computed once, so
+    that the interpreter does not have to decode the IR objects on every step. */
+struct code {
+    fun_id                      m_fn;
+    decl                        m_decl;
+    std::vector<type>           m_param_types;
+    type                        m_ret_type;
+    // number of slots, including slot 0
+    unsigned                    m_frame_size{1};
+    std::vector<instr>          m_instrs;
+    // IR source of each instruction, for tracing
+    std::vector<fn_body>        m_src;
+    std::vector<unsigned>       m_operands;
+    std::vector<value>          m_scalars;
+    std::vector<object_ref>     m_objs;
+    std::vector<ctor_layout>    m_ctors;
+    std::vector<join_point>     m_jps;
+    std::vector<std::string>    m_errors;
+    std::vector<fun_id>         m_callees;
+    std::vector<prim_fn>        m_prims;
+    // resolved `m_callees`, filled in by the interpreter on first use
+    std::unique_ptr<std::atomic<symbol_cache_entry *>[]> m_callee_entries;
+    // true iff the code belongs to a `shared_decl_cache` and may be used by several threads
+    bool                        m_shared{false};
+};
+
+/** \brief Translate the body of an IR declaration into `code`. */
+class lower_fn {
+    environment const &                       m_env;
+    code &                                    m_code;
+    // join points in scope, the innermost last
+    std::vector<std::pair<unsigned, unsigned>> m_jp_scope;
+
+    unsigned pc() const { return m_code.m_instrs.size(); }
+
+    void emit(fn_body const & src, opcode op, type t, unsigned dst, unsigned a = 0, unsigned b = 0, unsigned c = 0) {
+        m_code.m_instrs.push_back(instr { op, t, dst, a, b, c });
+        m_code.m_src.push_back(src);
+    }
+
+    void emit_error(fn_body const & src, std::string const & msg) {
+        emit(src, opcode::Error, type::Irrelevant, 0, m_code.m_errors.size());
+        m_code.m_errors.push_back(msg);
+    }
+
+    unsigned slot(var_id const & x) {
+        unsigned i = x.get_small_value();
+        m_code.m_frame_size = std::max(m_code.m_frame_size, i + 1);
+        return i;
+    }
+
+    unsigned arg_slot(arg const & a) {
+        return arg_is_irrelevant(a) ? 0 : slot(arg_var_id(a));
+    }
+
+    unsigned args(array_ref<arg> const & as) {
+        unsigned r = m_code.m_operands.size();
+        for (arg const & a : as)
+            m_code.m_operands.push_back(arg_slot(a));
+        return r;
+    }
+
+    /* Return true if assigning the arguments at `m_operands[as]` to the slots `dsts` in order would overwrite an
+       argument before it is read. */
+    bool overlaps(unsigned as, std::vector<unsigned> const & dsts) const {
+        for (unsigned j = 0; j < dsts.size(); j++) {
+            for (unsigned i = 0; i < j; i++) {
+                if (m_code.m_operands[as + j] == dsts[i])
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    unsigned ctor(ctor_info const & c, unsigned num_args) {
+        m_code.m_ctors.push_back(ctor_layout {
+                static_cast<unsigned>(ctor_info_tag(c).get_small_value()),
+                static_cast<unsigned>(ctor_info_size(c).get_small_value()),
+                static_cast<unsigned>(ctor_info_usize(c).get_small_value() * sizeof(void *) + ctor_info_ssize(c).get_small_value()),
+                num_args });
+        return m_code.m_ctors.size() - 1;
+    }
+
+    unsigned callee(fun_id const & fn) {
+        for (unsigned i = 0; i < m_code.m_callees.size(); i++) {
+            if (m_code.m_callees[i] == fn)
+                return i;
+        }
+        m_code.m_callees.push_back(fn);
+        return m_code.m_callees.size() - 1;
+    }
+
+    void emit_const(fn_body const & b, type t, unsigned x, value v) {
+        emit(b, opcode::Const, t, x, m_code.m_scalars.size());
+        m_code.m_scalars.push_back(v);
+    }
+
+    void emit_lit(fn_body const & b, type t, unsigned x, lit_val const & l) {
+        switch (lit_val_tag(l)) {
+        case lit_val_kind::Num: {
+            nat const & n = lit_val_num(l);
+            switch (t) {
+            case type::Float:
+                lean_inc(n.raw());
+                return emit_const(b, t, x, value::from_float(lean_float_of_nat(n.raw())));
+            case type::UInt8:
+            case type::UInt16:
+            case type::UInt32:
+            case type::USize:
+                return emit_const(b, t, x, lean_usize_of_nat(n.raw()));
+            case type::UInt64:
+                return emit_const(b, t, x, lean_uint64_of_nat(n.raw()));
+            // `nat` literal
+            case type::Object:
+            case type::TObject:
+                emit(b, opcode::LitObj, t, x, m_code.m_objs.size());
+                m_code.m_objs.push_back(n);
+                return;
+            case type::Irrelevant:
+                break;
+            }
+            return emit_error(b, "invalid instruction");
+        }
+        case lit_val_kind::Str:
+            emit(b, opcode::LitObj, t, x, m_code.m_objs.size());
+            m_code.m_objs.push_back(lit_val_str(l));
+            return;
+        }
+        emit_error(b, "invalid instruction");
+    }
+
+    /* Return true if `b` is `let x := f args; ret x` where `f` is the current function */
+    bool is_tail_call(fn_body const & b) {
+        expr const & e = fn_body_vdecl_expr(b);
+        fn_body const & cont = fn_body_vdecl_cont(b);
+        return
+            expr_tag(e) == expr_kind::FAp && expr_fap_fun(e) == m_code.m_fn && expr_fap_args(e).size() > 0 &&
+            fn_body_tag(cont) == fn_body_kind::Ret && !arg_is_irrelevant(fn_body_ret_arg(cont)) &&
+            arg_var_id(fn_body_ret_arg(cont)) == fn_body_vdecl_var(b);
+    }
+
+    /* Emit a `Prim` instruction if `fn` is an `@[extern]` declaration implemented by a C function that has a handler
+       in `g_prims`. As in the C code emitted for calls of such declarations (`emitSimpleExternalCall`), the arguments
+       of irrelevant parameters of `fn` are dropped. */
+    bool emit_prim(fn_body const & src, type t, unsigned x, fun_id const & fn, array_ref<arg> const & as) {
+        option_ref<decl> d = find_ir_decl(m_env, fn);
+        if (!d || decl_tag(*d.get()) != decl_kind::Extern)
+            return false;
+        optional<std::string> c_fn = get_extern_name_for(m_env, *g_c_backend, fn);
+        if (!c_fn)
+            return false;
+        auto it = g_prims->find(*c_fn);
+        if (it == g_prims->end())
+            return false;
+        array_ref<param> const & ps = decl_params(*d.get());
+        if (ps.size() != as.size())
+            return false;
+        unsigned r = m_code.m_operands.size();
+        for (size_t i = 0; i < as.size(); i++) {
+            if (param_type(ps[i]) != type::Irrelevant)
+                m_code.m_operands.push_back(arg_slot(as[i]));
+        }
+        unsigned n = m_code.m_operands.size() - r;
+        if (n != it->second.m_arity) {
+            m_code.m_operands.resize(r);
+            return false;
+        }
+        emit(src, opcode::Prim, t, x, m_code.m_prims.size(), r, n);
+        m_code.m_prims.push_back(it->second.m_fn);
+        return true;
+    }
+
+    void lower_vdecl(fn_body const & b) {
+        expr const & e = fn_body_vdecl_expr(b);
+        type t         = fn_body_vdecl_type(b);
+        unsigned x     = slot(fn_body_vdecl_var(b));
+        switch (expr_tag(e)) {
+        case expr_kind::Ctor: {
+            ctor_info const & c = expr_ctor_info(e);
+            if (ctor_info_size(c).is_zero() && ctor_info_usize(c).is_zero() && ctor_info_ssize(c).is_zero()) {
+                // a constructor without data is optimized to a tagged pointer
+                return emit_const(b, t, x, box(ctor_info_tag(c).get_small_value()));
+            }
+            unsigned as = args(expr_ctor_args(e));
+            return emit(b, opcode::Ctor, t, x, ctor(c, expr_ctor_args(e).size()), as);
+        }
+        case expr_kind::Reset:
+            return emit(b, opcode::Reset, t, x, slot(expr_reset_obj(e)), expr_reset_num_objs(e).get_small_value());
+        case expr_kind::Reuse: {
+            unsigned o  = slot(expr_reuse_obj(e));
+            unsigned as = args(expr_reuse_args(e));
+            unsigned c  = ctor(expr_reuse_ctor(e), expr_reuse_args(e).size());
+            return emit(b, expr_reuse_update_header(e) ? opcode::ReuseUpdateHeader : opcode::Reuse, t, x, o, c, as);
+        }
+        case expr_kind::Proj:
+            return emit(b, opcode::Proj, t, x, slot(expr_proj_obj(e)), expr_proj_idx(e).get_small_value());
+        case expr_kind::UProj:
+            return emit(b, opcode::UProj, t, x, slot(expr_uproj_obj(e)), expr_uproj_idx(e).get_small_value());
+        case expr_kind::SProj:
+            switch (t) {
+            case type::Float: case type::UInt8: case type::UInt16: case type::UInt32: case type::UInt64:
+                return emit(b, opcode::SProj, t, x, slot(expr_sproj_obj(e)),
+                            expr_sproj_idx(e).get_small_value() * sizeof(void *) + expr_sproj_offset(e).get_small_value());
+            case type::USize: case type::Irrelevant: case type::Object: case type::TObject:
+                break;
+            }
+            return emit_error(b, "invalid instruction");
+        case expr_kind::FAp:
+            if (expr_fap_args(e).size()) {
+                if (emit_prim(b, t, x, expr_fap_fun(e), expr_fap_args(e)))
+                    return;
+                unsigned as = args(expr_fap_args(e));
+                return emit(b, opcode::Call, t, x, callee(expr_fap_fun(e)), as, expr_fap_args(e).size());
+            } else {
+                // nullary function ("constant")
+                return emit(b, opcode::Load, t, x, callee(expr_fap_fun(e)));
+            }
+        case expr_kind::PAp: {
+            unsigned as = args(expr_pap_args(e));
+            return emit(b, opcode::PAp, t, x, callee(expr_pap_fun(e)), as, expr_pap_args(e).size());
+        }
+        case expr_kind::Ap: {
+            unsigned as = args(expr_ap_args(e));
+            return emit(b, opcode::Ap, t, x, slot(expr_ap_fun(e)), as, expr_ap_args(e).size());
+        }
+        case expr_kind::Box:
+            return emit(b, opcode::Box, t, x, slot(expr_box_obj(e)), static_cast<unsigned>(expr_box_type(e)));
+        case expr_kind::Unbox:
+            return emit(b, opcode::Unbox, t, x, slot(expr_unbox_obj(e)));
+        case expr_kind::Lit:
+            return emit_lit(b, t, x, expr_lit_val(e));
+        case expr_kind::IsShared:
+            return emit(b, opcode::IsShared, t, x, slot(expr_is_shared_obj(e)));
+        case expr_kind::IsTaggedPtr:
+            return emit(b, opcode::IsTaggedPtr, t, x, slot(expr_is_tagged_ptr_obj(e)));
+        }
+        emit_error(b, (sstream() << "unexpected instruction kind " << static_cast<unsigned>(expr_tag(e))).str());
+    }
+
+    void lower_case(fn_body const & b) {
+        array_ref<alt_core> const & alts = fn_body_case_alts(b);
+        unsigned size = 0;
+        for (alt_core const & a : alts) {
+            if (alt_core_tag(a) == alt_core_kind::Ctor)
+                size = std::max(size, static_cast<unsigned>(ctor_info_tag(alt_core_ctor_info(a)).get_small_value()) + 1);
+        }
+        // the last entry of the table is the default target
+        unsigned table = m_code.m_operands.size();
+        m_code.m_operands.resize(table + size + 1, g_no_target);
+        emit(b, opcode::Case, fn_body_case_var_type(b), 0, slot(fn_body_case_var(b)), table, size);
+        for (alt_core const & a : alts) {
+            unsigned target = pc();
+            switch (alt_core_tag(a)) {
+            case alt_core_kind::Ctor: {
+                lower(alt_core_ctor_cont(a));
+                unsigned tag = ctor_info_tag(alt_core_ctor_info(a)).get_small_value();
+                // as in a linear search, the first alternative for a tag wins
+                if (m_code.m_operands[table + tag] == g_no_target)
+                    m_code.m_operands[table + tag] = target;
+                break;
+            }
+            case alt_core_kind::Default:
+                lower(alt_core_default_cont(a));
+                for (unsigned i = 0; i <= size; i++) {
+                    if (m_code.m_operands[table + i] == g_no_target)
+                        m_code.m_operands[table + i] = target;
+                }
+                return;
+            }
+        }
+    }
+
+    void lower_jmp(fn_body const & b) {
+        unsigned id = fn_body_jmp_jp(b).get_small_value();
+        auto it = std::find_if(m_jp_scope.rbegin(), m_jp_scope.rend(),
+                               [&](std::pair<unsigned, unsigned> const & p) { return p.first == id; });
+        if (it == m_jp_scope.rend())
+            return emit_error(b, (sstream() << "unknown join point " << id).str());
+        join_point const & jp = m_code.m_jps[it->second];
+        unsigned as = args(fn_body_jmp_args(b));
+        unsigned n  = fn_body_jmp_args(b).size();
+        std::vector<unsigned> params(m_code.m_operands.begin() + jp.m_params, m_code.m_operands.begin() + jp.m_params + n);
+        emit(b, overlaps(as, params) ? opcode::JmpPar : opcode::Jmp, type::Irrelevant, 0, it->second, as, n);
+    }
+
+    void lower(fn_body const & b0) {
+        std::reference_wrapper<fn_body const> b(b0);
+        while (true) {
+            switch (fn_body_tag(b)) {
+            case fn_body_kind::VDecl:
+                if (is_tail_call(b)) {
+                    expr const & e = fn_body_vdecl_expr(b);
+                    unsigned n  = expr_fap_args(e).size();
+                    unsigned as = args(expr_fap_args(e));
+                    std::vector<unsigned> params;
+                    for (unsigned i = 1; i <= n; i++)
+                        params.push_back(i);
+                    return emit(b, overlaps(as, params) ? opcode::TailCallPar : opcode::TailCall, type::Irrelevant, 0, 0, as, n);
+                }
+                lower_vdecl(b);
+                b = fn_body_vdecl_cont(b);
+                break;
+            case fn_body_kind::JDecl: { // the body is placed after the continuation
+                unsigned idx = m_code.m_jps.size();
+                m_code.m_jps.push_back(join_point { 0, static_cast<unsigned>(m_code.m_operands.size()) });
+                for (param const & p : fn_body_jdecl_params(b))
+                    m_code.m_operands.push_back(slot(param_var(p)));
+                m_jp_scope.emplace_back(fn_body_jdecl_id(b).get_small_value(), idx);
+                lower(fn_body_jdecl_cont(b));
+                m_jp_scope.pop_back();
+                m_code.m_jps[idx].m_pc = pc();
+                b = fn_body_jdecl_body(b);
+                break;
+            }
+            case fn_body_kind::Set:
+                emit(b, opcode::Set, type::Irrelevant, 0, slot(fn_body_set_var(b)), fn_body_set_idx(b).get_small_value(),
+                     arg_slot(fn_body_set_arg(b)));
+                b = fn_body_set_cont(b);
+                break;
+            case fn_body_kind::SetTag:
+                emit(b, opcode::SetTag, type::Irrelevant, 0, slot(fn_body_set_tag_var(b)), fn_body_set_tag_cidx(b).get_small_value());
+                b = fn_body_set_tag_cont(b);
+                break;
+            case fn_body_kind::USet:
+                emit(b, opcode::USet, type::Irrelevant, 0, slot(fn_body_uset_target(b)), fn_body_uset_idx(b).get_small_value(),
+                     slot(fn_body_uset_source(b)));
+                b = fn_body_uset_cont(b);
+                break;
+            case fn_body_kind::SSet:
+                switch (fn_body_sset_type(b)) {
+                case type::Float: case type::UInt8: case type::UInt16: case type::UInt32: case type::UInt64:
+                    emit(b, opcode::SSet, fn_body_sset_type(b), 0, slot(fn_body_sset_target(b)),
+                         fn_body_sset_idx(b).get_small_value() * sizeof(void *) + fn_body_sset_offset(b).get_small_value(),
+                         slot(fn_body_sset_source(b)));
+                    break;
+                case type::USize: case type::Irrelevant: case type::Object: case type::TObject:
+                    return emit_error(b, "invalid instruction");
+                }
+                b = fn_body_sset_cont(b);
+                break;
+            case fn_body_kind::Inc:
+                emit(b, opcode::Inc, type::Irrelevant, 0, slot(fn_body_inc_var(b)), fn_body_inc_val(b).get_small_value());
+                b = fn_body_inc_cont(b);
+                break;
+            case fn_body_kind::Dec:
+                emit(b, opcode::Dec, type::Irrelevant, 0, slot(fn_body_dec_var(b)), fn_body_dec_val(b).get_small_value());
+                b = fn_body_dec_cont(b);
+                break;
+            case fn_body_kind::Del:
+                emit(b, opcode::Del, type::Irrelevant, 0, slot(fn_body_del_var(b)));
+                b = fn_body_del_cont(b);
+                break;
+            case fn_body_kind::MData: // metadata; no-op
+                b = fn_body_mdata_cont(b);
+                break;
+            case fn_body_kind::Case:
+                return lower_case(b);
+            case fn_body_kind::Ret:
+                return emit(b, opcode::Ret, type::Irrelevant, 0, arg_slot(fn_body_ret_arg(b)));
+            case fn_body_kind::Jmp:
+                return lower_jmp(b);
+            case fn_body_kind::Unreachable:
+                return emit(b, opcode::Unreachable, type::Irrelevant, 0);
+            }
+        }
+    }
+
+public:
+    lower_fn(environment const & env, code & c):m_env(env), m_code(c) {}
+
+    void operator()(decl const & d) {
+        m_code.m_fn       = decl_fun_id(d);
+        m_code.m_decl     = d;
+        m_code.m_ret_type = decl_type(d);
+        for (param const & p : decl_params(d)) {
+            // parameters are stored in slots 1, 2, ...
+            lean_assert(param_var(p).get_small_value() == m_code.m_param_types.size() + 1);
+            m_code.m_param_types.push_back(param_type(p));
+            slot(param_var(p));
+        }
+        lower(decl_fun_body(d));
+        m_code.m_callee_entries.reset(new std::atomic<symbol_cache_entry *>[m_code.m_callees.size()]());
+    }
+};
+
+static code * lower_decl(environment const & env, decl const & d, bool shared) {
+    code * c = new code();
+    lower_fn lower(env, *c);
+    lower(d);
+    c->m_shared = shared;
+    return c;
+}
+
+/** \brief Result of resolving a function name in the current environment and binary */
+struct symbol_cache_entry {
+    fun_id              m_fn;
+    decl                m_decl;
+    // symbol address; `nullptr` if function does not have native code
+    void *              m_addr;
+    // true iff we chose the boxed version of a function where the IR uses the unboxed version
+    bool                m_boxed;
+    // true iff the entry belongs to a `shared_decl_cache` and may be used by several threads
+    bool                m_shared;
+    std::vector<type>   m_param_types;
+    // `m_inc_args[i]` iff the i-th argument must be incremented before calling `m_addr`, see `interpreter::call`
+    std::vector<bool>   m_inc_args;
+    type                m_ret_type;
+    // lowered code of `m_decl`, created on first use
+    std::atomic<code *> m_code{nullptr};
+    // value of the nullary function `m_fn` computed by the interpreter (0: not evaluated, 1: being stored, 2: stored,
+    // 3: specific to each interpreter, see `interpreter::m_local_constants`)
+    std::atomic<uint8>  m_const_state{0};
+    bool                m_const_is_scalar{false};
+    value               m_const_val;
+
+    symbol_cache_entry(fun_id const & fn, decl const & d, void * addr, bool boxed, bool shared):
+        m_fn(fn), m_decl(d), m_addr(addr), m_boxed(boxed), m_shared(shared), m_ret_type(decl_type(d)) {
+        for (param const & p : decl_params(d)) {
+            m_param_types.push_back(param_type(p));
+            // NOTE: If we chose the boxed version where the IR chose the unboxed one, we need to manually increment
+            // originally borrowed parameters because the wrapper will decrement these after the call.
+            // Basically the wrapper is more homogeneous (removing both unboxed and borrowed parameters) than we
+            // would need in this instance.
+            m_inc_args.push_back(boxed && param_borrow(p));
+        }
+    }
+
+    ~symbol_cache_entry() {
+        delete m_code.load();
+        if (m_const_state.load() == 2 && !m_const_is_scalar)
+            dec(m_const_val.m_obj);
+    }
+};
+
+extern "C" uint8 lean_ir_is_imported_decl(object * env, object * n);
+static bool is_imported_ir_decl(environment const & env, name const & n) {
+    return lean_ir_is_imported_decl(env.to_obj_arg(), n.to_obj_arg());
+}
+
+/** \brief Symbol resolutions, lowered code and constant values of the IR declarations of imported modules.
+    They only depend on the imports of the environment (`environment::get_imports_key()`) and on the
+    `interpreter.prefer_native` option, so they are shared by all interpreters with the same imports, in particular
+    the ones created for interpreted closures called from tasks or from compiled code. Entries are never removed;
+    interpreters keep the cache they use alive. */
+class shared_decl_cache {
+    object * m_imports_key;
+    bool     m_prefer_native;
+    mutex    m_mutex;
+    std::unordered_map<name, symbol_cache_entry, name_hash_fn, name_eq_fn> m_symbols;
+public:
+    shared_decl_cache(object * imports_key, bool prefer_native):
+        m_imports_key(imports_key), m_prefer_native(prefer_native) {
+        mark_mt(m_imports_key);
+        inc_ref(m_imports_key);
+    }
+
+    ~shared_decl_cache() {
+        m_symbols.clear();
+        dec_ref(m_imports_key);
+    }
+
+    bool is_for(object * imports_key, bool prefer_native) const {
+        return m_imports_key == imports_key && m_prefer_native == prefer_native;
+    }
+
+    symbol_cache_entry * find(name const & fn) {
+        lock_guard<mutex> lock(m_mutex);
+        auto it = m_symbols.find(fn);
+        return it != m_symbols.end() ? &it->second : nullptr;
+    }
+
+    /** \brief Add an entry for `fn`, unless another thread was faster. */
+    symbol_cache_entry & insert(name const & fn, decl const & d, void * addr, bool boxed) {
+        mark_mt(fn.raw());
+        mark_mt(d.raw());
+        lock_guard<mutex> lock(m_mutex);
+        return m_symbols.emplace(std::piecewise_construct, std::forward_as_tuple(fn),
+                                 std::forward_as_tuple(fn, d, addr, boxed, true)).first->second;
+    }
+
+    /** \brief Return the lowered code of `e`. The code of an imported declaration only depends on the imports of
+        `env`. */
+    code & get_code(environment const & env, symbol_cache_entry & e) {
+        lean_assert(e.m_shared);
+        lock_guard<mutex> lock(m_mutex);
+        code * c = e.m_code.load();
+        if (!c) {
+            c = lower_decl(env, e.m_decl, true);
+            e.m_code.store(c, std::memory_order_release);
+        }
+        return *c;
+    }
+};
+
+#ifndef LEAN_NUM_SHARED_DECL_CACHES
+#define LEAN_NUM_SHARED_DECL_CACHES 4
+#endif
+
+// number of lookups answered by a `shared_decl_cache` entry created by another lookup
+static std::atomic<uint64> g_shared_decl_cache_hits(0);
+
+static mutex * g_shared_decl_caches_mutex = nullptr;
+// the most recently used cache last
+static std::vector<std::shared_ptr<shared_decl_cache>> * g_shared_decl_caches = nullptr;
+
+static std::shared_ptr<shared_decl_cache> get_shared_decl_cache(environment const & env, bool prefer_native) {
+    if (!env.has_imports())
+        return nullptr;
+    object * key = env.get_imports_key();
+    lock_guard<mutex> lock(*g_shared_decl_caches_mutex);
+    auto & caches = *g_shared_decl_caches;
+    for (auto it = caches.begin(); it != caches.end(); ++it) {
+        if ((*it)->is_for(key, prefer_native)) {
+            std::shared_ptr<shared_decl_cache> r = *it;
+            caches.erase(it);
+            caches.push_back(r);
+            return r;
+        }
+    }
+    if (caches.size() >= LEAN_NUM_SHARED_DECL_CACHES)
+        caches.erase(caches.begin());
+    caches.push_back(std::make_shared<shared_decl_cache>(key, prefer_native));
+    return caches.back();
+}
+
+#ifndef LEAN_INTERPRETER_PROFILE_MAX_DEPTH
+#define LEAN_INTERPRETER_PROFILE_MAX_DEPTH 256
+#endif
+
+#ifndef LEAN_INTERPRETER_PROFILE_NUM_DECLS
+#define LEAN_INTERPRETER_PROFILE_NUM_DECLS 20
+#endif
+
+/** \brief Cumulative statistics of an IR declaration */
+struct decl_profile {
+    uint64 m_calls{0};
+    // time spent in the declaration itself, and including its callees
+    uint64 m_self_ns{0};
+    uint64 m_total_ns{0};
+    // constructor objects and closures allocated by the `Ctor`, `Reuse` and `PAp` instructions of interpreted code
+    uint64 m_allocs{0};
+};
+
+/** \brief Execution profile of all interpreters, reported by `display_cumulative_profiling_times` */
+struct cumulative_interpreter_profile {
+    mutex                                                             m_mutex;
+    std::unordered_map<name, decl_profile, name_hash_fn, name_eq_fn> m_decls;
+    // self time of each call stack, outermost function first and separated by `;`
+    std::map<std::string, uint64>                                     m_stacks;
+};
+static cumulative_interpreter_profile * g_cumulative_profile = nullptr;
+
+/** \brief Call tree of the code run by an interpreter while the `profiler` option is set.
+
+    Time is measured when entering and leaving a function, and charged to the function being left. Direct recursion
+    is collapsed into a single node. Calls nested more than `LEAN_INTERPRETER_PROFILE_MAX_DEPTH` deep are not
+    recorded; their time and allocations are charged to the deepest recorded caller. */
+class interpreter_profile {
+    typedef std::chrono::steady_clock clock;
+    struct node {
+        // `symbol_cache_entry` of the function, `nullptr` for the root
+        void const * m_key;
+        name         m_fn;
+        unsigned     m_depth;
+        std::unordered_map<void const *, std::unique_ptr<node>> m_children;
+        uint64       m_calls{0};
+        uint64       m_self_ns{0};
+        uint64       m_allocs{0};
+
+        node(void const * key, name const & fn, unsigned depth): m_key(key), m_fn(fn), m_depth(depth) {}
+    };
+    node                m_root;
+    node *              m_cur;
+    std::vector<node *> m_stack;
+    clock::time_point   m_last;
+
+    void charge() {
+        clock::time_point now = clock::now();
+        m_cur->m_self_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(now - m_last).count();
+        m_last = now;
+    }
+
+    /* Add the statistics of `n` and its children to `p`, and return the time spent in `n` including its children.
+       `active` counts the ancestors of each function so that the total time of recursive functions is only counted
+       once. */
+    static uint64 merge(node const & n, std::string const & stack, std::unordered_map<name, unsigned, name_hash_fn, name_eq_fn> & active,
+                        cumulative_interpreter_profile & p) {
+        unsigned & depth = active[n.m_fn];
+        bool outermost   = depth == 0;
+        depth++;
+        uint64 total = n.m_self_ns;
+        for (auto const & c : n.m_children)
+            total += merge(*c.second, stack + ";" + c.second->m_fn.to_string(), active, p);
+        depth--;
+        decl_profile & d = p.m_decls[n.m_fn];
+        d.m_calls   += n.m_calls;
+        d.m_self_ns += n.m_self_ns;
+        d.m_allocs  += n.m_allocs;
+        if (outermost)
+            d.m_total_ns += total;
+        p.m_stacks[stack] += n.m_self_ns;
+        return total;
+    }
+
+public:
+    interpreter_profile(): m_root(nullptr, name(), 0), m_cur(&m_root), m_last(clock::now()) {}
+
+    ~interpreter_profile() {
+        lock_guard<mutex> lock(g_cumulative_profile->m_mutex);
+        std::unordered_map<name, unsigned, name_hash_fn, name_eq_fn> active;
+        for (auto const & c : m_root.m_children)
+            merge(*c.second, c.second->m_fn.to_string(), active, *g_cumulative_profile);
+    }
+
+    void enter(void const * key, name const & fn) {
+        charge();
+        m_stack.push_back(m_cur);
+        if (m_cur->m_key != key) {
+            if (m_cur->m_depth >= LEAN_INTERPRETER_PROFILE_MAX_DEPTH)
+                return;
+            std::unique_ptr<node> & c = m_cur->m_children[key];
+            if (!c)
+                c.reset(new node(key, fn, m_cur->m_depth + 1));
+            m_cur = c.get();
+        }
+        m_cur->m_calls++;
+    }
+
+    void exit() {
+        charge();
+        m_cur = m_stack.back();
+        m_stack.pop_back();
+    }
+
+    void count_alloc() { m_cur->m_allocs++; }
+};
+
+static void display_interpreter_profile(std::ostream & out) {
+    cumulative_interpreter_profile & p = *g_cumulative_profile;
+    lock_guard<mutex> lock(p.m_mutex);
+    if (p.m_decls.empty())
+        return;
+    std::vector<std::pair<name, decl_profile>> decls(p.m_decls.begin(), p.m_decls.end());
+    std::sort(decls.begin(), decls.end(), [](std::pair<name, decl_profile> const & a, std::pair<name, decl_profile> const & b) {
+        return a.second.m_self_ns > b.second.m_self_ns;
+    });
+    auto secs = [](uint64 ns) { return display_profiling_time{second_duration(ns / 1e9)}; };
+    /* Allocations only count the objects created by the interpreter itself. Objects allocated by primitives executed
+       in place (see `initialize_prims`), e.g. big numbers or arrays grown by `Array.push`, and by native code are
+       not included. */
+    out << "cumulative interpreter profile (self time, total time, calls, allocations):\n";
+    for (unsigned i = 0; i < decls.size() && i < LEAN_INTERPRETER_PROFILE_NUM_DECLS; i++) {
+        decl_profile const & d = decls[i].second;
+        out << "\t" << decls[i].first << " " << secs(d.m_self_ns) << " " << secs(d.m_total_ns) << " "
+            << d.m_calls << " " << d.m_allocs << "\n";
+    }
+    // folded stacks with self times in microseconds, as expected by `flamegraph.pl`
+    if (char const * fname = std::getenv("LEAN_PROFILE_FLAMEGRAPH")) {
+        std::ofstream f(fname);
+        for (auto const & s : p.m_stacks) {
+            if (s.second >= 1000)
+                f << s.first << " " << s.second / 1000 << "\n";
+        }
+        if (f.fail())
+            out << "failed to write interpreter profile to '" << fname << "'\n";
+        else
+            out << "interpreter profile written to '" << fname << "'\n";
+    }
+}
+
 class interpreter;
 LEAN_THREAD_PTR(interpreter, g_interpreter);
 
 class interpreter {
     // stack of IR variable slots
     std::vector<value> m_arg_stack;
-    // stack of join points
-    std::vector<fn_body const *> m_jp_stack;
     struct frame {
-        name m_fn;
-        // base pointers into the stack above
+        name const * m_fn;
+        // base pointer into the stack above, pointing at slot 0 for interpreted functions
         size_t m_arg_bp;
-        size_t m_jp_bp;
 
-        frame(name const & mFn, size_t mArgBp, size_t mJpBp) : m_fn(mFn), m_arg_bp(mArgBp), m_jp_bp(mJpBp) {}
+        frame(name const & fn, size_t arg_bp) : m_fn(&fn), m_arg_bp(arg_bp) {}
     };
     std::vector<frame> m_call_stack;
+    // temporary storage for parallel assignments
+    std::vector<value> m_scratch;
     environment const & m_env;
     options const & m_opts;
     // if `false`, use IR code where possible
     bool m_prefer_native;
-    struct constant_cache_entry {
-      bool m_is_scalar;
-      value m_val;
-    };
-    // caches values of nullary functions ("constants")
-    name_map<constant_cache_entry> m_constant_cache;
-    struct symbol_cache_entry {
-        decl m_decl;
-        // symbol address; `nullptr` if function does not have native code
-        void * m_addr;
-        // true iff we chose the boxed version of a function where the IR uses the unboxed version
-        bool m_boxed;
+    // entries for imported declarations, `nullptr` if the environment has no imports
+    std::shared_ptr<shared_decl_cache> m_shared;
+    // entries for declarations of the current module
+    std::deque<symbol_cache_entry> m_local_symbols;
+    // caches symbol lookup successes _and_ failures, as well as values of nullary functions ("constants")
+    std::unordered_map<name, symbol_cache_entry *, name_hash_fn, name_eq_fn> m_symbol_cache;
+    // values of shared constants that contain interpreter closures, which capture the environment and options of
+    // this interpreter and thus cannot be shared
+    std::unordered_map<symbol_cache_entry const *, object_ref> m_local_constants;
+    // `nullptr` unless the `profiler` option is set
+    std::unique_ptr<interpreter_profile> m_profile;
+
+    /** \brief Records the execution of a function in the profile, if any, while in scope. */
+    class profile_scope {
+        interpreter_profile * m_profile;
+    public:
+        profile_scope(interpreter const & interp, symbol_cache_entry const & e): m_profile(interp.m_profile.get()) {
+            if (m_profile)
+                m_profile->enter(&e, e.m_fn);
+        }
+        ~profile_scope() {
+            if (m_profile)
+                m_profile->exit();
+        }
     };
-    // caches symbol lookup successes _and_ failures
-    name_map<symbol_cache_entry> m_symbol_cache;
 
     /** \brief Get current stack frame */
     inline frame & get_frame() {
         return m_call_stack.back();
     }
 
-    /** \brief Get reference to stack slot of IR variable */
-    inline value & var(var_id const & v) {
-        // variables are 1-indexed
-        size_t i = get_frame().m_arg_bp + v.get_small_value() - 1;
-        // we don't know the frame size (unless we do an additional IR pass), so we extend it dynamically
-        if (i >= m_arg_stack.size()) {
-            m_arg_stack.resize(i + 1);
-        }
-        return m_arg_stack[i];
-    }
-
 public:
     template<class T>
     static inline T with_interpreter(environment const & env, options const & opts, name const & fn, std::function<T(interpreter &)> const & f) {
@@ -375,38 +1236,30 @@ public:
             // We changed threads or the closure was stored and called in a different context.
             time_task t("interpretation", opts, fn);
             scope_trace_env scope_trace(env, opts);
-            // the caches contain data from the Environment, so we cannot reuse them when changing it
+            // the local caches contain data from the Environment, so we cannot reuse them when changing it;
+            // data about imported declarations is kept in a `shared_decl_cache`
             interpreter interp(env, opts);
             flet<interpreter *> fl(g_interpreter, &interp);
             return f(interp);
         }
     }
 
+    /** \brief Collect the innermost functions on the call stack of the current interpreter for the heap profiler */
+    static void get_heapprof_frames(std::vector<std::string> & frames, unsigned max_frames) {
+        if (interpreter * interp = g_interpreter) {
+            for (auto it = interp->m_call_stack.rbegin(); it != interp->m_call_stack.rend() && frames.size() < max_frames; ++it)
+                frames.push_back(it->m_fn->to_string());
+        }
+    }
+
 private:
-    value eval_arg(arg const & a) {
-        // an "irrelevant" argument is type- or proof-erased; we can use an arbitrary value for it
-        return arg_is_irrelevant(a) ? box(0) : var(arg_var_id(a));
-    }
-
-    /** \brief Allocate constructor object with given tag and arguments */
-    object * alloc_ctor(ctor_info const & i, array_ref<arg> const & args) {
-        size_t tag = ctor_info_tag(i).get_small_value();
-        // number of boxed object fields
-        size_t size = ctor_info_size(i).get_small_value();
-        // number of unboxed USize fields (whose byte size the IR is ignorant of)
-        size_t usize = ctor_info_usize(i).get_small_value();
-        // byte size of all other unboxed fields
-        size_t ssize = ctor_info_ssize(i).get_small_value();
-        if (size == 0 && usize == 0 && ssize == 0) {
-            // a constructor without data is optimized to a tagged pointer
-            return box(tag);
-        } else {
-            object *o = alloc_cnstr(tag, size, usize * sizeof(void *) + ssize);
-            for (size_t i = 0; i < args.size(); i++) {
-                cnstr_set(o, i, eval_arg(args[i]).m_obj);
-            }
-            return o;
+    /** \brief Allocate constructor object with given layout and arguments */
+    object * alloc_ctor(ctor_layout const & l, unsigned const * args, value const * fp) {
+        object * o = alloc_cnstr(l.m_tag, l.m_num_objs, l.m_scalar_sz);
+        for (unsigned i = 0; i < l.m_num_args; i++) {
+            cnstr_set(o, i, fp[args[i]].m_obj);
         }
+        return o;
     }
 
     /** \brief Return closure pointing to interpreter stub taking interpreter data, declaration to be called, and partially
@@ -422,133 +1275,32 @@ private:
         return cls;
     }
 
-    value eval_expr(expr const & e, type t) {
-        switch (expr_tag(e)) {
-            case expr_kind::Ctor:
-                return value { alloc_ctor(expr_ctor_info(e), expr_ctor_args(e)) };
-            case expr_kind::Reset: { // release fields if unique reference in preparation for `Reuse` below
-                object * o = var(expr_reset_obj(e)).m_obj;
-                if (is_exclusive(o)) {
-                    for (size_t i = 0; i < expr_reset_num_objs(e).get_small_value(); i++) {
-                        cnstr_release(o, i);
-                    }
-                    return o;
-                } else {
-                    dec_ref(o);
-                    return box(0);
-                }
-            }
-            case expr_kind::Reuse: { // reuse dead allocation if possible
-                object * o = var(expr_reuse_obj(e)).m_obj;
-                // check if `Reset` above had a unique reference it consumed
-                if (is_scalar(o)) {
-                    // fall back to regular allocation
-                    return alloc_ctor(expr_reuse_ctor(e), expr_reuse_args(e));
-                } else {
-                    // create new constructor object in-place
-                    if (expr_reuse_update_header(e)) {
-                        cnstr_set_tag(o, ctor_info_tag(expr_reuse_ctor(e)).get_small_value());
-                    }
-                    for (size_t i = 0; i < expr_reuse_args(e).size(); i++) {
-                        cnstr_set(o, i, eval_arg(expr_reuse_args(e)[i]).m_obj);
-                    }
-                    return o;
-                }
-            }
-            case expr_kind::Proj: // object field access
-                return cnstr_get(var(expr_proj_obj(e)).m_obj, expr_proj_idx(e).get_small_value());
-            case expr_kind::UProj: // USize field access
-                return cnstr_get_usize(var(expr_uproj_obj(e)).m_obj, expr_uproj_idx(e).get_small_value());
-            case expr_kind::SProj: { // other unboxed field access
-                size_t offset = expr_sproj_idx(e).get_small_value() * sizeof(void *) +
-                                expr_sproj_offset(e).get_small_value();
-                object * o = var(expr_sproj_obj(e)).m_obj;
-                switch (t) {
-                    case type::Float: return value::from_float(cnstr_get_float(o, offset));
-                    case type::UInt8: return cnstr_get_uint8(o, offset);
-                    case type::UInt16: return cnstr_get_uint16(o, offset);
-                    case type::UInt32: return cnstr_get_uint32(o, offset);
-                    case type::UInt64: return cnstr_get_uint64(o, offset);
-                    case type::USize:
-                    case type::Irrelevant:
-                    case type::Object:
-                    case type::TObject:
-                        break;
-                }
-                throw exception("invalid instruction");
-            }
-            case expr_kind::FAp: { // satured ("full") application of top-level function
-                if (expr_fap_args(e).size()) {
-                    return call(expr_fap_fun(e), expr_fap_args(e));
-                } else {
-                    // nullary function ("constant")
-                    return load(expr_fap_fun(e), t);
-                }
-            }
-            case expr_kind::PAp: { // unsatured (partial) application of top-level function
-                symbol_cache_entry sym = lookup_symbol(expr_pap_fun(e));
-                if (sym.m_addr) {
-                    // point closure directly at native symbol
-                    object * cls = alloc_closure(sym.m_addr, decl_params(sym.m_decl).size(), expr_pap_args(e).size());
-                    for (unsigned i = 0; i < expr_pap_args(e).size(); i++) {
-                        closure_set(cls, i, eval_arg(expr_pap_args(e)[i]).m_obj);
-                    }
-                    return cls;
-                } else {
-                    // point closure at interpreter stub
-                    object ** args = static_cast<object **>(LEAN_ALLOCA(expr_pap_args(e).size() * sizeof(object *))); // NOLINT
-                    for (size_t i = 0; i < expr_pap_args(e).size(); i++) {
-                        args[i] = eval_arg(expr_pap_args(e)[i]).m_obj;
-                    }
-                    return mk_stub_closure(sym.m_decl, expr_pap_args(e).size(), args);
-                }
+    /** \brief Unsatured (partial) application of top-level function */
+    object * mk_pap(symbol_cache_entry const & e, unsigned n, unsigned const * args, value const * fp) {
+        if (e.m_addr) {
+            // point closure directly at native symbol
+            object * cls = alloc_closure(e.m_addr, e.m_param_types.size(), n);
+            for (unsigned i = 0; i < n; i++) {
+                closure_set(cls, i, fp[args[i]].m_obj);
             }
-            case expr_kind::Ap: { // (saturated or unsatured) application of closure; mostly handled by runtime
-                object ** args = static_cast<object **>(LEAN_ALLOCA(expr_ap_args(e).size() * sizeof(object *))); // NOLINT
-                for (size_t i = 0; i < expr_ap_args(e).size(); i++) {
-                    args[i] = eval_arg(expr_ap_args(e)[i]).m_obj;
-                }
-                object * r = apply_n(var(expr_ap_fun(e)).m_obj, expr_ap_args(e).size(), args);
-                return r;
+            return cls;
+        } else {
+            // point closure at interpreter stub
+            object ** as = static_cast<object **>(LEAN_ALLOCA(n * sizeof(object *))); // NOLINT
+            for (unsigned i = 0; i < n; i++) {
+                as[i] = fp[args[i]].m_obj;
             }
-            case expr_kind::Box: // box unboxed value
-                return box_t(var(expr_box_obj(e)).m_num, expr_box_type(e));
-            case expr_kind::Unbox: // unbox boxed value
-                return unbox_t(var(expr_unbox_obj(e)).m_obj, t);
-            case expr_kind::Lit: // load numeric or string literal
-                switch (lit_val_tag(expr_lit_val(e))) {
-                    case lit_val_kind::Num: {
-                        nat const & n = lit_val_num(expr_lit_val(e));
-                        switch (t) {
-                            case type::Float:
-                                lean_inc(n.raw());
-                                return value::from_float(lean_float_of_nat(n.raw()));
-                            case type::UInt8:
-                            case type::UInt16:
-                            case type::UInt32:
-                            case type::USize:
-                                return lean_usize_of_nat(n.raw());
-                            case type::UInt64:
-                                return lean_uint64_of_nat(n.raw());
-                            // `nat` literal
-                            case type::Object:
-                            case type::TObject:
-                                return n.to_obj_arg();
-                            case type::Irrelevant:
-                                break;
-                        }
-                        throw exception("invalid instruction");
-                    }
-                    case lit_val_kind::Str:
-                        return lit_val_str(expr_lit_val(e)).to_obj_arg();
-                }
-                break;
-            case expr_kind::IsShared:
-                return !is_exclusive(var(expr_is_shared_obj(e)).m_obj);
-            case expr_kind::IsTaggedPtr:
-                return !is_scalar(var(expr_is_tagged_ptr_obj(e)).m_obj);
+            return mk_stub_closure(e.m_decl, n, as);
         }
-        throw exception(sstream() << "unexpected instruction kind " << static_cast<unsigned>(expr_tag(e)));
+    }
+
+    /** \brief (Saturated or unsatured) application of closure; mostly handled by runtime */
+    object * apply(object * f, unsigned n, unsigned const * args, value const * fp) {
+        object ** as = static_cast<object **>(LEAN_ALLOCA(n * sizeof(object *))); // NOLINT
+        for (unsigned i = 0; i < n; i++) {
+            as[i] = fp[args[i]].m_obj;
+        }
+        return apply_n(f, n, as);
     }
 
     void check_system() {
@@ -559,185 +1311,268 @@ private:
             ss << ex.what() << "\n";
             ss << "interpreter stacktrace:\n";
             for (unsigned i = 0; i < m_call_stack.size(); i++) {
-                ss << "#" << (i + 1) << " " << m_call_stack[m_call_stack.size() - i - 1].m_fn << "\n";
+                ss << "#" << (i + 1) << " " << *m_call_stack[m_call_stack.size() - i - 1].m_fn << "\n";
             }
             throw throwable(ss);
         }
     }
 
-    value eval_body(fn_body const & b0) {
-        check_system();
-
-        // make reference reassignable...
-        std::reference_wrapper<fn_body const> b(b0);
-        while (true) {
-            DEBUG_CODE(lean_trace(name({"interpreter", "step"}),
-                                  tout() << std::string(m_call_stack.size(), ' ') << format_fn_body_head(b) << "\n";);)
-            switch (fn_body_tag(b)) {
-                case fn_body_kind::VDecl: { // variable declaration
-                    expr const & e = fn_body_vdecl_expr(b);
-                    fn_body const & cont = fn_body_vdecl_cont(b);
-                    // tail recursion?
-                    if (expr_tag(e) == expr_kind::FAp && expr_fap_fun(e) == get_frame().m_fn &&
-                        fn_body_tag(cont) == fn_body_kind::Ret && !arg_is_irrelevant(fn_body_ret_arg(cont)) &&
-                        arg_var_id(fn_body_ret_arg(cont)) == fn_body_vdecl_var(b)) {
-                        // tail recursion! copy argument values to parameter slots and reset `b`
-                        array_ref<arg> const & args = expr_fap_args(e);
-                        // argument and parameter slots may overlap, so first copy arguments to end of stack
-                        size_t old_size = m_arg_stack.size();
-                        for (const auto & arg : args) {
-                            m_arg_stack.push_back(eval_arg(arg));
-                        }
-                        // now copy to parameter slots
-                        for (size_t i = 0; i < args.size(); i++) {
-                            m_arg_stack[get_frame().m_arg_bp + i] = m_arg_stack[old_size + i];
-                        }
-                        m_arg_stack.resize(get_frame().m_arg_bp + args.size());
-                        b = b0;
-                        check_system();
-                        break;
-                    }
-                    value v = eval_expr(fn_body_vdecl_expr(b), fn_body_vdecl_type(b));
-                    // NOTE: `var` must be called *after* `eval_expr` because the stack may get resized and invalidate
-                    // the pointer
-                    var(fn_body_vdecl_var(b)) = v;
-                    DEBUG_CODE(lean_trace(name({"interpreter", "step"}),
-                                          tout() << std::string(m_call_stack.size(), ' ') << "=> x_";
-                                          tout() << fn_body_vdecl_var(b).get_small_value() << " = ";
-                                          print_value(tout(), var(fn_body_vdecl_var(b)), fn_body_vdecl_type(b));
-                                          tout() << "\n";);)
-                    b = fn_body_vdecl_cont(b);
-                    break;
-                }
-                case fn_body_kind::JDecl: { // join-point declaration; store in stack slot just like variables
-                    size_t i = get_frame().m_jp_bp + fn_body_jdecl_id(b).get_small_value();
-                    if (i >= m_jp_stack.size()) {
-                        m_jp_stack.resize(i + 1);
-                    }
-                    m_jp_stack[i] = &b.get();
-                    b = fn_body_jdecl_cont(b);
-                    break;
+    /** \brief Execute the instruction `i` of `c` in the frame `fp`, unless it is a control-flow instruction, which are
+        handled by `run`. Return the new frame pointer, which changes if the stack has been resized by a call. */
+    value * step(code & c, instr const & i, value * fp) {
+        unsigned const * ops = c.m_operands.data();
+        switch (i.m_op) {
+        case opcode::Ctor:
+            fp[i.m_dst] = alloc_ctor(c.m_ctors[i.m_a], ops + i.m_b, fp);
+            if (m_profile)
+                m_profile->count_alloc();
+            break;
+        case opcode::Const:
+            fp[i.m_dst] = c.m_scalars[i.m_a];
+            break;
+        case opcode::LitObj:
+            fp[i.m_dst] = c.m_objs[i.m_a].to_obj_arg();
+            break;
+        case opcode::Reset: { // release fields if unique reference in preparation for `Reuse` below
+            object * o = fp[i.m_a].m_obj;
+            value r;
+            if (is_exclusive(o)) {
+                for (unsigned j = 0; j < i.m_b; j++) {
+                    cnstr_release(o, j);
                 }
-                case fn_body_kind::Set: { // set boxed field of unique reference
-                    object * o = var(fn_body_set_var(b)).m_obj;
-                    lean_assert(is_exclusive(o));
-                    cnstr_set(o, fn_body_set_idx(b).get_small_value(), eval_arg(fn_body_set_arg(b)).m_obj);
-                    b = fn_body_set_cont(b);
-                    break;
+                r = o;
+            } else {
+                dec_ref(o);
+                r = box(0);
+            }
+            // freeing the fields may run finalizers that re-enter the interpreter and resize the stack
+            fp = &m_arg_stack[get_frame().m_arg_bp];
+            fp[i.m_dst] = r;
+            break;
+        }
+        case opcode::Reuse:
+        case opcode::ReuseUpdateHeader: { // reuse dead allocation if possible
+            object * o = fp[i.m_a].m_obj;
+            ctor_layout const & l = c.m_ctors[i.m_b];
+            // check if `Reset` above had a unique reference it consumed
+            if (is_scalar(o)) {
+                // fall back to regular allocation
+                fp[i.m_dst] = alloc_ctor(l, ops + i.m_c, fp);
+                if (m_profile)
+                    m_profile->count_alloc();
+            } else {
+                // create new constructor object in-place
+                if (i.m_op == opcode::ReuseUpdateHeader) {
+                    cnstr_set_tag(o, l.m_tag);
                 }
-                case fn_body_kind::SetTag: { // set constructor tag of unique reference
-                    object * o = var(fn_body_set_tag_var(b)).m_obj;
-                    lean_assert(is_exclusive(o));
-                    cnstr_set_tag(o, fn_body_set_tag_cidx(b).get_small_value());
-                    b = fn_body_set_tag_cont(b);
-                    break;
+                for (unsigned j = 0; j < l.m_num_args; j++) {
+                    cnstr_set(o, j, fp[ops[i.m_c + j]].m_obj);
                 }
-                case fn_body_kind::USet: { // set USize field of unique reference
-                    object * o = var(fn_body_uset_target(b)).m_obj;
-                    lean_assert(is_exclusive(o));
-                    cnstr_set_usize(o, fn_body_uset_idx(b).get_small_value(), var(fn_body_uset_source(b)).m_num);
-                    b = fn_body_uset_cont(b);
-                    break;
+                fp[i.m_dst] = o;
+            }
+            break;
+        }
+        case opcode::Proj: // object field access
+            fp[i.m_dst] = cnstr_get(fp[i.m_a].m_obj, i.m_b);
+            break;
+        case opcode::UProj: // USize field access
+            fp[i.m_dst] = cnstr_get_usize(fp[i.m_a].m_obj, i.m_b);
+            break;
+        case opcode::SProj: { // other unboxed field access
+            object * o = fp[i.m_a].m_obj;
+            switch (i.m_type) {
+                case type::Float: fp[i.m_dst] = value::from_float(cnstr_get_float(o, i.m_b)); break;
+                case type::UInt8: fp[i.m_dst] = cnstr_get_uint8(o, i.m_b); break;
+                case type::UInt16: fp[i.m_dst] = cnstr_get_uint16(o, i.m_b); break;
+                case type::UInt32: fp[i.m_dst] = cnstr_get_uint32(o, i.m_b); break;
+                case type::UInt64: fp[i.m_dst] = cnstr_get_uint64(o, i.m_b); break;
+                default: lean_unreachable();
+            }
+            break;
+        }
+        case opcode::Call: { // satured ("full") application of top-level function
+            value r = call(get_callee(c, i.m_a), i.m_c, ops + i.m_b);
+            // the stack may have been resized
+            fp = &m_arg_stack[get_frame().m_arg_bp];
+            fp[i.m_dst] = r;
+            break;
+        }
+        case opcode::Prim:
+            fp[i.m_dst] = c.m_prims[i.m_a](fp, ops + i.m_b);
+            break;
+        case opcode::Load: { // nullary function ("constant")
+            value r = load(get_callee(c, i.m_a), i.m_type);
+            fp = &m_arg_stack[get_frame().m_arg_bp];
+            fp[i.m_dst] = r;
+            break;
+        }
+        case opcode::PAp:
+            fp[i.m_dst] = mk_pap(get_callee(c, i.m_a), i.m_c, ops + i.m_b, fp);
+            if (m_profile)
+                m_profile->count_alloc();
+            break;
+        case opcode::Ap: {
+            object * r = apply(fp[i.m_a].m_obj, i.m_c, ops + i.m_b, fp);
+            fp = &m_arg_stack[get_frame().m_arg_bp];
+            fp[i.m_dst] = r;
+            break;
+        }
+        case opcode::Box: // box unboxed value
+            fp[i.m_dst] = box_t(fp[i.m_a], static_cast<type>(i.m_b));
+            break;
+        case opcode::Unbox: // unbox boxed value
+            fp[i.m_dst] = unbox_t(fp[i.m_a].m_obj, i.m_type);
+            break;
+        case opcode::IsShared:
+            fp[i.m_dst] = !is_exclusive(fp[i.m_a].m_obj);
+            break;
+        case opcode::IsTaggedPtr:
+            fp[i.m_dst] = !is_scalar(fp[i.m_a].m_obj);
+            break;
+        case opcode::Set: { // set boxed field of unique reference
+            object * o = fp[i.m_a].m_obj;
+            lean_assert(is_exclusive(o));
+            cnstr_set(o, i.m_b, fp[i.m_c].m_obj);
+            return fp;
+        }
+        case opcode::SetTag: { // set constructor tag of unique reference
+            object * o = fp[i.m_a].m_obj;
+            lean_assert(is_exclusive(o));
+            cnstr_set_tag(o, i.m_b);
+            return fp;
+        }
+        case opcode::USet: { // set USize field of unique reference
+            object * o = fp[i.m_a].m_obj;
+            lean_assert(is_exclusive(o));
+            cnstr_set_usize(o, i.m_b, fp[i.m_c].m_num);
+            return fp;
+        }
+        case opcode::SSet: { // set other unboxed field of unique reference
+            object * o = fp[i.m_a].m_obj;
+            value v = fp[i.m_c];
+            lean_assert(is_exclusive(o));
+            switch (i.m_type) {
+                case type::Float: cnstr_set_float(o, i.m_b, v.m_float); break;
+                case type::UInt8: cnstr_set_uint8(o, i.m_b, v.m_num); break;
+                case type::UInt16: cnstr_set_uint16(o, i.m_b, v.m_num); break;
+                case type::UInt32: cnstr_set_uint32(o, i.m_b, v.m_num); break;
+                case type::UInt64: cnstr_set_uint64(o, i.m_b, v.m_num); break;
+                default: lean_unreachable();
+            }
+            return fp;
+        }
+        case opcode::Inc: // increment reference counter
+            inc(fp[i.m_a].m_obj, i.m_b);
+            return fp;
+        case opcode::Dec: { // decrement reference counter
+            object * o = fp[i.m_a].m_obj;
+            for (unsigned j = 0; j < i.m_b; j++) {
+                dec(o);
+            }
+            // as in `Reset`, finalizers may have resized the stack
+            return &m_arg_stack[get_frame().m_arg_bp];
+        }
+        case opcode::Del: // delete object of unique reference
+            lean_free_object(fp[i.m_a].m_obj);
+            return fp;
+        case opcode::Unreachable:
+            throw exception("unreachable code");
+        case opcode::Error:
+            throw exception(c.m_errors[i.m_a]);
+        default:
+            lean_unreachable();
+        }
+        // `i` assigned the variable `x_{m_dst}`
+        DEBUG_CODE(lean_trace(name({"interpreter", "step"}),
+                              tout() << std::string(m_call_stack.size(), ' ') << "=> x_" << i.m_dst << " = ";
+                              print_value(tout(), fp[i.m_dst], i.m_type);
+                              tout() << "\n";);)
+        return fp;
+    }
+
+    /** \brief Execute `c` in the current frame, whose slots have already been allocated. */
+    value run(code & c) {
+        check_system();
+        value * fp             = &m_arg_stack[get_frame().m_arg_bp];
+        instr const * instrs   = c.m_instrs.data();
+        unsigned const * ops   = c.m_operands.data();
+        unsigned pc            = 0;
+        while (true) {
+            instr const & i = instrs[pc++];
+            DEBUG_CODE(lean_trace(name({"interpreter", "step"}),
+                                  tout() << std::string(m_call_stack.size(), ' ') << format_fn_body_head(c.m_src[&i - instrs]) << "\n";);)
+            switch (i.m_op) {
+            case opcode::TailCall: // tail recursion! copy argument values to parameter slots and restart
+                for (unsigned j = 0; j < i.m_c; j++) {
+                    fp[j + 1] = fp[ops[i.m_b + j]];
                 }
-                case fn_body_kind::SSet: { // set other unboxed field of unique reference
-                    object * o = var(fn_body_sset_target(b)).m_obj;
-                    size_t offset = fn_body_sset_idx(b).get_small_value() * sizeof(void *) +
-                                    fn_body_sset_offset(b).get_small_value();
-                    value v = var(fn_body_sset_source(b));
-                    lean_assert(is_exclusive(o));
-                    switch (fn_body_sset_type(b)) {
-                        case type::Float: cnstr_set_float(o, offset, v.m_float); break;
-                        case type::UInt8: cnstr_set_uint8(o, offset, v.m_num); break;
-                        case type::UInt16: cnstr_set_uint16(o, offset, v.m_num); break;
-                        case type::UInt32: cnstr_set_uint32(o, offset, v.m_num); break;
-                        case type::UInt64: cnstr_set_uint64(o, offset, v.m_num); break;
-                        case type::USize:
-                        case type::Irrelevant:
-                        case type::Object:
-                        case type::TObject:
-                            throw exception(sstream() << "invalid instruction");
-                    }
-                    b = fn_body_sset_cont(b);
-                    break;
+                pc = 0;
+                check_system();
+                continue;
+            case opcode::TailCallPar:
+                m_scratch.clear();
+                for (unsigned j = 0; j < i.m_c; j++) {
+                    m_scratch.push_back(fp[ops[i.m_b + j]]);
                 }
-                case fn_body_kind::Inc: // increment reference counter
-                    inc(var(fn_body_inc_var(b)).m_obj, fn_body_inc_val(b).get_small_value());
-                    b = fn_body_inc_cont(b);
-                    break;
-                case fn_body_kind::Dec: { // decrement reference counter
-                    size_t n = fn_body_dec_val(b).get_small_value();
-                    for (size_t i = 0; i < n; i++) {
-                        dec(var(fn_body_dec_var(b)).m_obj);
-                    }
-                    b = fn_body_dec_cont(b);
-                    break;
+                for (unsigned j = 0; j < i.m_c; j++) {
+                    fp[j + 1] = m_scratch[j];
                 }
-                case fn_body_kind::Del: // delete object of unique reference
-                    lean_free_object(var(fn_body_del_var(b)).m_obj);
-                    b = fn_body_del_cont(b);
-                    break;
-                case fn_body_kind::MData: // metadata; no-op
-                    b = fn_body_mdata_cont(b);
-                    break;
-                case fn_body_kind::Case: { // branch according to constructor tag
-                    array_ref<alt_core> const & alts = fn_body_case_alts(b);
-                    unsigned tag;
-                    value v = var(fn_body_case_var(b));
-                    if (type_is_scalar(fn_body_case_var_type(b))) {
-                        tag = v.m_num;
-                    } else {
-                        tag = lean_obj_tag(v.m_obj);
-                    }
-                    for (alt_core const & a : alts) {
-                        switch (alt_core_tag(a)) {
-                            case alt_core_kind::Ctor:
-                                if (tag == ctor_info_tag(alt_core_ctor_info(a)).get_small_value()) {
-                                    b = alt_core_ctor_cont(a);
-                                    goto done;
-                                }
-                                break;
-                            case alt_core_kind::Default:
-                                b = alt_core_default_cont(a);
-                                goto done;
-                        }
-                    }
+                pc = 0;
+                check_system();
+                continue;
+            case opcode::Case: { // branch according to constructor tag
+                value v = fp[i.m_a];
+                unsigned tag = type_is_scalar(i.m_type) ? v.m_num : lean_obj_tag(v.m_obj);
+                unsigned target = ops[i.m_b + std::min(tag, i.m_c)];
+                if (target == g_no_target)
                     throw exception("incomplete case");
-                    done: break;
+                pc = target;
+                continue;
+            }
+            case opcode::Ret:
+                return fp[i.m_a];
+            case opcode::Jmp: { // jump to join-point
+                join_point const & jp = c.m_jps[i.m_a];
+                for (unsigned j = 0; j < i.m_c; j++) {
+                    fp[ops[jp.m_params + j]] = fp[ops[i.m_b + j]];
                 }
-                case fn_body_kind::Ret:
-                    return eval_arg(fn_body_ret_arg(b));
-                case fn_body_kind::Jmp: { // jump to join-point
-                    fn_body const & jp = *m_jp_stack[get_frame().m_jp_bp + fn_body_jmp_jp(b).get_small_value()];
-                    lean_assert(fn_body_jdecl_params(jp).size() == fn_body_jmp_args(b).size());
-                    for (size_t i = 0; i < fn_body_jdecl_params(jp).size(); i++) {
-                        var(param_var(fn_body_jdecl_params(jp)[i])) = eval_arg(fn_body_jmp_args(b)[i]);
-                    }
-                    b = fn_body_jdecl_body(jp);
-                    break;
+                pc = jp.m_pc;
+                continue;
+            }
+            case opcode::JmpPar: {
+                join_point const & jp = c.m_jps[i.m_a];
+                m_scratch.clear();
+                for (unsigned j = 0; j < i.m_c; j++) {
+                    m_scratch.push_back(fp[ops[i.m_b + j]]);
+                }
+                for (unsigned j = 0; j < i.m_c; j++) {
+                    fp[ops[jp.m_params + j]] = m_scratch[j];
                 }
-                case fn_body_kind::Unreachable:
-                    throw exception("unreachable code");
+                pc = jp.m_pc;
+                continue;
+            }
+            default:
+                fp = step(c, i, fp);
             }
         }
     }
 
     // specify argument base pointer explicitly because we've usually already pushed some function arguments
-    void push_frame(decl const & d, size_t arg_bp) {
+    void push_frame(name const & fn, std::vector<type> const & DEBUG_CODE(param_types), size_t arg_bp) {
         DEBUG_CODE({
             lean_trace(name({"interpreter", "call"}),
-                       tout() << std::string(m_call_stack.size(), ' ')
-                              << decl_fun_id(d);
-                       for (size_t i = arg_bp; i < m_arg_stack.size(); i++) {
-                           tout() << " "; print_value(tout(), m_arg_stack[i], param_type(decl_params(d)[i - arg_bp]));
+                       tout() << std::string(m_call_stack.size(), ' ') << fn;
+                       // arguments of interpreted functions start at slot 1
+                       for (size_t i = 0; i < param_types.size() && arg_bp + i + 1 < m_arg_stack.size(); i++) {
+                           tout() << " "; print_value(tout(), m_arg_stack[arg_bp + i + 1], param_types[i]);
                        }
                        tout() << "\n";);
         });
-        m_call_stack.emplace_back(decl_fun_id(d), arg_bp, m_jp_stack.size());
+        m_call_stack.emplace_back(fn, arg_bp);
     }
 
     void pop_frame(value DEBUG_CODE(r), type DEBUG_CODE(t)) {
         m_arg_stack.resize(get_frame().m_arg_bp);
-        m_jp_stack.resize(get_frame().m_jp_bp);
         m_call_stack.pop_back();
         DEBUG_CODE({
             lean_trace(name({"interpreter", "call"}),
@@ -748,27 +1583,69 @@ private:
        });
     }
 
+    /** \brief Allocate a frame for `c` at `bp`. The arguments must have been pushed at `bp + 1`, ... */
+    void enter(code & c, size_t bp) {
+        m_arg_stack[bp] = box(0);
+        m_arg_stack.resize(bp + c.m_frame_size);
+        push_frame(c.m_fn, c.m_param_types, bp);
+    }
+
     /** \brief Return cached lookup result for given unmangled function name in the current binary. */
-    symbol_cache_entry lookup_symbol(name const & fn) {
-        if (symbol_cache_entry const * e = m_symbol_cache.find(fn)) {
-            return *e;
-        } else {
-            symbol_cache_entry e_new { get_decl(fn), nullptr, false };
-            if (m_prefer_native || decl_tag(e_new.m_decl) == decl_kind::Extern || has_init_attribute(m_env, fn)) {
+    symbol_cache_entry & lookup_symbol(name const & fn) {
+        auto it = m_symbol_cache.find(fn);
+        if (it != m_symbol_cache.end())
+            return *it->second;
+        bool shared = m_shared && is_imported_ir_decl(m_env, fn);
+        symbol_cache_entry * e = shared ? m_shared->find(fn) : nullptr;
+        if (e)
+            g_shared_decl_cache_hits++;
+        if (!e) {
+            decl d = get_decl(fn);
+            void * addr = nullptr;
+            bool boxed = false;
+            if (m_prefer_native || decl_tag(d) == decl_kind::Extern || has_init_attribute(m_env, fn)) {
                 string_ref mangled = name_mangle(fn, *g_mangle_prefix);
                 string_ref boxed_mangled(string_append(mangled.to_obj_arg(), g_boxed_mangled_suffix->raw()));
                 // check for boxed version first
                 if (void *p_boxed = lookup_symbol_in_cur_exe(boxed_mangled.data())) {
-                    e_new.m_addr = p_boxed;
-                    e_new.m_boxed = true;
+                    addr = p_boxed;
+                    boxed = true;
                 } else if (void *p = lookup_symbol_in_cur_exe(mangled.data())) {
                     // if there is no boxed version, there are no unboxed parameters, so use default version
-                    e_new.m_addr = p;
+                    addr = p;
                 }
             }
-            m_symbol_cache.insert(fn, e_new);
-            return e_new;
+            if (shared) {
+                e = &m_shared->insert(fn, d, addr, boxed);
+            } else {
+                m_local_symbols.emplace_back(fn, d, addr, boxed, false);
+                e = &m_local_symbols.back();
+            }
         }
+        m_symbol_cache.emplace(fn, e);
+        return *e;
+    }
+
+    symbol_cache_entry & get_callee(code & c, unsigned i) {
+        symbol_cache_entry * e = c.m_callee_entries[i].load(std::memory_order_acquire);
+        if (!e) {
+            e = &lookup_symbol(c.m_callees[i]);
+            // shared code must not point to the entries of this interpreter
+            if (!c.m_shared || e->m_shared)
+                c.m_callee_entries[i].store(e, std::memory_order_release);
+        }
+        return *e;
+    }
+
+    /** \brief Return the lowered code of the declaration of `e`. */
+    code & get_code(symbol_cache_entry & e) {
+        if (code * c = e.m_code.load(std::memory_order_acquire))
+            return *c;
+        if (e.m_shared)
+            return m_shared->get_code(m_env, e);
+        code * c = lower_decl(m_env, e.m_decl, false);
+        e.m_code.store(c);
+        return *c;
     }
 
     /** \brief Retrieve Lean declaration from environment. */
@@ -781,12 +1658,18 @@ private:
     }
 
     /** \brief Evaluate nullary function ("constant"). */
-    value load(name const & fn, type t) {
-        if (constant_cache_entry const * cached = m_constant_cache.find(fn)) {
-            if (!cached->m_is_scalar) {
-                inc(cached->m_val.m_obj);
+    value load(symbol_cache_entry & e, type t) {
+        name const & fn = e.m_fn;
+        uint8 state = e.m_const_state.load(std::memory_order_acquire);
+        if (state == 2) {
+            if (!e.m_const_is_scalar) {
+                inc(e.m_const_val.m_obj);
             }
-            return cached->m_val;
+            return e.m_const_val;
+        } else if (state == 3) {
+            auto it = m_local_constants.find(&e);
+            if (it != m_local_constants.end())
+                return it->second.to_obj_arg();
         }
         if (object * const * o = g_init_globals->find(fn)) {
             // persistent, so no `inc` needed
@@ -797,7 +1680,6 @@ private:
             // We don't know whether `[init]` decls can be re-executed, so let's not.
             throw exception(sstream() << "cannot evaluate `[init]` declaration '" << fn << "' in the same module");
         }
-        symbol_cache_entry e = lookup_symbol(fn);
         if (e.m_addr) {
             // constants do not have boxed wrappers, but we'll survive
             switch (t) {
@@ -813,37 +1695,107 @@ private:
                     return *static_cast<object **>(e.m_addr);
             }
         } else {
-            push_frame(e.m_decl, m_arg_stack.size());
-            value r = eval_body(decl_fun_body(e.m_decl));
-            pop_frame(r, decl_type(e.m_decl));
-            if (!type_is_scalar(t)) {
-                inc(r.m_obj);
-            }
-            m_constant_cache.insert(fn, constant_cache_entry { type_is_scalar(t), r });
+            profile_scope prof(*this, e);
+            code & c = get_code(e);
+            size_t bp = m_arg_stack.size();
+            m_arg_stack.emplace_back();
+            enter(c, bp);
+            value r = run(c);
+            pop_frame(r, c.m_ret_type);
+            cache_constant(e, r, type_is_scalar(t));
             return r;
         }
+        lean_unreachable();
+    }
+
+    /** \brief Return true iff the object graph `o` contains a closure pointing at an interpreter stub. */
+    bool has_stub_closure(object * o) {
+        std::unordered_set<object *> visited;
+        std::vector<object *> todo;
+        auto push = [&](object * c) {
+            // objects of compacted regions (`m_rc == 0`) do not contain closures
+            if (c && !is_scalar(c) && c->m_rc != 0 && visited.insert(c).second)
+                todo.push_back(c);
+        };
+        push(o);
+        while (!todo.empty()) {
+            o = todo.back();
+            todo.pop_back();
+            switch (lean_ptr_tag(o)) {
+            case LeanClosure:
+                for (unsigned i = 0; i <= 16; i++) {
+                    if (lean_closure_fun(o) == get_stub(i + 1))
+                        return true;
+                }
+                for (unsigned i = 0; i < lean_closure_num_fixed(o); i++)
+                    push(closure_get(o, i));
+                break;
+            case LeanArray:
+                for (size_t i = 0; i < array_size(o); i++)
+                    push(array_get(o, i));
+                break;
+            case LeanThunk:
+                push(lean_to_thunk(o)->m_value);
+                push(lean_to_thunk(o)->m_closure);
+                break;
+            case LeanTask: case LeanRef:
+                // may refer to interpreter closures later
+                return true;
+            case LeanScalarArray: case LeanString: case LeanMPZ: case LeanExternal:
+                break;
+            default:
+                for (unsigned i = 0; i < lean_ctor_num_objs(o); i++)
+                    push(cnstr_get(o, i));
+                break;
+            }
+        }
+        return false;
     }
 
-    value call(name const & fn, array_ref<arg> const & args) {
+    /** \brief Store the value `r` of the nullary function of `e`, unless another thread was faster. The values of
+        shared entries that contain interpreter closures are only stored for this interpreter. */
+    void cache_constant(symbol_cache_entry & e, value r, bool is_scalar) {
+        if (!is_scalar && e.m_shared) {
+            if (e.m_const_state.load() == 3 || has_stub_closure(r.m_obj)) {
+                uint8 expected = 0;
+                e.m_const_state.compare_exchange_strong(expected, 3);
+                m_local_constants.emplace(&e, object_ref(r.m_obj, true));
+                return;
+            }
+        }
+        if (!is_scalar) {
+            if (e.m_shared)
+                mark_mt(r.m_obj);
+            // reference owned by the cache
+            inc(r.m_obj);
+        }
+        uint8 expected = 0;
+        if (e.m_const_state.compare_exchange_strong(expected, 1)) {
+            e.m_const_is_scalar = is_scalar;
+            e.m_const_val       = r;
+            e.m_const_state.store(2, std::memory_order_release);
+        } else if (!is_scalar) {
+            dec(r.m_obj);
+        }
+    }
+
+    /** \brief Call `e` with the arguments stored in the slots `args` of the current frame. */
+    value call(symbol_cache_entry & e, unsigned n, unsigned const * args) {
+        profile_scope prof(*this, e);
         size_t old_size = m_arg_stack.size();
+        size_t bp = get_frame().m_arg_bp;
         value r;
-        symbol_cache_entry e = lookup_symbol(fn);
         if (e.m_addr) {
-            object ** args2 = static_cast<object **>(LEAN_ALLOCA(args.size() * sizeof(object *))); // NOLINT
-            for (size_t i = 0; i < args.size(); i++) {
-                type t = param_type(decl_params(e.m_decl)[i]);
-                args2[i] = box_t(eval_arg(args[i]), t);
-                if (e.m_boxed && param_borrow(decl_params(e.m_decl)[i])) {
-                    // NOTE: If we chose the boxed version where the IR chose the unboxed one, we need to manually increment
-                    // originally borrowed parameters because the wrapper will decrement these after the call.
-                    // Basically the wrapper is more homogeneous (removing both unboxed and borrowed parameters) than we
-                    // would need in this instance.
+            object ** args2 = static_cast<object **>(LEAN_ALLOCA(n * sizeof(object *))); // NOLINT
+            for (unsigned i = 0; i < n; i++) {
+                args2[i] = box_t(m_arg_stack[bp + args[i]], e.m_param_types[i]);
+                if (e.m_inc_args[i]) {
                     inc(args2[i]);
                 }
             }
-            push_frame(e.m_decl, old_size);
-            object * o = curry(e.m_addr, args.size(), args2);
-            type t = decl_type(e.m_decl);
+            push_frame(e.m_fn, e.m_param_types, old_size);
+            object * o = curry(e.m_addr, n, args2);
+            type t = e.m_ret_type;
             if (type_is_scalar(t)) {
                 lean_assert(e.m_boxed);
                 // NOTE: this unboxing does not exist in the IR, so we should manually consume `o`
@@ -854,31 +1806,38 @@ private:
             }
         } else {
             if (decl_tag(e.m_decl) == decl_kind::Extern) {
-                string_ref mangled = name_mangle(fn, *g_mangle_prefix);
+                string_ref mangled = name_mangle(e.m_fn, *g_mangle_prefix);
                 string_ref boxed_mangled(string_append(mangled.to_obj_arg(), g_boxed_mangled_suffix->raw()));
-                throw exception(sstream() << "could not find native implementation of external declaration '" << fn
+                throw exception(sstream() << "could not find native implementation of external declaration '" << e.m_fn
                                           << "' (symbols '" << boxed_mangled.data() << "' or '" << mangled.data() << "')");
             }
+            code & c = get_code(e);
             // evaluate args in old stack frame
-            for (const auto & arg : args) {
-                m_arg_stack.push_back(eval_arg(arg));
+            m_arg_stack.emplace_back();
+            for (unsigned i = 0; i < n; i++) {
+                value v = m_arg_stack[bp + args[i]];
+                m_arg_stack.push_back(v);
             }
-            push_frame(e.m_decl, old_size);
-            r = eval_body(decl_fun_body(e.m_decl));
+            enter(c, old_size);
+            r = run(c);
         }
-        pop_frame(r, decl_type(e.m_decl));
+        pop_frame(r, e.m_ret_type);
         return r;
     }
 
     // closure stub
     object * stub_m(object ** args) {
         decl d(args[2]);
+        symbol_cache_entry & e = lookup_symbol(decl_fun_id(d));
+        profile_scope prof(*this, e);
+        code & c = get_code(e);
         size_t old_size = m_arg_stack.size();
-        for (size_t i = 0; i < decl_params(d).size(); i++) {
+        m_arg_stack.emplace_back();
+        for (size_t i = 0; i < c.m_param_types.size(); i++) {
             m_arg_stack.push_back(args[3 + i]);
         }
-        push_frame(d, old_size);
-        object * r = eval_body(decl_fun_body(d)).m_obj;
+        enter(c, old_size);
+        object * r = run(c).m_obj;
         pop_frame(r, type::TObject);
         return r;
     }
@@ -935,14 +1894,9 @@ private:
 public:
     explicit interpreter(environment const & env, options const & opts) : m_env(env), m_opts(opts) {
         m_prefer_native = opts.get_bool(*g_interpreter_prefer_native, LEAN_DEFAULT_INTERPRETER_PREFER_NATIVE);
-    }
-
-    ~interpreter() {
-        for_each(m_constant_cache, [](name const &, constant_cache_entry const & e) {
-            if (!e.m_is_scalar) {
-                dec(e.m_val.m_obj);
-            }
-        });
+        m_shared        = get_shared_decl_cache(env, m_prefer_native);
+        if (get_profiler(opts))
+            m_profile.reset(new interpreter_profile());
     }
 
     /** A variant of `call` designed for external uses.
@@ -950,11 +1904,11 @@ public:
      *  * supports under- and over-application.
      *  * supports "calling" (evaluating) nullary constants. */
     object * call_boxed(name const & fn, unsigned n, object ** args) {
-        symbol_cache_entry e = lookup_symbol(fn);
-        unsigned arity = decl_params(e.m_decl).size();
+        symbol_cache_entry & e = lookup_symbol(fn);
+        unsigned arity = e.m_param_types.size();
         object * r;
         if (arity == 0) {
-            r = box_t(load(fn, decl_type(e.m_decl)), decl_type(e.m_decl));
+            r = box_t(load(e, e.m_ret_type), e.m_ret_type);
         } else {
             // First allocate a closure with zero fixed parameters. This is slightly wasteful in the under-application
             // case, but simpler to handle.
@@ -1024,7 +1978,7 @@ public:
                 object * o = io_result_get_value(r);
                 mark_persistent(o);
                 dec_ref(r);
-                symbol_cache_entry e = lookup_symbol(decl);
+                symbol_cache_entry const & e = lookup_symbol(decl);
                 if (e.m_addr) {
                     *((object **)e.m_addr) = o;
                 } else {
@@ -1068,6 +2022,10 @@ extern "C" LEAN_EXPORT object * lean_eval_const(object * env, object * opts, obj
 /* mkModuleInitializationFunctionName (moduleName : Name) : String */
 extern "C" obj_res lean_mk_module_initialization_function_name(obj_arg);
 
+extern "C" LEAN_EXPORT object * lean_ir_interpreter_shared_cache_hits(object *) {
+    return lean_io_result_mk_ok(lean_uint64_to_nat(g_shared_decl_cache_hits.load()));
+}
+
 extern "C" LEAN_EXPORT object * lean_run_mod_init(object * mod, object *) {
     string_ref mangled = string_ref(lean_mk_module_initialization_function_name(mod));
     if (void * init = lookup_symbol_in_cur_exe(mangled.data())) {
@@ -1101,7 +2059,15 @@ void initialize_ir_interpreter() {
     mark_persistent(ir::g_boxed_mangled_suffix->raw());
     ir::g_interpreter_prefer_native = new name({"interpreter", "prefer_native"});
     ir::g_init_globals = new name_map<object *>();
+    ir::g_c_backend = new name("c");
+    mark_persistent(ir::g_c_backend->raw());
+    ir::initialize_prims();
+    ir::g_shared_decl_caches_mutex = new mutex();
+    ir::g_shared_decl_caches = new std::vector<std::shared_ptr<ir::shared_decl_cache>>();
+    ir::g_cumulative_profile = new ir::cumulative_interpreter_profile();
+    add_cumulative_profile_fn(ir::display_interpreter_profile);
     register_bool_option(*ir::g_interpreter_prefer_native, LEAN_DEFAULT_INTERPRETER_PREFER_NATIVE, "(interpreter) whether to use precompiled code where available");
+    set_heapprof_frames_fn(ir::interpreter::get_heapprof_frames);
     DEBUG_CODE({
         register_trace_class({"interpreter"});
         register_trace_class({"interpreter", "call"});
@@ -1110,7 +2076,12 @@ void initialize_ir_interpreter() {
 }
 
 void finalize_ir_interpreter() {
+    delete ir::g_cumulative_profile;
+    delete ir::g_shared_decl_caches;
+    delete ir::g_shared_decl_caches_mutex;
     delete ir::g_init_globals;
+    delete ir::g_prims;
+    delete ir::g_c_backend;
     delete ir::g_interpreter_prefer_native;
     delete ir::g_boxed_mangled_suffix;
     delete ir::g_boxed_suffix;
@@ -5,6 +5,7 @@ Released under Apache 2.0 license as described in the file LICENSE.
 Authors: Leonardo de Moura, Gabriel Ebner, Sebastian Ullrich
 */
 #include <unordered_map>
+#include <map>
 #include <vector>
 #include <utility>
 #include <string>
@@ -19,8 +20,10 @@ Authors: Leonardo de Moura, Gabriel Ebner, Sebastian Ullrich
 #include "runtime/io.h"
 #include "runtime/compact.h"
 #include "runtime/buffer.h"
+#include "runtime/flet.h"
 #include "util/io.h"
 #include "util/name_map.h"
+#include "util/option_declarations.h"
 #include "library/module.h"
 #include "library/constants.h"
 #include "library/time_task.h"
@@ -40,9 +43,215 @@ Authors: Leonardo de Moura, Gabriel Ebner, Sebastian Ullrich
 #endif
 #endif
 
+#ifdef LEAN_USE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifndef LEAN_DEFAULT_OLEAN_COMPRESS
+#define LEAN_DEFAULT_OLEAN_COMPRESS false
+#endif
+
 namespace lean {
 // manually padded to multiple of word size, see `initialize_module`
 static char const * g_olean_header   = "oleanfile!!!!!!!";
+/* Compressed `.olean` files start with this header (of the same size) and the base address, followed by an
+   `olean_compressed_info`, one `olean_chunk_info` per chunk, and the chunks. Each chunk is a part of the compacted
+   region of size `m_chunk_size` (except for the last one) compressed independently with zlib, and is stored
+   uncompressed if compression does not make it smaller. `lean -o` produces compressed files when the option
+   `olean.compress` is set. Reading and writing them requires Lean to be built with zlib (CMake option `USE_ZLIB`). */
+static char const * g_olean_compressed_header = "oleanzip!!!!!!!!";
+#define LEAN_OLEAN_COMPRESSED_VERSION        2
+#define LEAN_OLEAN_COMPRESSED_CHUNK_SIZE     (1u << 20)
+#define LEAN_OLEAN_COMPRESSED_MAX_CHUNK_SIZE (1u << 30)
+
+static name * g_olean_compress = nullptr;
+/* Set by `write_module` for `lean_save_module_data` */
+LEAN_THREAD_VALUE(bool, g_compress_olean, false);
+
+struct olean_compressed_info {
+    uint32 m_version;
+    uint32 m_chunk_size;
+    uint64 m_data_size;  // size of the uncompressed compacted region
+};
+
+struct olean_chunk_info {
+    uint32 m_size;       // size of the chunk in the file
+    uint32 m_checksum;   // `chunk_checksum` of the uncompressed chunk
+};
+
+static uint32 chunk_checksum(char const * data, size_t sz) {
+    return hash_str(sz, reinterpret_cast<unsigned char const *>(data), 11);
+}
+
+/* Base addresses of `.olean` files are derived from the module name and lie in the following window. On
+   64-bit POSIX systems, we reserve the whole window on the first import so that no other mapping
+   (heap, shared libraries, ...) can occupy the preferred address of a module. */
+#define LEAN_OLEAN_WINDOW_BEGIN (1ULL<<45)
+#define LEAN_OLEAN_WINDOW_SIZE  (1ULL<<45)
+
+#ifndef LEAN_WINDOWS
+class olean_window {
+    mutex                    m_mutex;
+    char *                   m_begin{nullptr}; // `nullptr` if the window could not be reserved
+    char *                   m_end{nullptr};
+    std::map<char *, char *> m_mapped; // end address of mapped ranges, indexed by start address
+
+    static size_t page_align(size_t sz) {
+        size_t page_size = sysconf(_SC_PAGESIZE);
+        return (sz + page_size - 1) & ~(page_size - 1);
+    }
+
+    static bool reserve(char * addr, size_t sz, bool fixed) {
+        void * r = mmap(addr, sz, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | (fixed ? MAP_FIXED : 0), -1, 0);
+        if (r == MAP_FAILED)
+            return false;
+        if (r != addr) {
+            munmap(r, sz);
+            return false;
+        }
+        return true;
+    }
+
+    bool overlaps_mapped(char * begin, char * end) const {
+        auto it = m_mapped.lower_bound(end);
+        return it != m_mapped.begin() && std::prev(it)->second > begin;
+    }
+
+public:
+    olean_window() {
+        if (sizeof(void *) < 8 || std::getenv("LEAN_NO_OLEAN_WINDOW"))
+            return;
+        char * begin = reinterpret_cast<char *>(static_cast<size_t>(LEAN_OLEAN_WINDOW_BEGIN));
+        if (reserve(begin, LEAN_OLEAN_WINDOW_SIZE, false)) {
+            m_begin = begin;
+            m_end   = begin + LEAN_OLEAN_WINDOW_SIZE;
+        }
+    }
+
+    /* Map the first `sz` bytes of `fd` at `addr`, or fresh writable memory if `fd` is -1.
+       Return `MAP_FAILED` if it is not possible. */
+    char * map(char * addr, size_t sz, int fd) {
+        int prot  = fd == -1 ? PROT_READ | PROT_WRITE : PROT_READ;
+        int flags = fd == -1 ? MAP_PRIVATE | MAP_ANONYMOUS : MAP_PRIVATE;
+        unique_lock<mutex> lock(m_mutex);
+        char * end = addr + page_align(sz);
+        if (m_begin <= addr && end <= m_end) {
+            if (overlaps_mapped(addr, end))
+                return static_cast<char *>(MAP_FAILED);
+            void * r = mmap(addr, sz, prot, flags | MAP_FIXED, fd, 0);
+            if (r != MAP_FAILED)
+                m_mapped[addr] = end;
+            return static_cast<char *>(r);
+        }
+        lock.unlock();
+        /* The preferred address is outside the window, e.g. because the file was created by an older version */
+        return static_cast<char *>(mmap(addr, sz, prot, flags, fd, 0));
+    }
+
+    void unmap(char * addr, size_t sz) {
+        lock_guard<mutex> lock(m_mutex);
+        auto it = m_mapped.find(addr);
+        if (it != m_mapped.end()) {
+            /* return the range to the reservation */
+            lean_always_assert(reserve(addr, it->second - addr, true));
+            m_mapped.erase(it);
+        } else {
+            lean_always_assert(munmap(addr, sz) == 0);
+        }
+    }
+};
+
+static olean_window & get_olean_window() {
+    static olean_window * g_window = new olean_window(); // never freed, regions may outlive static destructors
+    return *g_window;
+}
+#endif
+
+/* Writes the compacted region of a module directly to the `.olean` file, after the header. */
+class olean_file_sink : public compactor_sink {
+    std::fstream &  m_out;
+    std::streamoff  m_header_size;
+    std::streamoff  m_size{0};
+    void check() {
+        if (!m_out)
+            throw exception("I/O error");
+    }
+public:
+    olean_file_sink(std::fstream & out, std::streamoff header_size):m_out(out), m_header_size(header_size) {}
+    void write(void const * data, size_t sz) override {
+        m_out.seekp(m_header_size + m_size);
+        m_out.write(static_cast<char const *>(data), sz);
+        m_size += sz;
+        check();
+    }
+    void read(size_t offset, void * data, size_t sz) override {
+        m_out.seekg(m_header_size + offset);
+        m_out.read(static_cast<char *>(data), sz);
+        check();
+    }
+    void write_at(size_t offset, void const * data, size_t sz) override {
+        m_out.seekp(m_header_size + offset);
+        m_out.write(static_cast<char const *>(data), sz);
+        check();
+    }
+};
+
+#ifndef LEAN_USE_ZLIB
+static void compress_olean(std::string const &, std::string const &) {
+    throw exception("compressed .olean files are not supported, Lean was built without zlib");
+}
+#else
+/* Write a compressed version of the `.olean` file `in_fn` to `out_fn`. */
+static void compress_olean(std::string const & in_fn, std::string const & out_fn) {
+    std::ifstream in(in_fn, std::ios_base::binary);
+    std::ofstream out(out_fn, std::ios_base::binary);
+    if (in.fail() || out.fail())
+        throw exception("I/O error");
+    in.seekg(0, in.end);
+    size_t size = in.tellg();
+    size_t base_addr;
+    size_t header_size = strlen(g_olean_header) + sizeof(base_addr);
+    in.seekg(strlen(g_olean_header));
+    in.read(reinterpret_cast<char *>(&base_addr), sizeof(base_addr));
+    olean_compressed_info info;
+    info.m_version    = LEAN_OLEAN_COMPRESSED_VERSION;
+    info.m_chunk_size = LEAN_OLEAN_COMPRESSED_CHUNK_SIZE;
+    info.m_data_size  = size - header_size;
+    size_t num_chunks = (info.m_data_size + info.m_chunk_size - 1) / info.m_chunk_size;
+    std::vector<olean_chunk_info> chunks(num_chunks);
+    out.write(g_olean_compressed_header, strlen(g_olean_compressed_header));
+    out.write(reinterpret_cast<char *>(&base_addr), sizeof(base_addr));
+    out.write(reinterpret_cast<char *>(&info), sizeof(info));
+    std::streamoff chunks_pos = out.tellp();
+    // the chunk table is written again below, once the sizes are known
+    out.write(reinterpret_cast<char *>(chunks.data()), num_chunks * sizeof(olean_chunk_info));
+    std::vector<char> raw(info.m_chunk_size);
+    std::vector<char> compressed(compressBound(info.m_chunk_size));
+    for (size_t i = 0; i < num_chunks; i++) {
+        size_t sz = std::min(static_cast<size_t>(info.m_chunk_size), static_cast<size_t>(info.m_data_size - i * info.m_chunk_size));
+        in.read(raw.data(), sz);
+        if (!in)
+            throw exception("I/O error");
+        chunks[i].m_checksum = chunk_checksum(raw.data(), sz);
+        uLongf csz = compressed.size();
+        if (compress2(reinterpret_cast<Bytef *>(compressed.data()), &csz, reinterpret_cast<Bytef const *>(raw.data()), sz,
+                      Z_DEFAULT_COMPRESSION) != Z_OK)
+            throw exception("compression failed");
+        if (csz < sz) {
+            out.write(compressed.data(), csz);
+            chunks[i].m_size = csz;
+        } else {
+            out.write(raw.data(), sz);
+            chunks[i].m_size = sz;
+        }
+    }
+    out.seekp(chunks_pos);
+    out.write(reinterpret_cast<char *>(chunks.data()), num_chunks * sizeof(olean_chunk_info));
+    out.close();
+    if (out.fail())
+        throw exception("I/O error");
+}
+#endif
 
 extern "C" LEAN_EXPORT object * lean_save_module_data(b_obj_arg fname, b_obj_arg mod, b_obj_arg mdata, object *) {
     std::string olean_fn(string_cstr(fname));
@@ -50,7 +259,8 @@ extern "C" LEAN_EXPORT object * lean_save_module_data(b_obj_arg fname, b_obj_arg
     // so that we neither expose partially-written files nor modify possibly memory-mapped files
     std::string olean_tmp_fn = olean_fn + ".tmp";
     try {
-        std::ofstream out(olean_tmp_fn, std::ios_base::binary);
+        // the compacted region is streamed to the file, `olean_file_sink` reads parts of it back for maximal sharing
+        std::fstream out(olean_tmp_fn, std::ios_base::in | std::ios_base::out | std::ios_base::trunc | std::ios_base::binary);
         if (out.fail()) {
             return io_result_mk_error((sstream() << "failed to create file '" << olean_fn << "'").str());
         }
@@ -63,20 +273,30 @@ extern "C" LEAN_EXPORT object * lean_save_module_data(b_obj_arg fname, b_obj_arg
         // Let's start with a hash of the module name. Note that while our string hash is a dubious 32-bit
         // algorithm, the mixing of multiple `Name` parts seems to result in a nicely distributed 64-bit
         // output
-        size_t base_addr = name(mod, true).hash();
-        // x86-64 user space is currently limited to the lower 47 bits
+        uint64_t hash = name(mod, true).hash();
+        // x86-64 user space is currently limited to the lower 47 bits, our window is in the middle of it
         // https://en.wikipedia.org/wiki/X86-64#Virtual_address_space_details
-        base_addr = base_addr & ((1LL<<47) - 1);
+        size_t base_addr = static_cast<size_t>(LEAN_OLEAN_WINDOW_BEGIN + (hash & (LEAN_OLEAN_WINDOW_SIZE - 1)));
         // `mmap` addresses must be page-aligned. The default (non-huge) page size on x86-64 is 4KB.
         // `MapViewOfFileEx` addresses must be aligned to the "memory allocation granularity", which is 64KB.
         base_addr = base_addr & ~((1LL<<16) - 1);
 
-        object_compactor compactor(reinterpret_cast<void *>(base_addr + strlen(g_olean_header) + sizeof(base_addr)));
-        compactor(mdata);
+        size_t header_size = strlen(g_olean_header) + sizeof(base_addr);
         out.write(g_olean_header, strlen(g_olean_header));
         out.write(reinterpret_cast<char *>(&base_addr), sizeof(base_addr));
-        out.write(static_cast<char const *>(compactor.data()), compactor.size());
+        olean_file_sink sink(out, header_size);
+        object_compactor compactor(reinterpret_cast<void *>(base_addr + header_size), &sink);
+        compactor(mdata);
         out.close();
+        if (out.fail()) {
+            return io_result_mk_error((sstream() << "failed to write '" << olean_fn << "'").str());
+        }
+        if (g_compress_olean) {
+            std::string olean_ztmp_fn = olean_fn + ".ztmp";
+            compress_olean(olean_tmp_fn, olean_ztmp_fn);
+            std::remove(olean_tmp_fn.c_str());
+            olean_tmp_fn = olean_ztmp_fn;
+        }
         while (std::rename(olean_tmp_fn.c_str(), olean_fn.c_str()) != 0) {
 #ifdef LEAN_WINDOWS
             if (errno == EEXIST) {
@@ -103,6 +323,84 @@ extern "C" LEAN_EXPORT object * lean_save_module_data(b_obj_arg fname, b_obj_arg
     }
 }
 
+/* Decompress the compacted region of a compressed `.olean` file whose header has already been read.
+   The region is decompressed to its base address if possible so that it does not need to be relocated.
+
+   All chunks are decompressed eagerly when the module is imported. Objects of the region are accessed directly by
+   pointer, so decompressing a chunk on first access would require trapping page faults (via `userfaultfd` or a
+   `SIGSEGV` handler, which would conflict with the stack overflow detection in `runtime/stack_overflow.cpp`). The cost
+   is that importing a compressed module takes the decompression time of the whole file, and its data lives in
+   private anonymous memory rather than in the page cache shared by all processes mapping the same uncompressed
+   file. Compressed files thus mainly reduce disk usage and transfer sizes. */
+#ifndef LEAN_USE_ZLIB
+static compacted_region * read_compressed_olean(std::ifstream &, size_t, char *, size_t) {
+    throw exception("compressed .olean files are not supported, Lean was built without zlib");
+}
+#else
+static compacted_region * read_compressed_olean(std::ifstream & in, size_t size, char * base_addr, size_t header_size) {
+    olean_compressed_info info;
+    in.read(reinterpret_cast<char *>(&info), sizeof(info));
+    if (!in)
+        throw exception("invalid header");
+    if (info.m_version != LEAN_OLEAN_COMPRESSED_VERSION)
+        throw exception(sstream() << "unsupported compressed format version " << info.m_version);
+    if (info.m_chunk_size == 0 || info.m_chunk_size > LEAN_OLEAN_COMPRESSED_MAX_CHUNK_SIZE)
+        throw exception("invalid header");
+    size_t data_size  = info.m_data_size;
+    size_t num_chunks = (data_size + info.m_chunk_size - 1) / info.m_chunk_size;
+    if (data_size == 0 || num_chunks > size / sizeof(olean_chunk_info))
+        throw exception("invalid header");
+    std::vector<olean_chunk_info> chunks(num_chunks);
+    in.read(reinterpret_cast<char *>(chunks.data()), num_chunks * sizeof(olean_chunk_info));
+    if (!in)
+        throw exception("invalid header");
+
+    char * buffer = nullptr;
+    bool is_mmap  = false;
+    std::function<void()> free_data;
+#ifndef LEAN_WINDOWS
+    size_t map_size = header_size + data_size;
+    char * mem      = get_olean_window().map(base_addr, map_size, -1);
+    if (mem == base_addr) {
+        buffer    = mem + header_size;
+        is_mmap   = true;
+        free_data = [=]() { get_olean_window().unmap(mem, map_size); };
+    } else if (mem != MAP_FAILED) {
+        get_olean_window().unmap(mem, map_size);
+    }
+#endif
+    if (!buffer) {
+        buffer    = static_cast<char *>(malloc(data_size));
+        free_data = [=]() { free(buffer); };
+    }
+    std::vector<char> compressed;
+    for (size_t i = 0; i < num_chunks; i++) {
+        size_t sz   = std::min(static_cast<size_t>(info.m_chunk_size), data_size - i * info.m_chunk_size);
+        char * dest = buffer + i * info.m_chunk_size;
+        bool ok;
+        if (chunks[i].m_size == sz) {
+            in.read(dest, sz);
+            ok = static_cast<bool>(in);
+        } else {
+            compressed.resize(chunks[i].m_size);
+            in.read(compressed.data(), chunks[i].m_size);
+            uLongf dsz = sz;
+            ok = in && uncompress(reinterpret_cast<Bytef *>(dest), &dsz, reinterpret_cast<Bytef const *>(compressed.data()),
+                                  chunks[i].m_size) == Z_OK && dsz == sz;
+        }
+        if (!ok || chunk_checksum(dest, sz) != chunks[i].m_checksum) {
+            free_data();
+            throw exception(sstream() << "corrupted chunk " << i);
+        }
+    }
+#ifndef LEAN_WINDOWS
+    if (is_mmap)
+        lean_always_assert(mprotect(base_addr, map_size, PROT_READ) == 0);
+#endif
+    return new compacted_region(data_size, buffer, base_addr + header_size, is_mmap, free_data);
+}
+#endif
+
 extern "C" LEAN_EXPORT object * lean_read_module_data(object * fname, object *) {
     std::string olean_fn(string_cstr(fname));
     try {
@@ -120,64 +418,69 @@ extern "C" LEAN_EXPORT object * lean_read_module_data(object * fname, object *)
         }
         char * header = new char[header_size];
         in.read(header, header_size);
-        if (strncmp(header, g_olean_header, header_size) != 0) {
+        bool compressed = strncmp(header, g_olean_compressed_header, header_size) == 0;
+        if (!compressed && strncmp(header, g_olean_header, header_size) != 0) {
             return io_result_mk_error((sstream() << "failed to read file '" << olean_fn << "', invalid header").str());
         }
         delete[] header;
         char * base_addr;
         in.read(reinterpret_cast<char *>(&base_addr), sizeof(base_addr));
         header_size += sizeof(base_addr);
-        char * buffer = nullptr;
-        bool is_mmap = false;
-        std::function<void()> free_data;
+        compacted_region * region;
+        if (compressed) {
+            region = read_compressed_olean(in, size, base_addr, header_size);
+        } else {
+            char * buffer = nullptr;
+            bool is_mmap = false;
+            std::function<void()> free_data;
 #ifdef LEAN_WINDOWS
-        // `FILE_SHARE_DELETE` is necessary to allow the file to (be marked to) be deleted while in use
-        HANDLE h_olean_fn = CreateFile(olean_fn.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
-        if (h_olean_fn == INVALID_HANDLE_VALUE) {
-            return io_result_mk_error((sstream() << "failed to open '" << olean_fn << "': " << GetLastError()).str());
-        }
-        HANDLE h_map = CreateFileMapping(h_olean_fn, NULL, PAGE_READONLY, 0, 0, NULL);
-        if (h_olean_fn == NULL) {
-            return io_result_mk_error((sstream() << "failed to map '" << olean_fn << "': " << GetLastError()).str());
-        }
-        buffer = static_cast<char *>(MapViewOfFileEx(h_map, FILE_MAP_READ, 0, 0, 0, base_addr));
-        free_data = [=]() {
-            if (buffer) {
-                lean_always_assert(UnmapViewOfFile(base_addr));
+            // `FILE_SHARE_DELETE` is necessary to allow the file to (be marked to) be deleted while in use
+            HANDLE h_olean_fn = CreateFile(olean_fn.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+            if (h_olean_fn == INVALID_HANDLE_VALUE) {
+                return io_result_mk_error((sstream() << "failed to open '" << olean_fn << "': " << GetLastError()).str());
+            }
+            HANDLE h_map = CreateFileMapping(h_olean_fn, NULL, PAGE_READONLY, 0, 0, NULL);
+            if (h_olean_fn == NULL) {
+                return io_result_mk_error((sstream() << "failed to map '" << olean_fn << "': " << GetLastError()).str());
             }
-            lean_always_assert(CloseHandle(h_map));
-            lean_always_assert(CloseHandle(h_olean_fn));
-        };
+            buffer = static_cast<char *>(MapViewOfFileEx(h_map, FILE_MAP_READ, 0, 0, 0, base_addr));
+            free_data = [=]() {
+                if (buffer) {
+                    lean_always_assert(UnmapViewOfFile(base_addr));
+                }
+                lean_always_assert(CloseHandle(h_map));
+                lean_always_assert(CloseHandle(h_olean_fn));
+            };
 #else
-        int fd = open(olean_fn.c_str(), O_RDONLY);
-        if (fd == -1) {
-            return io_result_mk_error((sstream() << "failed to open '" << olean_fn << "': " << strerror(errno)).str());
-        }
-        buffer = static_cast<char *>(mmap(base_addr, size, PROT_READ, MAP_PRIVATE, fd, 0));
-        close(fd);
-        free_data = [=]() {
-            if (buffer != MAP_FAILED) {
-                lean_always_assert(munmap(buffer, size) == 0);
+            int fd = open(olean_fn.c_str(), O_RDONLY);
+            if (fd == -1) {
+                return io_result_mk_error((sstream() << "failed to open '" << olean_fn << "': " << strerror(errno)).str());
             }
-        };
-#endif
-        if (buffer == base_addr) {
-            buffer += header_size;
-            is_mmap = true;
-        } else {
-            free_data();
-            buffer = static_cast<char *>(malloc(size - header_size));
+            buffer = get_olean_window().map(base_addr, size, fd);
+            close(fd);
             free_data = [=]() {
-                free(buffer);
+                if (buffer != MAP_FAILED) {
+                    get_olean_window().unmap(buffer, size);
+                }
             };
-            in.read(buffer, size - header_size);
-            if (!in) {
-                return io_result_mk_error((sstream() << "failed to read file '" << olean_fn << "'").str());
+#endif
+            if (buffer == base_addr) {
+                buffer += header_size;
+                is_mmap = true;
+            } else {
+                free_data();
+                buffer = static_cast<char *>(malloc(size - header_size));
+                free_data = [=]() {
+                    free(buffer);
+                };
+                in.read(buffer, size - header_size);
+                if (!in) {
+                    return io_result_mk_error((sstream() << "failed to read file '" << olean_fn << "'").str());
+                }
             }
+            region = new compacted_region(size - header_size, buffer, base_addr + header_size, is_mmap, free_data);
         }
         in.close();
-
-        compacted_region * region = new compacted_region(size - header_size, buffer, base_addr + header_size, is_mmap, free_data);
 #if defined(__has_feature)
 #if __has_feature(address_sanitizer)
         // do not report as leak
@@ -199,7 +502,19 @@ extern "C" LEAN_EXPORT object * lean_read_module_data(object * fname, object *)
 def writeModule (env : Environment) (fname : String) : IO Unit := */
 extern "C" object * lean_write_module(object * env, object * fname, object *);
 
-void write_module(environment const & env, std::string const & olean_fn) {
+void write_module(environment const & env, std::string const & olean_fn, options const & opts) {
+    flet<bool> compress(g_compress_olean, opts.get_bool(*g_olean_compress, LEAN_DEFAULT_OLEAN_COMPRESS));
     consume_io_result(lean_write_module(env.to_obj_arg(), mk_string(olean_fn), io_mk_world()));
 }
+
+void initialize_module() {
+    g_olean_compress = new name{"olean", "compress"};
+    mark_persistent(g_olean_compress->raw());
+    register_bool_option(*g_olean_compress, LEAN_DEFAULT_OLEAN_COMPRESS,
+                         "(olean) compress the .olean file written by `lean -o` (requires Lean to be built with zlib)");
+}
+
+void finalize_module() {
+    delete g_olean_compress;
+}
 }
@@ -10,9 +10,13 @@ Authors: Leonardo de Moura, Gabriel Ebner, Sebastian Ullrich
 #include <utility>
 #include <vector>
 #include "runtime/optional.h"
+#include "util/options.h"
 #include "kernel/environment.h"
 
 namespace lean {
-/** \brief Store module using \c env. */
-void write_module(environment const & env, std::string const & olean_fn);
+/** \brief Store module using \c env. The file is compressed if the option `olean.compress` is set in \c opts. */
+void write_module(environment const & env, std::string const & olean_fn, options const & opts);
+
+void initialize_module();
+void finalize_module();
 }
@@ -6,13 +6,19 @@ Author: Sebastian Ullrich
 */
 #include <string>
 #include <map>
+#include <vector>
+#include <sstream>
+#include "kernel/type_checker.h"
 #include "library/time_task.h"
 #include "library/trace.h"
 
 namespace lean {
 
 static std::map<std::string, second_duration> * g_cum_times;
+static type_checker_stats * g_cum_kernel_stats;
+static bool g_has_kernel_stats = false;
 static mutex * g_cum_times_mutex;
+static std::vector<cumulative_profile_fn> * g_cum_profile_fns;
 LEAN_THREAD_PTR(time_task, g_current_time_task);
 
 void report_profiling_time(std::string const & category, second_duration time) {
@@ -20,20 +26,34 @@ void report_profiling_time(std::string const & category, second_duration time) {
     (*g_cum_times)[category] += time;
 }
 
+void add_cumulative_profile_fn(cumulative_profile_fn fn) {
+    g_cum_profile_fns->push_back(fn);
+}
+
 void display_cumulative_profiling_times(std::ostream & out) {
     if (g_cum_times->empty())
         return;
     out << "cumulative profiling times:\n";
     for (auto const & p : *g_cum_times)
         out << "\t" << p.first << " " << display_profiling_time{p.second} << "\n";
+    if (g_has_kernel_stats) {
+        out << "cumulative kernel statistics:\n";
+        g_cum_kernel_stats->display(out, 20);
+    }
+    for (cumulative_profile_fn fn : *g_cum_profile_fns)
+        fn(out);
 }
 
 void initialize_time_task() {
     g_cum_times_mutex = new mutex;
     g_cum_times = new std::map<std::string, second_duration>;
+    g_cum_kernel_stats = new type_checker_stats();
+    g_cum_profile_fns = new std::vector<cumulative_profile_fn>();
 }
 
 void finalize_time_task() {
+    delete g_cum_profile_fns;
+    delete g_cum_kernel_stats;
     delete g_cum_times;
     delete g_cum_times_mutex;
 }
@@ -68,4 +88,28 @@ extern "C" LEAN_EXPORT obj_res lean_profileit(b_obj_arg category, b_obj_arg opts
                 TO_REF(options, opts));
     return apply_1(fn, box(0));
 }
+
+/* kernelProfileit {α : Type} (declName : @& Name) (opts : @& Options) (fn : Unit → α) : α */
+extern "C" LEAN_EXPORT obj_res lean_kernel_profileit(b_obj_arg decl_name, b_obj_arg opts, obj_arg fn) {
+    options const & o = TO_REF(options, opts);
+    if (!get_profiler(o))
+        return apply_1(fn, box(0));
+    scoped_type_checker_stats stats;
+    object * r;
+    bool slow;
+    {
+        time_task t("type checking", o, TO_REF(name, decl_name));
+        r    = apply_1(fn, box(0));
+        slow = t.get_elapsed() >= get_profiling_threshold(o);
+    }
+    if (slow) {
+        std::ostringstream out;
+        stats.get().display(out, 10);
+        tout() << out.str();
+    }
+    lock_guard<mutex> _(*g_cum_times_mutex);
+    g_cum_kernel_stats->merge(stats.get());
+    g_has_kernel_stats = true;
+    return r;
+}
 }
@@ -14,6 +14,10 @@ namespace lean {
 void report_profiling_time(std::string const & category, second_duration time);
 void display_cumulative_profiling_times(std::ostream & out);
 
+/** \brief Procedure displaying further cumulative statistics after the profiling times. */
+typedef void (*cumulative_profile_fn)(std::ostream & out);
+void add_cumulative_profile_fn(cumulative_profile_fn fn);
+
 /** Measure time of some task and report it for the final cumulative profile. */
 class time_task {
     std::string     m_category;
@@ -22,6 +26,8 @@ class time_task {
 public:
     time_task(std::string const & category, options const & opts, name decl = name());
     ~time_task();
+    /** \brief Return the time spent in this task so far, excluding nested tasks. */
+    second_duration get_elapsed() const { return m_timeit ? m_timeit->get_elapsed() : second_duration(0); }
 };
 
 void initialize_time_task();
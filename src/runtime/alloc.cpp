@@ -4,11 +4,18 @@ Released under Apache 2.0 license as described in the file LICENSE.
 
 Author: Leonardo de Moura
 */
-#include <vector>
+#include <cstdlib>
+#include <iostream>
 #include <lean/lean.h>
 #include "runtime/thread.h"
 #include "runtime/debug.h"
 #include "runtime/alloc.h"
+#include "runtime/heapprof.h"
+
+#if !defined(LEAN_WINDOWS) && !defined(LEAN_EMSCRIPTEN)
+#include <sys/mman.h>
+#define LEAN_MMAP_SEGMENTS
+#endif
 
 #ifdef LEAN_RUNTIME_STATS
 #define LEAN_RUNTIME_STAT_CODE(c) c
@@ -26,6 +33,11 @@ Author: Leonardo de Moura
 #define LEAN_SEGMENT_SIZE          8*1024*1024 // 8 Mb
 #define LEAN_NUM_SLOTS             (LEAN_MAX_SMALL_OBJECT_SIZE / LEAN_OBJECT_SIZE_DELTA)
 #define LEAN_MAX_TO_EXPORT_OBJS    1024
+#define LEAN_EXPORT_TABLE_SIZE     64          // must be a power of two
+#define LEAN_DEFAULT_MAX_RETAINED_SEGMENTS 2
+/* The current segment is only decommitted when it becomes empty if at least this many bytes of pages
+   were used, to avoid a system call for every page of a heap that repeatedly allocates and frees a few objects. */
+#define LEAN_MIN_DECOMMIT_SIZE     1024*1024 // 1 Mb
 
 LEAN_CASSERT(LEAN_PAGE_SIZE > LEAN_MAX_SMALL_OBJECT_SIZE);
 LEAN_CASSERT(LEAN_SEGMENT_SIZE > LEAN_PAGE_SIZE);
@@ -33,14 +45,20 @@ LEAN_CASSERT(LEAN_SEGMENT_SIZE > LEAN_PAGE_SIZE);
 namespace lean {
 namespace allocator {
 #ifdef LEAN_RUNTIME_STATS
-static atomic<uint64> g_num_alloc(0);
-static atomic<uint64> g_num_small_alloc(0);
-static atomic<uint64> g_num_dealloc(0);
-static atomic<uint64> g_num_small_dealloc(0);
-static atomic<uint64> g_num_segments(0);
-static atomic<uint64> g_num_pages(0);
-static atomic<uint64> g_num_exports(0);
-static atomic<uint64> g_num_recycled_pages(0);
+static atomic<uint64_t> g_num_alloc(0);
+static atomic<uint64_t> g_num_small_alloc(0);
+static atomic<uint64_t> g_num_dealloc(0);
+static atomic<uint64_t> g_num_small_dealloc(0);
+static atomic<uint64_t> g_num_segments(0);
+static atomic<uint64_t> g_num_pages(0);
+static atomic<uint64_t> g_num_exports(0);
+static atomic<uint64_t> g_num_recycled_pages(0);
+static atomic<uint64_t> g_num_reclaimed_pages(0);
+static atomic<uint64_t> g_num_reused_pages(0);
+static atomic<uint64_t> g_num_retained_segments(0);
+static atomic<uint64_t> g_num_reused_segments(0);
+static atomic<uint64_t> g_num_freed_segments(0);
+static atomic<uint64_t> g_num_decommitted_segments(0);
 struct alloc_stats {
     ~alloc_stats() {
         std::cerr << "num. alloc.:         " << g_num_alloc << "\n";
@@ -50,16 +68,28 @@ struct alloc_stats {
         std::cerr << "num. segments:       " << g_num_segments << "\n";
         std::cerr << "num. pages:          " << g_num_pages << "\n";
         std::cerr << "num. recycled pages: " << g_num_recycled_pages << "\n";
+        std::cerr << "num. reclaimed pages: " << g_num_reclaimed_pages << "\n";
+        std::cerr << "num. reused pages:   " << g_num_reused_pages << "\n";
+        std::cerr << "num. retained segs.: " << g_num_retained_segments << "\n";
+        std::cerr << "num. reused segs.:   " << g_num_reused_segments << "\n";
+        std::cerr << "num. freed segs.:    " << g_num_freed_segments << "\n";
+        std::cerr << "num. decommitted current segs.: " << g_num_decommitted_segments << "\n";
         std::cerr << "num. exports:        " << g_num_exports << "\n";
     }
 };
 static alloc_stats g_alloc_stats;
 #endif
 
+/* Maximum number of completely empty segments a heap keeps around (decommitted) for reuse
+   before returning them to the OS. It can be set using the environment variable `LEAN_RETAINED_SEGMENTS`. */
+static unsigned g_max_retained_segments = LEAN_DEFAULT_MAX_RETAINED_SEGMENTS;
+
 struct heap;
 struct page;
+struct segment;
 struct page_header {
     atomic<heap *>   m_heap;
+    segment *        m_segment;
     page *           m_next;
     page *           m_prev;
     void *           m_free_list;
@@ -68,6 +98,8 @@ struct page_header {
     unsigned         m_num_free;
     unsigned         m_slot_idx;
     bool             m_in_page_free_list;
+    /* Number of objects in this page recorded by the heap profiler that have not been freed yet */
+    atomic<unsigned> m_num_sampled;
 };
 
 struct page {
@@ -79,7 +111,9 @@ struct page {
     void set_prev(page * p) { m_header.m_prev = p; }
     void set_heap(heap * h) { m_header.m_heap = h; }
     heap * get_heap() { return m_header.m_heap; }
+    segment * get_segment() const { return m_header.m_segment; }
     bool has_many_free() const { return m_header.m_num_free > m_header.m_max_free / 4; }
+    bool is_empty() const { return m_header.m_num_free == m_header.m_max_free; }
     bool in_page_free_list() const { return m_header.m_in_page_free_list; }
     unsigned get_slot_idx() const { return m_header.m_slot_idx; }
     void push_free_obj(void * o);
@@ -91,7 +125,10 @@ inline char * align_ptr(char * p, size_t a) {
 
 struct segment {
     segment *    m_next{nullptr};
+    segment *    m_prev{nullptr};
     char *       m_next_page_mem;
+    /* Number of pages in this segment that are not in the heap's empty page list. */
+    unsigned     m_num_used_pages{0};
     char         m_data[LEAN_SEGMENT_SIZE];
 
     char * get_first_page_mem() {
@@ -104,27 +141,48 @@ struct segment {
         m_next_page_mem = get_first_page_mem();
     }
 
+    /* Return the memory of all pages to the OS, but keep the address range. */
+    void decommit() {
+        char * first = get_first_page_mem();
+#ifdef LEAN_MMAP_SEGMENTS
+        madvise(first, m_next_page_mem - first, MADV_DONTNEED);
+#endif
+        m_next_page_mem = first;
+    }
+
     bool is_full() const {
         return m_next_page_mem + LEAN_PAGE_SIZE > m_data + LEAN_SEGMENT_SIZE;
     }
 };
 
 struct heap {
+    /* Doubly linked list of segments in use, the first one is used to allocate new pages. */
     segment * m_curr_segment{nullptr};
+    /* Completely empty segments that have been decommitted, but not unmapped yet. */
+    segment * m_retained_segments{nullptr};
+    unsigned  m_num_retained_segments{0};
     heap *    m_next_orphan{nullptr};
     page *    m_curr_page[LEAN_NUM_SLOTS];
     page *    m_page_free_list[LEAN_NUM_SLOTS];
+    /* Pages without live objects. They can be reused by any slot. */
+    page *    m_empty_pages{nullptr};
     /* Objects that must be sent to other heaps. */
     void *    m_to_export_list{nullptr};
     unsigned  m_to_export_list_size{0};
-    mutex     m_mutex; /* for the following fields */
     /* The following list contains object by this heap that were deallocated
-       by other heaps. */
-    void *    m_to_import_list{nullptr};
+       by other heaps. Other heaps push whole chains of objects onto it using compare-and-swap,
+       and the owner takes the whole list at once using an atomic exchange. */
+    atomic<void *> m_to_import_list{nullptr};
     uint64_t  m_heartbeat{0}; /* Counter for implementing "deterministic timeouts". It is currently the number of small allocations */
+    /* Number of small allocations until the next one is recorded by the heap profiler */
+    uint64_t  m_heapprof_countdown{get_heapprof_interval() ? get_heapprof_interval() : UINT64_MAX};
+    uint64_t  m_heapprof_rand{88172645463325252ull};
     void import_objs();
     void export_objs();
     void alloc_segment();
+    void remove_empty_pages(segment * s);
+    void release_segment(segment * s);
+    void reclaim_page(page * p);
 };
 
 struct heap_manager {
@@ -171,30 +229,31 @@ inline void * get_next_obj(void * obj) {
 static inline void page_list_insert(page * & head, page * new_head) {
     if (head)
         head->set_prev(new_head);
+    new_head->set_prev(nullptr);
     new_head->set_next(head);
     head = new_head;
 }
 
 static inline void page_list_remove(page * & head, page * to_remove) {
-    if (head == to_remove) {
-        /* First element */
-        head = to_remove->get_next();
-    }
     page * prev = to_remove->get_prev();
-    lean_assert(prev);
-    if (page * next = to_remove->get_next()) {
+    page * next = to_remove->get_next();
+    if (prev) {
         prev->set_next(next);
-        next->set_prev(prev);
     } else {
-        /* Last element */
-        prev->set_next(nullptr);
+        /* First element */
+        lean_assert(head == to_remove);
+        head = next;
     }
+    if (next)
+        next->set_prev(prev);
 }
 
 static inline page * page_list_pop(page * & head) {
     lean_assert(head);
     page * r = head;
     head = head->get_next();
+    if (head)
+        head->set_prev(nullptr);
     return r;
 }
 
@@ -203,6 +262,14 @@ void page::push_free_obj(void * o) {
     set_next_obj(o, m_header.m_free_list);
     m_header.m_free_list = o;
     m_header.m_num_free++;
+    if (LEAN_UNLIKELY(is_empty())) {
+        heap * h = get_heap();
+        /* The current page of a slot is never reclaimed since `lean_alloc_small` assumes it exists. */
+        if (this != h->m_curr_page[m_header.m_slot_idx]) {
+            h->reclaim_page(this);
+            return;
+        }
+    }
     if (!in_page_free_list() && has_many_free()) {
         heap * h = get_heap();
         unsigned slot_idx = m_header.m_slot_idx;
@@ -216,12 +283,7 @@ void page::push_free_obj(void * o) {
 }
 
 void heap::import_objs() {
-    void * to_import = nullptr;
-    {   // TODO(Leo): avoid mutex using compare and swap
-        lock_guard<mutex> lock(m_mutex);
-        to_import = m_to_import_list;
-        m_to_import_list = nullptr;
-    }
+    void * to_import = m_to_import_list.exchange(nullptr);
     while (to_import) {
         page * p = get_page_of(to_import);
         void * n = get_next_obj(to_import);
@@ -230,59 +292,168 @@ void heap::import_objs() {
     }
 }
 
+/* Push the chain of objects `head ... tail` onto the import list of `h`. */
+static void push_to_import_list(heap * h, void * head, void * tail) {
+    void * old_head = h->m_to_import_list.load();
+    do {
+        set_next_obj(tail, old_head);
+    } while (!h->m_to_import_list.compare_exchange_strong(old_head, head));
+}
+
 struct export_entry {
     heap * m_heap;
     void * m_head;
     void * m_tail;
 };
 
+static inline unsigned export_table_idx(heap * h) {
+    return (reinterpret_cast<size_t>(h) / sizeof(heap)) & (LEAN_EXPORT_TABLE_SIZE - 1);
+}
+
 void heap::export_objs() {
-    std::vector<export_entry> to_export;
+    /* Group the objects by target heap using a small open addressing table. In the unlikely case
+       the table is full, the object is sent to its heap immediately. */
+    export_entry to_export[LEAN_EXPORT_TABLE_SIZE];
+    unsigned num_entries = 0;
+    for (export_entry & e : to_export)
+        e.m_heap = nullptr;
     void * o = m_to_export_list;
     while (o != nullptr) {
         void * n   = get_next_obj(o);
         heap * h   = get_page_of(o)->get_heap();
-        bool found = false;
-        for (export_entry & e : to_export) {
-            if (e.m_heap == h) {
-                set_next_obj(o, e.m_head);
-                e.m_head = o;
-                found = true;
-                break;
-            }
-        }
-        if (!found) {
+        unsigned i = export_table_idx(h);
+        while (to_export[i].m_heap != nullptr && to_export[i].m_heap != h)
+            i = (i + 1) & (LEAN_EXPORT_TABLE_SIZE - 1);
+        export_entry & e = to_export[i];
+        if (e.m_heap == h) {
+            set_next_obj(o, e.m_head);
+            e.m_head = o;
+        } else if (num_entries < LEAN_EXPORT_TABLE_SIZE - 1) {
             set_next_obj(o, nullptr);
-            to_export.push_back(export_entry{h, o, o});
+            e = export_entry{h, o, o};
+            num_entries++;
+        } else {
+            push_to_import_list(h, o, o);
         }
         o = n;
     }
     m_to_export_list      = nullptr;
     m_to_export_list_size = 0;
     for (export_entry const & e : to_export) {
-        unique_lock<mutex> lock(e.m_heap->m_mutex);
-        set_next_obj(e.m_tail, e.m_heap->m_to_import_list);
-        e.m_heap->m_to_import_list = e.m_head;
+        if (e.m_heap != nullptr)
+            push_to_import_list(e.m_heap, e.m_head, e.m_tail);
     }
 }
 
+static segment * new_segment() {
+#ifdef LEAN_MMAP_SEGMENTS
+    void * mem = mmap(nullptr, sizeof(segment), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) lean_internal_panic_out_of_memory();
+    return new (mem) segment();
+#else
+    return new segment();
+#endif
+}
+
+static void delete_segment(segment * s) {
+#ifdef LEAN_MMAP_SEGMENTS
+    munmap(s, sizeof(segment));
+#else
+    delete s;
+#endif
+}
+
 void heap::alloc_segment() {
-    LEAN_RUNTIME_STAT_CODE(g_num_segments++);
-    segment * s = new segment();
-    s->m_next   = m_curr_segment;
+    segment * s;
+    if (m_retained_segments) {
+        LEAN_RUNTIME_STAT_CODE(g_num_reused_segments++);
+        s = m_retained_segments;
+        m_retained_segments = s->m_next;
+        m_num_retained_segments--;
+    } else {
+        LEAN_RUNTIME_STAT_CODE(g_num_segments++);
+        s = new_segment();
+    }
+    lean_assert(s->m_num_used_pages == 0);
+    s->m_prev = nullptr;
+    s->m_next = m_curr_segment;
+    if (m_curr_segment)
+        m_curr_segment->m_prev = s;
     m_curr_segment = s;
 }
 
+/* Remove the pages of the completely empty segment `s` from the list of empty pages. */
+void heap::remove_empty_pages(segment * s) {
+    lean_assert(s->m_num_used_pages == 0);
+    for (char * m = s->get_first_page_mem(); m < s->m_next_page_mem; m += LEAN_PAGE_SIZE)
+        page_list_remove(m_empty_pages, reinterpret_cast<page*>(m));
+}
+
+/* Remove the completely empty segment `s` from the segment list, and either keep it for reuse
+   (after returning its memory to the OS) or unmap it. */
+void heap::release_segment(segment * s) {
+    lean_assert(s != m_curr_segment);
+    remove_empty_pages(s);
+    if (s->m_prev)
+        s->m_prev->m_next = s->m_next;
+    if (s->m_next)
+        s->m_next->m_prev = s->m_prev;
+    if (m_num_retained_segments < g_max_retained_segments) {
+        LEAN_RUNTIME_STAT_CODE(g_num_retained_segments++);
+        s->decommit();
+        s->m_next = m_retained_segments;
+        m_retained_segments = s;
+        m_num_retained_segments++;
+    } else {
+        LEAN_RUNTIME_STAT_CODE(g_num_freed_segments++);
+        delete_segment(s);
+    }
+}
+
+/* Move the page `p` without live objects from its slot to the list of empty pages. */
+void heap::reclaim_page(page * p) {
+    lean_assert(p->is_empty());
+    LEAN_RUNTIME_STAT_CODE(g_num_reclaimed_pages++);
+    unsigned slot_idx = p->get_slot_idx();
+    if (p->in_page_free_list())
+        page_list_remove(m_page_free_list[slot_idx], p);
+    else
+        page_list_remove(m_curr_page[slot_idx], p);
+    page_list_insert(m_empty_pages, p);
+    segment * s = p->get_segment();
+    lean_assert(s->m_num_used_pages > 0);
+    s->m_num_used_pages--;
+    if (s->m_num_used_pages == 0) {
+        if (s != m_curr_segment) {
+            release_segment(s);
+        } else if (s->m_next_page_mem - s->get_first_page_mem() >= LEAN_MIN_DECOMMIT_SIZE) {
+            /* Keep allocating pages from the current segment, but return its memory to the OS */
+            LEAN_RUNTIME_STAT_CODE(g_num_decommitted_segments++);
+            remove_empty_pages(s);
+            s->decommit();
+        }
+    }
+}
+
 static page * alloc_page(heap * h, unsigned obj_size) {
     lean_assert(lean_align(obj_size, LEAN_OBJECT_SIZE_DELTA) == obj_size);
-    segment * s = h->m_curr_segment;
-    LEAN_RUNTIME_STAT_CODE(g_num_pages++);
-    page * p    = new (s->m_next_page_mem) page();
-    s->m_next_page_mem += LEAN_PAGE_SIZE;
-    if (s->is_full()) {
-        /* s is full, we need to allocate a new one. */
-        h->alloc_segment();
+    page * p;
+    if (h->m_empty_pages) {
+        /* reuse empty page, it may have been used by a different slot */
+        LEAN_RUNTIME_STAT_CODE(g_num_reused_pages++);
+        p = page_list_pop(h->m_empty_pages);
+    } else {
+        segment * s = h->m_curr_segment;
+        LEAN_RUNTIME_STAT_CODE(g_num_pages++);
+        p = new (s->m_next_page_mem) page();
+        p->m_header.m_segment = s;
+        s->m_next_page_mem += LEAN_PAGE_SIZE;
+        if (s->is_full()) {
+            /* s is full, we need to allocate a new one. */
+            h->alloc_segment();
+        }
     }
+    p->get_segment()->m_num_used_pages++;
     unsigned slot_idx        = lean_get_slot_idx(obj_size);
     p->m_header.m_heap       = h;
     page_list_insert(h->m_curr_page[slot_idx], p);
@@ -315,6 +486,7 @@ static page * alloc_page(heap * h, unsigned obj_size) {
     p->m_header.m_max_free   = num_free;
     p->m_header.m_num_free   = num_free;
     p->m_header.m_in_page_free_list = false;
+    p->m_header.m_num_sampled = 0;
     return p;
 }
 
@@ -357,6 +529,24 @@ void init_thread_heap() {
     init_heap(false);
 }
 
+LEAN_NOINLINE
+static void heapprof_sample_small(void * o, unsigned sz) {
+    /* randomize the distance to the next sample (mean: the interval) to avoid aliasing with periodic allocation patterns */
+    uint64_t & x = g_heap->m_heapprof_rand;
+    x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+    unsigned interval = get_heapprof_interval();
+    g_heap->m_heapprof_countdown = interval / 2 + 1 + x % interval;
+    if (heapprof_alloc(o, sz, interval))
+        get_page_of(o)->m_header.m_num_sampled++;
+}
+
+static inline void * heapprof_check_small(void * o, unsigned sz) {
+    /* A single predictable branch when the profiler is disabled */
+    if (LEAN_UNLIKELY(g_heapprof_interval != 0) && --g_heap->m_heapprof_countdown == 0)
+        heapprof_sample_small(o, sz);
+    return o;
+}
+
 LEAN_NOINLINE
 void * lean_alloc_small_cold(unsigned sz, unsigned slot_idx, page * p) {
     if (g_heap->m_page_free_list[slot_idx] == nullptr) {
@@ -383,12 +573,12 @@ extern "C" LEAN_EXPORT void * lean_alloc_small(unsigned sz, unsigned slot_idx) {
     g_heap->m_heartbeat++;
     void * r = p->m_header.m_free_list;
     if (LEAN_UNLIKELY(r == nullptr)) {
-        return lean_alloc_small_cold(sz, slot_idx, p);
+        return heapprof_check_small(lean_alloc_small_cold(sz, slot_idx, p), sz);
     }
     p->m_header.m_free_list = get_next_obj(r);
     p->m_header.m_num_free--;
     lean_assert(get_page_of(r) == p);
-    return r;
+    return heapprof_check_small(r, sz);
 }
 
 /* Helper function for increasing hearbeat even when LEAN_SMALL_ALLOCATOR is not defined */
@@ -410,6 +600,8 @@ void * alloc(size_t sz) {
     if (LEAN_UNLIKELY(sz > LEAN_MAX_SMALL_OBJECT_SIZE)) {
         void * r = malloc(sz);
         if (r == nullptr) lean_internal_panic_out_of_memory();
+        if (LEAN_UNLIKELY(get_heapprof_interval() != 0))
+            heapprof_alloc(r, sz, 1);
         return r;
     }
     lean_assert(g_heap);
@@ -436,6 +628,8 @@ static inline void dealloc_small_core(void * o) {
     }
     lean_assert(g_heap);
     page * p = get_page_of(o);
+    if (LEAN_UNLIKELY(p->m_header.m_num_sampled.load() != 0) && heapprof_free(o))
+        p->m_header.m_num_sampled--;
     if (LEAN_LIKELY(p->get_heap() == g_heap)) {
         p->push_free_obj(o);
     } else {
@@ -447,6 +641,8 @@ void dealloc(void * o, size_t sz) {
     LEAN_RUNTIME_STAT_CODE(g_num_dealloc++);
     sz = lean_align(sz, LEAN_OBJECT_SIZE_DELTA);
     if (LEAN_UNLIKELY(sz > LEAN_MAX_SMALL_OBJECT_SIZE)) {
+        if (LEAN_UNLIKELY(get_heapprof_interval() != 0))
+            heapprof_free(o);
         return free(o);
     }
     dealloc_small_core(o);
@@ -462,6 +658,12 @@ extern "C" LEAN_EXPORT unsigned lean_small_mem_size(void * o) {
 }
 
 void initialize_alloc() {
+    initialize_heapprof();
+#ifndef LEAN_EMSCRIPTEN
+    if (char const * num_segments = std::getenv("LEAN_RETAINED_SEGMENTS")) {
+        g_max_retained_segments = atoi(num_segments);
+    }
+#endif
     g_heap_manager = new heap_manager();
     init_heap(true);
 }
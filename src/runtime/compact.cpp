@@ -4,7 +4,6 @@ Released under Apache 2.0 license as described in the file LICENSE.
 
 Author: Leonardo de Moura
 */
-#include <unordered_set>
 #include <algorithm>
 #include <string>
 #include <vector>
@@ -18,47 +17,108 @@ Author: Leonardo de Moura
 #endif
 
 #define LEAN_COMPACTOR_INIT_SZ 1024*1024
-#define LEAN_MAX_SHARING_TABLE_INITIAL_SIZE 1024*1024
+#define LEAN_MAX_SHARING_TABLE_INITIAL_SIZE 64*1024 // must be a power of two
+#define LEAN_COMPACTOR_TABLE_INITIAL_SIZE 64*1024   // must be a power of two
+// a streaming compactor writes its buffer to the sink when it exceeds this size
+#define LEAN_COMPACTOR_CHUNK_SZ 8*1024*1024
+// flushed objects up to this size are kept in memory after the first maximal sharing hit on them
+#define LEAN_MAX_SHARING_CACHED_SZ 256
 
 // uncomment to track the number of each kind of object in an .olean file
 // #define LEAN_TAG_COUNTERS
 
 namespace lean {
 
-struct max_sharing_key {
-    size_t m_offset;
-    size_t m_size;
-    max_sharing_key(size_t offset, size_t sz):m_offset(offset), m_size(sz) {}
-};
+/* Open addressing table from objects to their offsets in the compacted region. */
+struct object_compactor::obj_table {
+    struct entry {
+        object *      m_obj;
+        object_offset m_offset;
+    };
+    std::vector<entry> m_entries;
+    size_t             m_size{0};
+    unsigned           m_shift;
+
+    static size_t idx(object * o, unsigned shift) {
+        // Fibonacci hashing, objects are at least word-aligned
+        return static_cast<size_t>((static_cast<uint64_t>(reinterpret_cast<size_t>(o)) * 11400714819323198485ull) >> shift);
+    }
+
+    obj_table():m_entries(LEAN_COMPACTOR_TABLE_INITIAL_SIZE, entry{nullptr, nullptr}), m_shift(64 - log2(LEAN_COMPACTOR_TABLE_INITIAL_SIZE)) {}
 
-struct max_sharing_hash {
-    object_compactor * m;
-    max_sharing_hash(object_compactor * manager):m(manager) {}
-    unsigned operator()(max_sharing_key const & k) const {
-        return hash_str(k.m_size, reinterpret_cast<unsigned char const *>(m->m_begin) + k.m_offset, 17);
+    static unsigned log2(size_t n) {
+        unsigned r = 0;
+        while ((static_cast<size_t>(1) << r) < n) r++;
+        return r;
     }
-};
 
-struct max_sharing_eq {
-    object_compactor * m;
-    max_sharing_eq(object_compactor * manager):m(manager) {}
-    bool operator()(max_sharing_key const & k1, max_sharing_key const & k2) const {
-        if (k1.m_size != k2.m_size) return false;
-        return memcmp(reinterpret_cast<char*>(m->m_begin) + k1.m_offset, reinterpret_cast<char*>(m->m_begin) + k2.m_offset, k1.m_size) == 0;
+    void grow() {
+        std::vector<entry> old_entries(2 * m_entries.size(), entry{nullptr, nullptr});
+        old_entries.swap(m_entries);
+        m_shift--;
+        for (entry const & e : old_entries) {
+            if (e.m_obj) {
+                size_t i = idx(e.m_obj, m_shift);
+                while (m_entries[i].m_obj) i = (i + 1) & (m_entries.size() - 1);
+                m_entries[i] = e;
+            }
+        }
+    }
+
+    /* Return `g_null_offset` if `o` is not in the table. */
+    object_offset find(object * o) const;
+
+    void insert(object * o, object_offset offset) {
+        if (2 * (m_size + 1) > m_entries.size())
+            grow();
+        size_t i = idx(o, m_shift);
+        while (m_entries[i].m_obj) {
+            lean_assert(m_entries[i].m_obj != o);
+            i = (i + 1) & (m_entries.size() - 1);
+        }
+        m_entries[i] = entry{o, offset};
+        m_size++;
     }
 };
 
+/* Open addressing table of the objects in the compacted region, indexed by their contents. The hash of each
+   object is stored so that the table can be resized without access to already flushed data.
 
+   Objects that are shared at all are usually shared many times (names, universe levels, common subterms), so
+   the contents of a small flushed object are copied to `m_cache` on the first hit. Further hits on it are then
+   resolved without reading from the sink. */
 struct object_compactor::max_sharing_table {
-    std::unordered_set<max_sharing_key, max_sharing_hash, max_sharing_eq> m_table;
-    max_sharing_table(object_compactor * manager):
-        m_table(LEAN_MAX_SHARING_TABLE_INITIAL_SIZE, max_sharing_hash(manager), max_sharing_eq(manager)) {
+    static constexpr size_t not_cached = static_cast<size_t>(-1);
+    struct entry {
+        size_t   m_offset;
+        size_t   m_size; // 0 if the entry is empty
+        size_t   m_cached; // offset of a copy of the object in `m_cache`, or `not_cached`
+        unsigned m_hash;
+    };
+    std::vector<entry> m_entries;
+    size_t             m_size{0};
+    std::vector<char>  m_cache;
+
+    max_sharing_table():m_entries(LEAN_MAX_SHARING_TABLE_INITIAL_SIZE, entry{0, 0, not_cached, 0}) {}
+
+    void grow() {
+        std::vector<entry> old_entries(2 * m_entries.size(), entry{0, 0, not_cached, 0});
+        old_entries.swap(m_entries);
+        for (entry const & e : old_entries) {
+            if (e.m_size) {
+                size_t i = e.m_hash & (m_entries.size() - 1);
+                while (m_entries[i].m_size) i = (i + 1) & (m_entries.size() - 1);
+                m_entries[i] = e;
+            }
+        }
     }
 };
 
-object_compactor::object_compactor(void * base_addr):
-    m_max_sharing_table(new max_sharing_table(this)),
+object_compactor::object_compactor(void * base_addr, compactor_sink * sink):
+    m_obj_table(new obj_table()),
+    m_max_sharing_table(new max_sharing_table()),
     m_base_addr(base_addr),
+    m_sink(sink),
     m_begin(malloc(LEAN_COMPACTOR_INIT_SZ)),
     m_end(m_begin),
     m_capacity(static_cast<char*>(m_begin) + LEAN_COMPACTOR_INIT_SZ) {
@@ -75,6 +135,18 @@ object_compactor::~object_compactor() {
 */
 object_offset g_null_offset = reinterpret_cast<object_offset>(static_cast<size_t>(-1) - 1);
 
+object_offset object_compactor::obj_table::find(object * o) const {
+    size_t i = idx(o, m_shift);
+    while (true) {
+        entry const & e = m_entries[i];
+        if (e.m_obj == o)
+            return e.m_offset;
+        if (!e.m_obj)
+            return g_null_offset;
+        i = (i + 1) & (m_entries.size() - 1);
+    }
+}
+
 void * object_compactor::alloc(size_t sz) {
     size_t rem = sz % sizeof(void*);
     if (rem != 0)
@@ -82,8 +154,9 @@ void * object_compactor::alloc(size_t sz) {
     while (static_cast<char*>(m_end) + sz > m_capacity) {
         size_t new_capacity = capacity()*2;
         void * new_begin = malloc(new_capacity);
-        memcpy(new_begin, m_begin, size());
-        m_end      = static_cast<char*>(new_begin) + size();
+        size_t buffer_size = buffered_size();
+        memcpy(new_begin, m_begin, buffer_size);
+        m_end      = static_cast<char*>(new_begin) + buffer_size;
         m_capacity = static_cast<char*>(new_begin) + new_capacity;
         free(m_begin);
         m_begin    = new_begin;
@@ -95,34 +168,77 @@ void * object_compactor::alloc(size_t sz) {
     return r;
 }
 
-void object_compactor::save(object * o, object * new_o) {
-    lean_assert(m_begin <= new_o && new_o < m_end);
-    m_obj_table.insert(std::make_pair(o, reinterpret_cast<object_offset>(reinterpret_cast<char*>(new_o) - reinterpret_cast<char*>(m_begin) + reinterpret_cast<size_t>(m_base_addr))));
+/* Write the buffer to the sink. Must not be called while an object is being inserted. */
+void object_compactor::flush() {
+    lean_assert(m_sink);
+    size_t buffer_size = buffered_size();
+    m_sink->write(m_begin, buffer_size);
+    m_flushed += buffer_size;
+    m_end = m_begin;
+}
+
+size_t object_compactor::region_offset(void * p) const {
+    lean_assert(m_begin <= p && p <= m_end);
+    return m_flushed + (static_cast<char*>(p) - static_cast<char*>(m_begin));
+}
+
+object_offset object_compactor::to_object_offset(size_t offset) const {
+    return reinterpret_cast<object_offset>(offset + reinterpret_cast<size_t>(m_base_addr));
+}
+
+/* Return true iff the object of the `entry_idx`-th entry of the maximal sharing table is equal to `data`. */
+bool object_compactor::region_equal(size_t entry_idx, void const * data) {
+    max_sharing_table::entry & e = m_max_sharing_table->m_entries[entry_idx];
+    size_t sz = e.m_size;
+    if (e.m_offset >= m_flushed)
+        return memcmp(static_cast<char*>(m_begin) + (e.m_offset - m_flushed), data, sz) == 0;
+    std::vector<char> & cache = m_max_sharing_table->m_cache;
+    if (e.m_cached != max_sharing_table::not_cached)
+        return memcmp(cache.data() + e.m_cached, data, sz) == 0;
+    m_cmp_buffer.resize(sz);
+    m_sink->read(e.m_offset, m_cmp_buffer.data(), sz);
+    if (memcmp(m_cmp_buffer.data(), data, sz) != 0)
+        return false;
+    if (sz <= LEAN_MAX_SHARING_CACHED_SZ) {
+        e.m_cached = cache.size();
+        cache.insert(cache.end(), m_cmp_buffer.begin(), m_cmp_buffer.end());
+    }
+    return true;
+}
+
+void object_compactor::save(object * o, size_t offset) {
+    m_obj_table->insert(o, to_object_offset(offset));
 }
 
 void object_compactor::save_max_sharing(object * o, object * new_o, size_t new_o_sz) {
-    max_sharing_key k(reinterpret_cast<char*>(new_o) - reinterpret_cast<char*>(m_begin), new_o_sz);
-    auto it = m_max_sharing_table->m_table.find(k);
-    if (it != m_max_sharing_table->m_table.end()) {
-        m_end = new_o;
-        new_o = reinterpret_cast<lean_object*>(reinterpret_cast<char*>(m_begin) + it->m_offset);
-    } else {
-        m_max_sharing_table->m_table.insert(k);
+    max_sharing_table & t = *m_max_sharing_table;
+    unsigned h = hash_str(new_o_sz, reinterpret_cast<unsigned char const *>(new_o), 17);
+    size_t i = h & (t.m_entries.size() - 1);
+    while (t.m_entries[i].m_size) {
+        max_sharing_table::entry const & e = t.m_entries[i];
+        if (e.m_hash == h && e.m_size == new_o_sz && region_equal(i, new_o)) {
+            m_end = new_o;
+            save(o, e.m_offset);
+            return;
+        }
+        i = (i + 1) & (t.m_entries.size() - 1);
     }
-    save(o, new_o);
+    size_t offset = region_offset(new_o);
+    t.m_entries[i] = max_sharing_table::entry{offset, new_o_sz, max_sharing_table::not_cached, h};
+    t.m_size++;
+    if (2 * t.m_size > t.m_entries.size())
+        t.grow();
+    save(o, offset);
 }
 
 object_offset object_compactor::to_offset(object * o) {
     if (lean_is_scalar(o)) {
         return o;
     } else {
-        auto it = m_obj_table.find(o);
-        if (it == m_obj_table.end()) {
+        object_offset r = m_obj_table->find(o);
+        if (r == g_null_offset)
             m_todo.push_back(o);
-            return g_null_offset;
-        } else {
-            return it->second;
-        }
+        return r;
     }
 }
 
@@ -267,9 +383,9 @@ void object_compactor::insert_mpz(object * o) {
     // we assume the limb array is the only indirection in an `__mpz_struct` and everything else can be bitcopied
     void * data = reinterpret_cast<char*>(new_o) + sizeof(mpz_object);
     memcpy(data, m._mp_d, data_sz);
-    m._mp_d = reinterpret_cast<mp_limb_t *>(reinterpret_cast<char *>(data) - reinterpret_cast<char *>(m_begin) + reinterpret_cast<ptrdiff_t>(m_base_addr));
+    m._mp_d = reinterpret_cast<mp_limb_t *>(to_object_offset(region_offset(data)));
     m._mp_alloc = nlimbs;
-    save(o, (lean_object*)new_o);
+    save(o, region_offset(new_o));
 #else
     size_t data_sz = sizeof(mpn_digit) * to_mpz(o)->m_value.m_size;
     size_t sz      = sizeof(mpz_object) + data_sz;
@@ -278,8 +394,8 @@ void object_compactor::insert_mpz(object * o) {
     lean_set_non_heap_header((lean_object*)new_o, sz, LeanMPZ, 0);
     void * data = reinterpret_cast<char*>(new_o) + sizeof(mpz_object);
     memcpy(data, to_mpz(o)->m_value.m_digits, data_sz);
-    new_o->m_value.m_digits = reinterpret_cast<mpn_digit *>(reinterpret_cast<char *>(data) - reinterpret_cast<char *>(m_begin) + reinterpret_cast<ptrdiff_t>(m_base_addr));
-    save(o, (lean_object*)new_o);
+    new_o->m_value.m_digits = reinterpret_cast<mpn_digit *>(to_object_offset(region_offset(data)));
+    save(o, region_offset(new_o));
 #endif
 }
 
@@ -322,13 +438,14 @@ tag_counter_manager g_tag_counter_manager;
 
 void object_compactor::operator()(object * o) {
     lean_assert(m_todo.empty());
+    lean_assert(size() == 0);
     // allocate for root address, see end of function
     alloc(sizeof(object_offset));
     if (!lean_is_scalar(o)) {
         m_todo.push_back(o);
         while (!m_todo.empty()) {
             object * curr = m_todo.back();
-            if (m_obj_table.find(curr) != m_obj_table.end()) {
+            if (m_obj_table->find(curr) != g_null_offset) {
                 m_todo.pop_back();
                 continue;
             }
@@ -351,10 +468,18 @@ void object_compactor::operator()(object * o) {
             default:                  r = insert_constructor(curr); break;
             }
             if (r) m_todo.pop_back();
+            if (m_sink && buffered_size() >= LEAN_COMPACTOR_CHUNK_SZ)
+                flush();
         }
         m_tmp.clear();
     }
-    *static_cast<object_offset *>(m_begin) = to_offset(o);
+    object_offset root = to_offset(o);
+    if (m_flushed == 0)
+        *static_cast<object_offset *>(m_begin) = root;
+    if (m_sink) {
+        flush();
+        m_sink->write_at(0, &root, sizeof(object_offset));
+    }
 }
 
 compacted_region::compacted_region(size_t sz, void * data, void * base_addr, bool is_mmap, std::function<void()> free_data):
@@ -7,17 +7,28 @@ Author: Leonardo de Moura
 #pragma once
 #include <functional>
 #include <vector>
-#include <unordered_map>
+#include <memory>
 #include "runtime/object.h"
 
 namespace lean {
 typedef lean_object * object_offset;
 
+/* Destination of a streaming `object_compactor`. Offsets are relative to the beginning of the compacted region. */
+class compactor_sink {
+public:
+    virtual ~compactor_sink() {}
+    /* Append `sz` bytes to the region. */
+    virtual void write(void const * data, size_t sz) = 0;
+    /* Read back `sz` bytes that have already been written. */
+    virtual void read(size_t offset, void * data, size_t sz) = 0;
+    /* Overwrite `sz` bytes that have already been written. */
+    virtual void write_at(size_t offset, void const * data, size_t sz) = 0;
+};
+
 class object_compactor {
+    struct obj_table;
     struct max_sharing_table;
-    friend struct max_sharing_hash;
-    friend struct max_sharing_eq;
-    std::unordered_map<object*, object_offset, std::hash<object*>, std::equal_to<object*>> m_obj_table;
+    std::unique_ptr<obj_table> m_obj_table;
     std::unique_ptr<max_sharing_table> m_max_sharing_table;
     std::vector<object*> m_todo;
     std::vector<object_offset> m_tmp;
@@ -25,11 +36,21 @@ class object_compactor {
     // References within the compacted region are rewritten by subtracting `m_begin` and adding `m_base_addr`
     // In the simplest case `base_addr == nullptr`, we get region-relative pointers
     void * m_base_addr;
+    // If not null, finished chunks of the region are written to `m_sink` instead of being kept in memory
+    compactor_sink * m_sink;
+    size_t m_flushed{0}; // size of the part of the region that has been written to `m_sink`
+    std::vector<char> m_cmp_buffer;
+    // in-memory part of the region
     void * m_begin;
     void * m_end;
     void * m_capacity;
     size_t capacity() const { return static_cast<char*>(m_capacity) - static_cast<char*>(m_begin); }
-    void save(object * o, object * new_o);
+    size_t buffered_size() const { return static_cast<char*>(m_end) - static_cast<char*>(m_begin); }
+    size_t region_offset(void * p) const;
+    object_offset to_object_offset(size_t offset) const;
+    bool region_equal(size_t entry_idx, void const * data);
+    void flush();
+    void save(object * o, size_t offset);
     void save_max_sharing(object * o, object * new_o, size_t new_o_sz);
     void * alloc(size_t sz);
     object_offset to_offset(object * o);
@@ -44,15 +65,16 @@ class object_compactor {
     bool insert_ref(object * o);
     void insert_mpz(object * o);
 public:
-    object_compactor(void * base_addr = nullptr);
+    object_compactor(void * base_addr = nullptr, compactor_sink * sink = nullptr);
     object_compactor(object_compactor const &) = delete;
     object_compactor(object_compactor &&) = delete;
     ~object_compactor();
     object_compactor operator=(object_compactor const &) = delete;
     object_compactor operator=(object_compactor &&) = delete;
     void operator()(object * o);
-    size_t size() const { return static_cast<char*>(m_end) - static_cast<char*>(m_begin); }
-    void const * data() const { return m_begin; }
+    size_t size() const { return m_flushed + buffered_size(); }
+    /* Only available if the compactor has no sink. */
+    void const * data() const { lean_assert(!m_sink); return m_begin; }
 };
 
 class compacted_region {
@@ -0,0 +1,305 @@
+/*
+Copyright (c) 2021 Microsoft Corporation. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+*/
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <atomic>
+#include <unordered_map>
+#include <iostream>
+#include <cstdio>
+#include "runtime/thread.h"
+#include "runtime/flet.h"
+#include "runtime/heapprof.h"
+
+#if !defined(LEAN_WINDOWS) && !defined(LEAN_EMSCRIPTEN)
+#include <csignal>
+#include <unistd.h>
+#define LEAN_HEAPPROF_SIGNAL
+#endif
+
+#if defined(__GLIBC__) || defined(__APPLE__)
+#include <execinfo.h>
+#include <dlfcn.h>
+#include <cxxabi.h>
+#define LEAN_HEAPPROF_BACKTRACE
+#endif
+
+#define LEAN_HEAPPROF_MAX_NATIVE_FRAMES 64
+#define LEAN_HEAPPROF_MAX_LEAN_FRAMES   32
+/* Frames are either native return addresses or indices into `m_lean_frames` tagged with the following bit */
+#define LEAN_HEAPPROF_LEAN_FRAME        (static_cast<uint64_t>(1) << 63)
+
+namespace lean {
+unsigned                  g_heapprof_interval  = 0;
+static heapprof_frames_fn g_heapprof_frames_fn = nullptr;
+LEAN_THREAD_VALUE(bool, g_in_heapprof, false);
+#ifdef LEAN_HEAPPROF_SIGNAL
+/* Set by the signal handler. It is lock-free, and it is reset by an atomic exchange, so that each signal triggers at
+   most one dump even if several threads record allocations concurrently. */
+static std::atomic<bool> g_heapprof_dump_requested(false);
+#endif
+
+void set_heapprof_frames_fn(heapprof_frames_fn fn) {
+    g_heapprof_frames_fn = fn;
+}
+
+/* Minimal protocol buffer encoder for https://github.com/google/pprof/blob/master/proto/profile.proto */
+class pb_writer {
+    std::string m_buf;
+    void varint(uint64_t v) {
+        while (v >= 0x80) {
+            m_buf += static_cast<char>((v & 0x7f) | 0x80);
+            v >>= 7;
+        }
+        m_buf += static_cast<char>(v);
+    }
+    void tag(unsigned field, unsigned wire_type) { varint((field << 3) | wire_type); }
+public:
+    void uint(unsigned field, uint64_t v) { tag(field, 0); varint(v); }
+    void bytes(unsigned field, std::string const & s) { tag(field, 2); varint(s.size()); m_buf += s; }
+    void msg(unsigned field, pb_writer const & w) { bytes(field, w.m_buf); }
+    void packed(unsigned field, std::vector<uint64_t> const & vs) {
+        pb_writer w;
+        for (uint64_t v : vs) w.varint(v);
+        msg(field, w);
+    }
+    std::string const & str() const { return m_buf; }
+};
+
+class heap_profiler {
+    struct stack_stats {
+        uint64_t m_alloc_objs{0};
+        uint64_t m_alloc_bytes{0};
+        uint64_t m_inuse_objs{0};
+        uint64_t m_inuse_bytes{0};
+    };
+    struct live_object {
+        unsigned m_stack;
+        uint64_t m_objs;
+        uint64_t m_bytes;
+    };
+    mutex                                      m_mutex;
+    std::vector<std::string>                   m_lean_frames;
+    std::unordered_map<std::string, unsigned>  m_lean_frame_idx;
+    std::vector<std::vector<uint64_t>>         m_stacks; // innermost frame first
+    std::map<std::vector<uint64_t>, unsigned>  m_stack_idx;
+    std::vector<stack_stats>                   m_stats;
+    std::unordered_map<void *, live_object>    m_live;
+
+    unsigned lean_frame(std::string const & fn) {
+        auto it = m_lean_frame_idx.find(fn);
+        if (it != m_lean_frame_idx.end())
+            return it->second;
+        unsigned idx = m_lean_frames.size();
+        m_lean_frames.push_back(fn);
+        m_lean_frame_idx.emplace(fn, idx);
+        return idx;
+    }
+
+    unsigned stack(std::vector<uint64_t> const & frames) {
+        auto it = m_stack_idx.find(frames);
+        if (it != m_stack_idx.end())
+            return it->second;
+        unsigned idx = m_stacks.size();
+        m_stacks.push_back(frames);
+        m_stats.emplace_back();
+        m_stack_idx.emplace(frames, idx);
+        return idx;
+    }
+
+    std::string frame_name(uint64_t frame) const {
+        if (frame & LEAN_HEAPPROF_LEAN_FRAME)
+            return m_lean_frames[frame & ~LEAN_HEAPPROF_LEAN_FRAME];
+#ifdef LEAN_HEAPPROF_BACKTRACE
+        Dl_info info;
+        if (dladdr(reinterpret_cast<void *>(frame), &info) && info.dli_sname) {
+            int status;
+            char * demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+            if (demangled) {
+                std::string r(demangled);
+                free(demangled);
+                return r;
+            }
+            return info.dli_sname;
+        }
+#endif
+        char buf[32];
+        snprintf(buf, sizeof(buf), "0x%llx", static_cast<unsigned long long>(frame));
+        return buf;
+    }
+
+public:
+    void record_alloc(void * o, size_t sz, uint64_t weight) {
+        std::vector<std::string> lean_frames;
+        if (g_heapprof_frames_fn)
+            g_heapprof_frames_fn(lean_frames, LEAN_HEAPPROF_MAX_LEAN_FRAMES);
+        std::vector<uint64_t> frames;
+        lock_guard<mutex> lock(m_mutex);
+        for (std::string const & fn : lean_frames)
+            frames.push_back(LEAN_HEAPPROF_LEAN_FRAME | lean_frame(fn));
+#ifdef LEAN_HEAPPROF_BACKTRACE
+        void * native[LEAN_HEAPPROF_MAX_NATIVE_FRAMES];
+        int n = backtrace(native, LEAN_HEAPPROF_MAX_NATIVE_FRAMES);
+        /* skip `heap_profiler::record_alloc` and `heapprof_alloc` */
+        for (int i = 2; i < n; i++)
+            frames.push_back(reinterpret_cast<uint64_t>(native[i]));
+#endif
+        unsigned idx = stack(frames);
+        stack_stats & s = m_stats[idx];
+        s.m_alloc_objs  += weight;
+        s.m_alloc_bytes += weight * sz;
+        s.m_inuse_objs  += weight;
+        s.m_inuse_bytes += weight * sz;
+        m_live[o] = live_object{idx, weight, weight * sz};
+    }
+
+    bool record_free(void * o) {
+        lock_guard<mutex> lock(m_mutex);
+        auto it = m_live.find(o);
+        if (it == m_live.end())
+            return false;
+        stack_stats & s = m_stats[it->second.m_stack];
+        s.m_inuse_objs  -= it->second.m_objs;
+        s.m_inuse_bytes -= it->second.m_bytes;
+        m_live.erase(it);
+        return true;
+    }
+
+    std::string to_pprof() {
+        lock_guard<mutex> lock(m_mutex);
+        std::vector<std::string> strings{""};
+        std::unordered_map<std::string, uint64_t> string_idx{{"", 0}};
+        auto str = [&](std::string const & s) {
+            auto it = string_idx.find(s);
+            if (it != string_idx.end())
+                return it->second;
+            uint64_t idx = strings.size();
+            strings.push_back(s);
+            string_idx.emplace(s, idx);
+            return idx;
+        };
+        auto value_type = [&](char const * type, char const * unit) {
+            pb_writer w;
+            w.uint(1, str(type));
+            w.uint(2, str(unit));
+            return w;
+        };
+        pb_writer out;
+        out.msg(1, value_type("alloc_objects", "count"));
+        out.msg(1, value_type("alloc_space", "bytes"));
+        out.msg(1, value_type("inuse_objects", "count"));
+        out.msg(1, value_type("inuse_space", "bytes"));
+        /* every frame gets its own location and function, which share their id */
+        std::unordered_map<uint64_t, uint64_t> location_idx;
+        std::vector<uint64_t> locations;
+        for (unsigned i = 0; i < m_stacks.size(); i++) {
+            stack_stats const & s = m_stats[i];
+            std::vector<uint64_t> ids;
+            for (uint64_t frame : m_stacks[i]) {
+                auto it = location_idx.find(frame);
+                if (it == location_idx.end()) {
+                    it = location_idx.emplace(frame, locations.size() + 1).first;
+                    locations.push_back(frame);
+                }
+                ids.push_back(it->second);
+            }
+            pb_writer sample;
+            sample.packed(1, ids);
+            sample.packed(2, {s.m_alloc_objs, s.m_alloc_bytes, s.m_inuse_objs, s.m_inuse_bytes});
+            out.msg(2, sample);
+        }
+        for (unsigned i = 0; i < locations.size(); i++) {
+            uint64_t frame = locations[i];
+            pb_writer line;
+            line.uint(1, i + 1);
+            pb_writer loc;
+            loc.uint(1, i + 1);
+            if (!(frame & LEAN_HEAPPROF_LEAN_FRAME))
+                loc.uint(3, frame);
+            loc.msg(4, line);
+            out.msg(4, loc);
+            pb_writer fn;
+            uint64_t name = str(frame_name(frame));
+            fn.uint(1, i + 1);
+            fn.uint(2, name);
+            fn.uint(3, name);
+            out.msg(5, fn);
+        }
+        for (std::string const & s : strings)
+            out.bytes(6, s);
+        out.uint(9, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     std::chrono::system_clock::now().time_since_epoch()).count());
+        out.msg(11, value_type("space", "bytes"));
+        out.uint(12, g_heapprof_interval);
+        return out.str();
+    }
+};
+
+static heap_profiler * g_heap_profiler = nullptr;
+
+bool heapprof_dump(std::string const & fname) {
+    if (!g_heap_profiler)
+        return false;
+    flet<bool> in_heapprof(g_in_heapprof, true);
+    std::string data = g_heap_profiler->to_pprof();
+    std::ofstream out(fname, std::ios_base::binary);
+    out.write(data.data(), data.size());
+    out.close();
+    return !out.fail();
+}
+
+#ifdef LEAN_HEAPPROF_SIGNAL
+static void dump_requested_profile() {
+    std::string fname;
+    if (char const * f = std::getenv("LEAN_HEAPPROF_FILE"))
+        fname = f;
+    else
+        fname = "lean-heap." + std::to_string(getpid()) + ".pb";
+    if (!heapprof_dump(fname))
+        std::cerr << "failed to write heap profile '" << fname << "'\n";
+}
+#endif
+
+bool heapprof_alloc(void * o, size_t sz, uint64_t weight) {
+    /* collecting the frames may allocate Lean objects, which must not be recorded */
+    if (g_in_heapprof)
+        return false;
+#ifdef LEAN_HEAPPROF_SIGNAL
+    if (g_heapprof_dump_requested.load(std::memory_order_relaxed) && g_heapprof_dump_requested.exchange(false))
+        dump_requested_profile();
+#endif
+    flet<bool> in_heapprof(g_in_heapprof, true);
+    g_heap_profiler->record_alloc(o, sz, weight);
+    return true;
+}
+
+bool heapprof_free(void * o) {
+    return g_heap_profiler->record_free(o);
+}
+
+#ifdef LEAN_HEAPPROF_SIGNAL
+static void heapprof_signal_handler(int) {
+    g_heapprof_dump_requested.store(true);
+}
+#endif
+
+void initialize_heapprof() {
+    char const * interval = std::getenv("LEAN_HEAPPROF");
+    if (!interval || atoi(interval) <= 0)
+        return;
+    g_heapprof_interval = atoi(interval);
+    g_heap_profiler     = new heap_profiler(); // never freed, objects may be freed during finalization
+#ifdef LEAN_HEAPPROF_SIGNAL
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = heapprof_signal_handler;
+    action.sa_flags   = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGUSR1, &action, nullptr);
+#endif
+}
+}
@@ -0,0 +1,39 @@
+/*
+Copyright (c) 2021 Microsoft Corporation. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+*/
+#pragma once
+#include <string>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace lean {
+/* Sampling allocation-site heap profiler.
+
+   It is enabled by setting the environment variable `LEAN_HEAPPROF=<n>`, in which case on average every `n`-th
+   small object allocation (and every big one) is recorded together with its native backtrace and the Lean
+   functions being executed by the IR interpreter, if any. Recorded objects that are freed again are removed from
+   the "in use" statistics. The profile can be written in pprof format using `IO.heapProfDump` or, on POSIX
+   systems, by sending `SIGUSR1` to the process, in which case it is written to `LEAN_HEAPPROF_FILE`
+   (default: `lean-heap.<pid>.pb`) on the next recorded allocation. */
+
+/* Sampling interval, or 0 if the profiler is disabled. Only set by `initialize_heapprof`. */
+extern unsigned g_heapprof_interval;
+/* Return the sampling interval, or 0 if the profiler is disabled. */
+inline unsigned get_heapprof_interval() { return g_heapprof_interval; }
+/* Record the allocation of `o` of size `sz`, representing `weight` allocations of the same size.
+   Return false if the allocation was not recorded because it was made by the profiler itself. */
+bool heapprof_alloc(void * o, size_t sz, uint64_t weight);
+/* Record the deallocation of `o`. Return true iff `o` was recorded by `heapprof_alloc`. */
+bool heapprof_free(void * o);
+/* Write the profile in pprof format to `fname`. Return false if the file could not be written. */
+bool heapprof_dump(std::string const & fname);
+
+/* Procedure for collecting the names of (at most `max_frames` of) the Lean functions currently executing on this
+   thread, innermost first. */
+typedef void (*heapprof_frames_fn)(std::vector<std::string> & frames, unsigned max_frames);
+void set_heapprof_frames_fn(heapprof_frames_fn fn);
+
+void initialize_heapprof();
+}
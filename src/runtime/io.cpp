@@ -43,6 +43,7 @@ Authors: Leonardo de Moura, Sebastian Ullrich
 #include "runtime/object.h"
 #include "runtime/thread.h"
 #include "runtime/allocprof.h"
+#include "runtime/heapprof.h"
 
 #ifdef _MSC_VER
 #define S_ISDIR(mode) ((mode & _S_IFDIR) != 0)
@@ -452,6 +453,17 @@ extern "C" LEAN_EXPORT obj_res lean_io_allocprof(b_obj_arg msg, obj_arg fn, obj_
     return res;
 }
 
+/* heapProfDump (fname : @& String) : IO Unit */
+extern "C" LEAN_EXPORT obj_res lean_io_heapprof_dump(b_obj_arg fname, obj_arg) {
+    if (get_heapprof_interval() == 0) {
+        return io_result_mk_error("heap profiler is not enabled, set `LEAN_HEAPPROF=<n>` to record every n-th allocation");
+    }
+    if (!heapprof_dump(string_cstr(fname))) {
+        return io_result_mk_error((sstream() << "failed to write heap profile '" << string_cstr(fname) << "'").str());
+    }
+    return io_result_mk_ok(box(0));
+}
+
 /* getNumHeartbeats : BaseIO Nat */
 extern "C" LEAN_EXPORT obj_res lean_io_get_num_heartbeats(obj_arg /* w */) {
     return io_result_mk_ok(lean_uint64_to_nat(get_num_heartbeats()));
@@ -8,6 +8,7 @@ Author: Leonardo de Moura
 #include <algorithm>
 #include <vector>
 #include <deque>
+#include <memory>
 #include <cmath>
 #include <lean/lean.h>
 #include "runtime/object.h"
@@ -22,6 +23,10 @@ Author: Leonardo de Moura
 
 // see `Task.Priority.max`
 #define LEAN_MAX_PRIO 8
+// maximal number of tasks a worker runs nested inside `task_manager::wait_for`
+#define LEAN_MAX_HELP_DEPTH 64
+// maximal number of standard workers started in addition to `LEAN_NUM_THREADS` to replace workers blocked in `Task.get`
+#define LEAN_MAX_COMPENSATING_WORKERS 256
 
 namespace lean {
 
@@ -258,11 +263,197 @@ static void lean_del_core(object * o, object * & todo) {
     }
 }
 
+#if defined(LEAN_MULTI_THREAD)
+/* Deferred deallocation (opt-in, see `init_deferred_free`)
+
+   Freeing a large dead object graph (e.g., an old `Environment`) synchronously in `lean_dec_ref_cold` may take
+   hundreds of milliseconds. In deferred mode, the thread dropping the last reference to a multi-threaded object
+   frees at most `m_budget` objects of the graph itself and hands the remaining ones to a background reclaimer
+   thread. Objects reachable from multi-threaded objects are multi-threaded or persistent as well, so their
+   reference counters can be safely decremented by the reclaimer. Single-threaded graphs are always freed
+   synchronously.
+
+   When more than `m_max_pending` batches are waiting for the reclaimer, the mutator frees the graph itself
+   instead. This bounds the amount of dead memory that is not reclaimed yet.
+
+   Finalizers of external objects are never run by the reclaimer, since they may not expect to run concurrently with
+   the thread that used the object. The reclaimer sets dead external objects aside, and they are finalized by the next
+   thread that frees a dead multi-threaded object, or at shutdown, i.e., on a thread running Lean code as without
+   deferred deallocation. */
+class deferred_free_manager {
+    mutex                 m_mutex;
+    condition_variable    m_queue_cv;
+    std::vector<object *> m_queue; // `todo` lists (see `lean_del_core`) of dead objects
+    object *              m_externals{nullptr}; // dead external objects set aside by the reclaimer
+    atomic<bool>          m_has_externals{false};
+    bool                  m_shutting_down{false};
+    unsigned              m_budget;
+    unsigned              m_max_pending;
+    std::unique_ptr<lthread> m_thread;
+    /* statistics */
+    atomic<uint64>        m_num_deferred{0};  // number of batches handed to the reclaimer
+    atomic<uint64>        m_num_reclaimed{0}; // number of objects freed by the reclaimer
+    atomic<uint64>        m_num_rejected{0};  // number of batches freed by the mutator because of back-pressure
+
+    static void del_all(object * todo, uint64 & n) {
+        while (todo != nullptr) {
+            object * o = pop_back(todo);
+            lean_del_core(o, todo);
+            n++;
+        }
+    }
+
+    /* Free the objects of `todo` on the reclaimer thread, except for external objects. */
+    void reclaim(object * todo, uint64 & n) {
+        object * externals = nullptr;
+        while (todo != nullptr) {
+            object * o = pop_back(todo);
+            if (lean_is_external(o)) {
+                push_back(externals, o);
+            } else {
+                lean_del_core(o, todo);
+                n++;
+            }
+        }
+        if (externals != nullptr) {
+            lock_guard<mutex> lock(m_mutex);
+            while (externals != nullptr)
+                push_back(m_externals, pop_back(externals));
+            m_has_externals = true;
+        }
+    }
+
+    /* Finalize the external objects set aside by the reclaimer on the current thread. */
+    void del_externals() {
+        if (!m_has_externals.load(std::memory_order_relaxed))
+            return;
+        object * todo;
+        {
+            lock_guard<mutex> lock(m_mutex);
+            todo = m_externals;
+            m_externals = nullptr;
+            m_has_externals = false;
+        }
+        uint64 n = 0;
+        del_all(todo, n);
+    }
+
+    bool push(object * todo) {
+        lock_guard<mutex> lock(m_mutex);
+        if (m_shutting_down || m_queue.size() >= m_max_pending)
+            return false;
+        m_queue.push_back(todo);
+        m_queue_cv.notify_one();
+        return true;
+    }
+
+    void reclaimer() {
+        unique_lock<mutex> lock(m_mutex);
+        while (true) {
+            if (m_queue.empty()) {
+                if (m_shutting_down)
+                    break;
+                m_queue_cv.wait(lock);
+                continue;
+            }
+            object * todo = m_queue.back();
+            m_queue.pop_back();
+            lock.unlock();
+            uint64 n = 0;
+            reclaim(todo, n);
+            m_num_reclaimed += n;
+            lock.lock();
+        }
+    }
+
+public:
+    deferred_free_manager(unsigned budget, unsigned max_pending):
+        m_budget(budget), m_max_pending(max_pending) {
+        m_thread.reset(new lthread([this]() {
+            save_stack_info(false);
+            reclaimer();
+        }));
+    }
+
+    /* Wait for the reclaimer to free all pending objects and stop it. Afterwards, `del` frees synchronously. */
+    void shutdown() {
+        {
+            lock_guard<mutex> lock(m_mutex);
+            m_shutting_down = true;
+            m_queue_cv.notify_all();
+        }
+        m_thread->join();
+        del_externals();
+        if (std::getenv("LEAN_DEFERRED_FREE_STATS")) {
+            std::cerr << "deferred free: " << m_num_deferred.load() << " batches, "
+                      << m_num_reclaimed.load() << " objects reclaimed in background, "
+                      << m_num_rejected.load() << " batches freed synchronously\n";
+        }
+    }
+
+    /* Free the dead multi-threaded object `o`. */
+    void del(object * o) {
+        del_externals();
+        object * todo = nullptr;
+        unsigned budget = m_budget;
+        while (true) {
+            lean_del_core(o, todo);
+            if (todo == nullptr)
+                return;
+            if (budget == 0)
+                break;
+            budget--;
+            o = pop_back(todo);
+        }
+        if (push(todo)) {
+            m_num_deferred++;
+        } else {
+            m_num_rejected++;
+            uint64 n = 0;
+            del_all(todo, n);
+        }
+    }
+};
+
+/* Set before the task manager starts its workers and reset after they stopped, but also read by threads not managed
+   by the task manager. The manager itself is never deleted, since such threads may still be using it. */
+static atomic<deferred_free_manager *> g_deferred_free(nullptr);
+
+/* Enable deferred deallocation if `LEAN_DEFERRED_FREE` is set. Its value is the number of objects freed
+   synchronously before the rest of a graph is handed to the reclaimer. */
+static void init_deferred_free() {
+    lean_assert(g_deferred_free.load() == nullptr);
+#ifndef LEAN_EMSCRIPTEN
+    if (char const * budget = std::getenv("LEAN_DEFERRED_FREE")) {
+        unsigned max_pending = 1024;
+        if (char const * p = std::getenv("LEAN_DEFERRED_FREE_MAX_PENDING"))
+            max_pending = atoi(p);
+        g_deferred_free.store(new deferred_free_manager(atoi(budget), max_pending), std::memory_order_release);
+    }
+#endif
+}
+
+static void finalize_deferred_free() {
+    /* After `shutdown`, `del` frees synchronously, so concurrent calls that still see the manager are safe. */
+    if (deferred_free_manager * m = g_deferred_free.exchange(nullptr))
+        m->shutdown();
+}
+#endif
+
 extern "C" LEAN_EXPORT void lean_dec_ref_cold(lean_object * o) {
     if (o->m_rc == 1 || std::atomic_fetch_add_explicit(lean_get_rc_mt_addr(o), 1, std::memory_order_acq_rel) == -1) {
 #ifdef LEAN_LAZY_RC
         push_back(g_to_free, o);
 #else
+#if defined(LEAN_MULTI_THREAD)
+        /* `m_rc == 0` iff `o` is a dead multi-threaded object */
+        if (o->m_rc == 0) {
+            if (deferred_free_manager * m = g_deferred_free.load(std::memory_order_acquire)) {
+                m->del(o);
+                return;
+            }
+        }
+#endif
         object * todo = nullptr;
         while (true) {
             lean_del_core(o, todo);
@@ -637,37 +828,180 @@ struct scoped_current_task_object : flet<lean_task_object *> {
     scoped_current_task_object(lean_task_object * t):flet(g_current_task_object, t) {}
 };
 
+/* Local task queues of a standard worker thread, one per priority. The owner pushes and pops
+   at the back, other workers steal from the front. */
+struct worker_queue {
+    mutex                                         m_mutex;
+    std::deque<lean_task_object *>                m_queues[LEAN_MAX_PRIO+1];
+    unsigned                                      m_idx;
+    /* Set when the worker thread stopped, during shutdown or because it was no longer needed to replace
+       a blocked worker. The queue is then reused by the next worker started for the same slot. */
+    atomic<bool>                                  m_stopped{false};
+    worker_queue(unsigned idx):m_idx(idx) {}
+};
+
+LEAN_THREAD_PTR(worker_queue, g_worker_queue);
+LEAN_THREAD_VALUE(unsigned, g_help_depth, 0);
+
+/* Work-stealing scheduler. Tasks enqueued by a standard worker are pushed onto its local queue,
+   tasks enqueued by any other thread are pushed onto a lock-free injection stack. Idle workers look
+   for work in the order: local queue, injection stack, local queues of other workers, from the highest
+   to the lowest priority that has queued tasks.
+
+   Note that a worker runs the tasks it enqueued itself in LIFO order, newest first, unlike the single
+   FIFO queue used before. This keeps recently spawned tasks, which are usually the ones their spawner
+   waits for next, hot in the cache. Stolen and injected tasks are still started in FIFO order. Tasks
+   of the same priority never had a guaranteed start order across workers anyway.
+
+   Worker slots are never released: a worker that stops leaves its (empty) queue in `m_workers`, and a
+   task enqueued afterwards restarts a worker on that slot. Workers are only started and stopped under
+   `m_park_mutex`.
+
+   The queues are not protected by `m_mutex`. It is only used for the task state transitions
+   described at `lean_task_object` and for waiting for tasks to finish.
+
+   A worker waiting for an unfinished task first helps with it: if the task is still queued, the worker
+   takes it from whichever queue it is in and runs it itself. Otherwise the task is running on another
+   thread or waiting for its dependencies, and the worker blocks. It never runs unrelated tasks on its
+   stack: such a task could wait for the task suspended below it, or delay it arbitrarily. Instead,
+   blocked workers do not count towards `m_max_std_workers`, so that another worker is started if there
+   are queued tasks but no idle worker. Workers in excess of the limit stop once they run out of work. */
 class task_manager {
     mutex                                         m_mutex;
-    unsigned                                      m_num_std_workers{0};
-    unsigned                                      m_idle_std_workers{0};
+    /* Number of used slots of `m_workers`, number of standard worker threads that are running, and number
+       of them that have not stopped yet (see `wait_for_work`) */
+    atomic<unsigned>                              m_num_std_workers;
+    atomic<unsigned>                              m_running_std_workers;
+    atomic<unsigned>                              m_active_std_workers;
+    atomic<unsigned>                              m_idle_std_workers;
     unsigned                                      m_max_std_workers{0};
-    unsigned                                      m_num_dedicated_workers{0};
-    std::deque<lean_task_object *>                m_queues[LEAN_MAX_PRIO+1];
-    unsigned                                      m_queues_size{0};
-    unsigned                                      m_max_prio{0};
+    atomic<unsigned>                              m_num_dedicated_workers;
+    std::unique_ptr<atomic<worker_queue *>[]>     m_workers;
+    /* Tasks enqueued by threads other than standard workers. The stacks are linked using `m_imp->m_next_dep`,
+       which is not used while a task is queued, and are only ever emptied as a whole. */
+    atomic<lean_task_object *>                    m_injected[LEAN_MAX_PRIO+1];
+    /* Number of queued tasks per priority and in total. They are incremented before a task is pushed
+       and decremented after it has been taken, so they may be temporarily too large but never too small. */
+    atomic<unsigned>                              m_queued[LEAN_MAX_PRIO+1];
+    atomic<unsigned>                              m_queues_size;
+    mutex                                         m_park_mutex; /* for `m_queue_cv` */
+    atomic<unsigned>                              m_sleeping_std_workers;
+    /* Number of workers blocked in `wait_for`. They are woken up when a task is enqueued, as it may be
+       the awaited one, and do not count towards `m_max_std_workers`. */
+    atomic<unsigned>                              m_blocked_waiters;
     condition_variable                            m_queue_cv;
     condition_variable                            m_task_finished_cv;
     condition_variable                            m_worker_finished_cv;
-    bool                                          m_shutting_down{false};
+    atomic<bool>                                  m_shutting_down;
+
+    lean_task_object * pop_local(worker_queue * w, unsigned prio) {
+        lock_guard<mutex> lock(w->m_mutex);
+        std::deque<lean_task_object *> & q = w->m_queues[prio];
+        if (q.empty())
+            return nullptr;
+        lean_task_object * result = q.back();
+        q.pop_back();
+        return result;
+    }
 
-    lean_task_object * dequeue() {
-        lean_assert(m_queues_size != 0);
-        std::deque<lean_task_object *> & q = m_queues[m_max_prio];
-        lean_assert(!q.empty());
-        lean_task_object * result      = q.front();
+    lean_task_object * steal(worker_queue * w, unsigned prio) {
+        lock_guard<mutex> lock(w->m_mutex);
+        std::deque<lean_task_object *> & q = w->m_queues[prio];
+        if (q.empty())
+            return nullptr;
+        lean_task_object * result = q.front();
         q.pop_front();
-        m_queues_size--;
-        if (q.empty()) {
-            while (m_max_prio > 0) {
-                --m_max_prio;
-                if (!m_queues[m_max_prio].empty())
-                    break;
+        return result;
+    }
+
+    /* Take all tasks from the injection stack `prio`. The oldest one is returned, the others are moved to `w`. */
+    lean_task_object * take_injected(worker_queue * w, unsigned prio) {
+        lean_task_object * it = m_injected[prio].exchange(nullptr);
+        if (!it)
+            return nullptr;
+        lean_task_object * result = nullptr;
+        {
+            lock_guard<mutex> lock(w->m_mutex);
+            std::deque<lean_task_object *> & q = w->m_queues[prio];
+            /* The stack is ordered from newest to oldest, so that the owner will pop the older ones first. */
+            while (it) {
+                lean_task_object * next_it = it->m_imp->m_next_dep;
+                it->m_imp->m_next_dep = nullptr;
+                if (result)
+                    q.push_back(result);
+                result = it;
+                it = next_it;
             }
         }
         return result;
     }
 
+    /* Remove `t` from the local queue of `w` if it is there. */
+    static bool take_from(worker_queue * w, lean_task_object * t, unsigned prio) {
+        lock_guard<mutex> lock(w->m_mutex);
+        std::deque<lean_task_object *> & q = w->m_queues[prio];
+        /* `t` was most likely enqueued recently */
+        auto it = std::find(q.rbegin(), q.rend(), t);
+        if (it == q.rend())
+            return false;
+        q.erase(std::next(it).base());
+        return true;
+    }
+
+    /* Remove the task `t` from the queues if it is still queued, looking at the local queue of `w` first.
+       `m_mutex` must be held. */
+    bool take_queued(worker_queue * w, lean_task_object * t) {
+        unsigned prio = t->m_imp->m_prio;
+        if (prio > LEAN_MAX_PRIO || m_queued[prio].load() == 0)
+            return false;
+        bool found = take_from(w, t, prio);
+        unsigned num_workers = m_num_std_workers.load();
+        for (unsigned i = 1; !found && i < num_workers; i++) {
+            worker_queue * other = m_workers[(w->m_idx + i) % num_workers].load();
+            if (other)
+                found = take_from(other, t, prio);
+        }
+        if (!found) {
+            /* `t` may have been enqueued by a thread that is not a standard worker */
+            if (lean_task_object * o = take_injected(w, prio)) {
+                if (o == t) {
+                    found = true;
+                } else {
+                    lock_guard<mutex> lock(w->m_mutex);
+                    w->m_queues[prio].push_front(o);
+                }
+                found = found || take_from(w, t, prio);
+            }
+        }
+        if (found) {
+            m_queued[prio]--;
+            m_queues_size--;
+        }
+        return found;
+    }
+
+    lean_task_object * dequeue(worker_queue * w) {
+        unsigned num_workers = m_num_std_workers.load();
+        for (unsigned prio = LEAN_MAX_PRIO + 1; prio-- > 0;) {
+            if (m_queued[prio].load() == 0)
+                continue;
+            lean_task_object * result = pop_local(w, prio);
+            if (!result)
+                result = take_injected(w, prio);
+            for (unsigned i = 1; !result && i < num_workers; i++) {
+                worker_queue * victim = m_workers[(w->m_idx + i) % num_workers].load();
+                if (victim)
+                    result = steal(victim, prio);
+            }
+            if (result) {
+                m_queued[prio]--;
+                m_queues_size--;
+                return result;
+            }
+        }
+        return nullptr;
+    }
+
     void enqueue_core(lean_task_object * t) {
         lean_assert(t->m_imp);
         unsigned prio = t->m_imp->m_prio;
@@ -675,14 +1009,26 @@ class task_manager {
             spawn_dedicated_worker(t);
             return;
         }
-        if (prio > m_max_prio)
-            m_max_prio = prio;
-        m_queues[prio].push_back(t);
+        m_queued[prio]++;
         m_queues_size++;
-        if (!m_idle_std_workers && m_num_std_workers < m_max_std_workers)
-            spawn_worker();
-        else
+        if (worker_queue * w = g_worker_queue) {
+            lock_guard<mutex> lock(w->m_mutex);
+            w->m_queues[prio].push_back(t);
+        } else {
+            lean_task_object * old_head = m_injected[prio].load();
+            do {
+                t->m_imp->m_next_dep = old_head;
+            } while (!m_injected[prio].compare_exchange_strong(old_head, t));
+        }
+        if (m_idle_std_workers.load() == 0 && can_spawn_worker()) {
+            lock_guard<mutex> lock(m_park_mutex);
+            if (try_spawn_worker())
+                return;
+        }
+        if (m_sleeping_std_workers.load() > 0) {
+            lock_guard<mutex> lock(m_park_mutex);
             m_queue_cv.notify_one();
+        }
     }
 
     void deactivate_task_core(unique_lock<mutex> & lock, lean_task_object * t) {
@@ -703,29 +1049,99 @@ class task_manager {
         lock.lock();
     }
 
-    void spawn_worker() {
-        m_num_std_workers++;
-        lthread([this]() {
+    bool can_spawn_worker() {
+        return m_active_std_workers.load() < m_max_std_workers + m_blocked_waiters.load();
+    }
+
+    /* Start a worker on a stopped or unused slot. `m_park_mutex` must be held, so that no worker
+       stops concurrently (see `wait_for_work`). */
+    bool try_spawn_worker() {
+        if (!can_spawn_worker())
+            return false;
+        unsigned n = m_num_std_workers.load();
+        for (unsigned i = 0; i < n; i++) {
+            worker_queue * w = m_workers[i].load();
+            if (w->m_stopped.load()) {
+                w->m_stopped.store(false);
+                spawn_worker(w);
+                return true;
+            }
+        }
+        if (n < m_max_std_workers + LEAN_MAX_COMPENSATING_WORKERS) {
+            m_num_std_workers.store(n + 1);
+            spawn_worker(n);
+            return true;
+        }
+        return false;
+    }
+
+    /* Block until there may be queued tasks. Return false if there is no work left and the task manager
+       is shutting down or more workers are running than needed, in which case the slot of `w` has been
+       marked as stopped.
+
+       The decision to stop is made under `m_park_mutex`, and `m_active_std_workers` and
+       `m_idle_std_workers` are decremented before `m_queues_size` is checked a last time. So a
+       concurrent `enqueue_core` either sees the task counted in `m_queues_size` here, or it sees no
+       idle worker and starts a new one, which it does under `m_park_mutex` as well and thus after the
+       slot of `w` has been marked as stopped. */
+    bool wait_for_work(worker_queue * w) {
+        unique_lock<mutex> lock(m_park_mutex);
+        m_sleeping_std_workers++;
+        bool r = true;
+        if (m_queues_size.load() != 0) {
+            /* A task is being pushed or taken by another thread. If it is being pushed, `enqueue_core`
+               wakes us up, otherwise we only look again after a short time. */
+            m_queue_cv.wait_for(lock, chrono::milliseconds(1));
+        } else if (!m_shutting_down.load() &&
+                   m_active_std_workers.load() <= m_max_std_workers + m_blocked_waiters.load()) {
+            m_queue_cv.wait(lock);
+        } else {
+            m_active_std_workers--;
+            m_idle_std_workers--;
+            if (m_queues_size.load() == 0) {
+                w->m_stopped.store(true);
+                r = false;
+            } else {
+                m_idle_std_workers++;
+                m_active_std_workers++;
+            }
+        }
+        m_sleeping_std_workers--;
+        return r;
+    }
+
+    void spawn_worker(unsigned idx) {
+        lean_assert(m_workers[idx].load() == nullptr);
+        worker_queue * w = new worker_queue(idx);
+        m_workers[idx].store(w);
+        spawn_worker(w);
+    }
+
+    void spawn_worker(worker_queue * w) {
+        m_running_std_workers++;
+        m_active_std_workers++;
+        /* The new worker is counted as idle right away so that we do not spawn more workers for tasks
+           it will pick up. */
+        m_idle_std_workers++;
+        lthread([this, w]() {
             save_stack_info(false);
-            unique_lock<mutex> lock(m_mutex);
-            m_idle_std_workers++;
+            g_worker_queue = w;
             while (true) {
-                if (m_queues_size == 0) {
-                    if (m_shutting_down) {
-                        break;
+                if (lean_task_object * t = dequeue(w)) {
+                    m_idle_std_workers--;
+                    {
+                        unique_lock<mutex> lock(m_mutex);
+                        run_task(lock, t);
                     }
-                    m_queue_cv.wait(lock);
-                    continue;
+                    m_idle_std_workers++;
+                    reset_heartbeat();
+                } else if (!wait_for_work(w)) {
+                    break;
                 }
-
-                lean_task_object * t = dequeue();
-                m_idle_std_workers--;
-                run_task(lock, t);
-                m_idle_std_workers++;
-                reset_heartbeat();
             }
-            m_idle_std_workers--;
-            m_num_std_workers--;
+            g_worker_queue = nullptr;
+            unique_lock<mutex> lock(m_mutex);
+            m_running_std_workers--;
             m_worker_finished_cv.notify_all();
         });
         // `lthread` will be implicitly freed, which frees up its control resources but does not terminate the thread
@@ -787,6 +1203,21 @@ class task_manager {
         }
     }
 
+    /* Run `t` on the stack of a worker waiting in `wait_for`. */
+    void run_nested_task(unique_lock<mutex> & lock, lean_task_object * t) {
+        flet<unsigned> inc_depth(g_help_depth, g_help_depth + 1);
+        /* Heartbeats of the nested task must not be charged to the waiting one */
+        scope_heartbeat reset_hb(0);
+        run_task(lock, t);
+    }
+
+    void notify_blocked_waiters() {
+        if (m_blocked_waiters.load() > 0) {
+            lock_guard<mutex> lock(m_mutex);
+            m_task_finished_cv.notify_all();
+        }
+    }
+
     void handle_finished(lean_task_object * t) {
         lean_task_object * it = t->m_imp->m_head_dep;
         t->m_imp->m_head_dep = nullptr;
@@ -817,20 +1248,34 @@ class task_manager {
 
 public:
     task_manager(unsigned max_std_workers):
-        m_max_std_workers(max_std_workers) {
+        m_num_std_workers(0), m_running_std_workers(0), m_active_std_workers(0), m_idle_std_workers(0),
+        m_max_std_workers(max_std_workers), m_num_dedicated_workers(0),
+        m_workers(new atomic<worker_queue *>[max_std_workers + LEAN_MAX_COMPENSATING_WORKERS]),
+        m_queues_size(0), m_sleeping_std_workers(0), m_blocked_waiters(0), m_shutting_down(false) {
+        for (unsigned i = 0; i < max_std_workers + LEAN_MAX_COMPENSATING_WORKERS; i++)
+            m_workers[i].store(nullptr);
+        for (unsigned prio = 0; prio <= LEAN_MAX_PRIO; prio++) {
+            m_injected[prio].store(nullptr);
+            m_queued[prio].store(0);
+        }
     }
 
     ~task_manager() {
+        m_shutting_down.store(true);
+        {
+            lock_guard<mutex> lock(m_park_mutex);
+            m_queue_cv.notify_all();
+        }
         unique_lock<mutex> lock(m_mutex);
-        m_shutting_down = true;
-        m_queue_cv.notify_all();
         // wait for all workers to finish
-        m_worker_finished_cv.wait(lock, [&]() { return m_num_std_workers + m_num_dedicated_workers == 0; });
+        m_worker_finished_cv.wait(lock, [&]() { return m_running_std_workers.load() + m_num_dedicated_workers.load() == 0; });
+        for (unsigned i = 0; i < m_num_std_workers.load(); i++)
+            delete m_workers[i].load();
     }
 
     void enqueue(lean_task_object * t) {
-        unique_lock<mutex> lock(m_mutex);
         enqueue_core(t);
+        notify_blocked_waiters();
     }
 
     void add_dep(lean_task_object * t1, lean_task_object * t2) {
@@ -843,6 +1288,7 @@ public:
         lean_assert(t2->m_value == nullptr);
         if (t1->m_value) {
             enqueue_core(t2);
+            m_task_finished_cv.notify_all();
             return;
         }
         t2->m_imp->m_next_dep = t1->m_imp->m_head_dep;
@@ -855,7 +1301,27 @@ public:
         unique_lock<mutex> lock(m_mutex);
         if (t->m_value)
             return;
-        m_task_finished_cv.wait(lock, [&]() { return t->m_value != nullptr; });
+        worker_queue * w = g_worker_queue;
+        if (!w) {
+            m_task_finished_cv.wait(lock, [&]() { return t->m_value != nullptr; });
+            return;
+        }
+        while (!t->m_value) {
+            if (g_help_depth < LEAN_MAX_HELP_DEPTH && take_queued(w, t)) {
+                run_nested_task(lock, t);
+                continue;
+            }
+            /* Block until a task finishes or is enqueued. If no worker is idle, start another one to run
+               the queued tasks in the meantime. */
+            m_blocked_waiters++;
+            if (m_queues_size.load() != 0 && m_idle_std_workers.load() == 0) {
+                lock_guard<mutex> park_lock(m_park_mutex);
+                try_spawn_worker();
+            }
+            if (!t->m_value)
+                m_task_finished_cv.wait(lock);
+            m_blocked_waiters--;
+        }
     }
 
     object * wait_any(object * task_list) {
@@ -890,7 +1356,7 @@ public:
     }
 
     bool shutting_down() const {
-        return m_shutting_down;
+        return m_shutting_down.load();
     }
 };
 
@@ -901,6 +1367,7 @@ extern "C" LEAN_EXPORT void lean_init_task_manager_using(unsigned num_workers) {
 #if defined(LEAN_MULTI_THREAD)
     if (num_workers > 0) {
         g_task_manager = new task_manager(num_workers);
+        init_deferred_free();
     }
 #endif
 }
@@ -920,6 +1387,7 @@ extern "C" LEAN_EXPORT void lean_init_task_manager() {
 
 extern "C" LEAN_EXPORT void lean_finalize_task_manager() {
     if (g_task_manager) {
+        finalize_deferred_free();
         delete g_task_manager;
         g_task_manager = nullptr;
     }
@@ -930,12 +1398,14 @@ scoped_task_manager::scoped_task_manager(unsigned num_workers) {
 #if defined(LEAN_MULTI_THREAD)
     if (num_workers > 0) {
         g_task_manager = new task_manager(num_workers);
+        init_deferred_free();
     }
 #endif
 }
 
 scoped_task_manager::~scoped_task_manager() {
     if (g_task_manager) {
+        finalize_deferred_free();
         delete g_task_manager;
         g_task_manager = nullptr;
     }
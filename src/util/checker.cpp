@@ -0,0 +1,435 @@
+/*
+Copyright (c) 2021 Microsoft Corporation. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+*/
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <getopt.h>
+#include "runtime/thread.h"
+#include "runtime/io.h"
+#include "util/io.h"
+#include "util/name_hash_map.h"
+#include "util/name_hash_set.h"
+#include "kernel/environment.h"
+#include "kernel/kernel_exception.h"
+#include "kernel/type_checker.h"
+#include "kernel/for_each_fn.h"
+#include "initialize/init.h"
+
+/*
+Re-checker for `.olean` files.
+
+The constants stored in the given modules (and all their imports) are replayed through the kernel.
+The constants of a module are stored in no particular order, so we first sort them topologically.
+Each declaration is checked against an environment containing exactly the declarations preceding
+it in this order, so that independent declarations can be checked in parallel by the task manager.
+The constants generated by the kernel for inductive types and `Quot` must match the imported ones.
+Unsafe declarations may be mutually recursive, so they are checked against the final environment
+instead. */
+namespace lean {
+extern "C" object * lean_environment_add(object * env, object * cinfo);
+extern "C" object * lean_environment_mark_quot_init(object * env);
+extern "C" object * lean_environment_switch_constants(object * env);
+extern "C" object * lean_find_olean(object * mod, object * w);
+extern "C" object * lean_read_module_data(object * fname, object * w);
+extern "C" object * lean_init_search_path(object * w);
+extern "C" object * lean_kernel_exception_to_string(object * ex, object * opts, object * w);
+
+struct check_item {
+    name                       m_name;
+    /* Constants added to the environment for this item, e.g., an inductive type with its constructors and recursors. */
+    std::vector<constant_info> m_infos;
+    /* Constants of the same module this item depends on. */
+    std::vector<unsigned>      m_deps;
+    /* Index of the module containing this item. */
+    unsigned                   m_module_idx;
+    bool                       m_unsafe{false};
+    bool                       m_quot{false};
+    object_ref                 m_task;
+    check_item(name const & n, unsigned module_idx):m_name(n), m_module_idx(module_idx) {}
+};
+
+class checker {
+    std::vector<name>       m_modules;
+    name_hash_set           m_visited;
+    std::vector<object_ref> m_module_data;
+    std::vector<check_item> m_items;
+    std::vector<unsigned>   m_order;
+    environment             m_env;
+
+    void import_module(name const & mod) {
+        if (m_visited.find(mod) != m_visited.end())
+            return;
+        m_visited.insert(mod);
+        string_ref fname = get_io_result<string_ref>(lean_find_olean(mod.to_obj_arg(), io_mk_world()));
+        /* `ModuleData × CompactedRegion`, the region is never freed */
+        object_ref r     = get_io_result<object_ref>(lean_read_module_data(fname.to_obj_arg(), io_mk_world()));
+        object_ref data(cnstr_get(r.raw(), 0), true);
+        object * imports = cnstr_get(data.raw(), 0);
+        for (size_t i = 0; i < array_size(imports); i++) {
+            /* `structure Import where (module : Name) (runtimeOnly : Bool)` */
+            import_module(name(cnstr_get(array_get(imports, i), 0), true));
+        }
+        m_modules.push_back(mod);
+        m_module_data.push_back(data);
+    }
+
+    /* Return the name identifying the item containing the given constant. */
+    static name get_item_name(constant_info const & info, name_hash_map<constant_info> const & infos) {
+        switch (info.kind()) {
+        case constant_info_kind::Quot:
+            return name("Quot");
+        case constant_info_kind::Inductive:
+            return head(info.to_inductive_val().get_all());
+        case constant_info_kind::Recursor:
+            return head(info.to_recursor_val().get_all());
+        case constant_info_kind::Constructor: {
+            auto it = infos.find(info.to_constructor_val().get_induct());
+            if (it == infos.end())
+                throw exception(sstream() << "inductive type of constructor '" << info.get_name() << "' not found");
+            return head(it->second.to_inductive_val().get_all());
+        }
+        default:
+            return info.get_name();
+        }
+    }
+
+    void collect_deps(expr const & e, unsigned idx, name_hash_map<unsigned> const & item_of) {
+        std::vector<unsigned> & deps = m_items[idx].m_deps;
+        for_each(e, [&](expr const & c, unsigned) {
+                if (is_constant(c)) {
+                    auto it = item_of.find(const_name(c));
+                    if (it != item_of.end() && it->second != idx)
+                        deps.push_back(it->second);
+                }
+                return true;
+            });
+    }
+
+    void visit(unsigned idx, std::vector<char> & state) {
+        /* 0: not visited, 1: in progress, 2: done.
+           Cycles are only possible between unsafe declarations, which are checked against the final environment. */
+        if (state[idx] != 0)
+            return;
+        state[idx] = 1;
+        for (unsigned dep : m_items[idx].m_deps)
+            visit(dep, state);
+        state[idx] = 2;
+        m_order.push_back(idx);
+    }
+
+    void add_module_items(unsigned module_idx) {
+        object * constants = cnstr_get(m_module_data[module_idx].raw(), 1);
+        name_hash_map<constant_info> infos;
+        for (size_t i = 0; i < array_size(constants); i++) {
+            constant_info info(array_get(constants, i), true);
+            infos.insert(mk_pair(info.get_name(), info));
+        }
+        unsigned begin = m_items.size();
+        name_hash_map<unsigned> item_of;
+        for (size_t i = 0; i < array_size(constants); i++) {
+            constant_info info(array_get(constants, i), true);
+            name n = get_item_name(info, infos);
+            auto it = item_of.find(n);
+            unsigned idx;
+            if (it == item_of.end()) {
+                idx = m_items.size();
+                m_items.emplace_back(n, module_idx);
+                item_of.insert(mk_pair(n, idx));
+            } else {
+                idx = it->second;
+            }
+            m_items[idx].m_infos.push_back(info);
+            item_of.insert(mk_pair(info.get_name(), idx));
+            if (info.is_quot())
+                m_items[idx].m_quot = true;
+            if (info.is_unsafe() && !info.is_inductive() && !info.is_constructor() && !info.is_recursor())
+                m_items[idx].m_unsafe = true;
+        }
+        for (unsigned idx = begin; idx < m_items.size(); idx++) {
+            for (constant_info const & info : m_items[idx].m_infos) {
+                if (info.is_recursor())
+                    continue; // generated by the kernel
+                collect_deps(info.get_type(), idx, item_of);
+                if (info.has_value(true))
+                    collect_deps(info.get_value(true), idx, item_of);
+            }
+        }
+        /* Items of previous modules have already been ordered */
+        std::vector<char> state(m_items.size(), 2);
+        std::fill(state.begin() + begin, state.end(), 0);
+        for (unsigned idx = begin; idx < m_items.size(); idx++)
+            visit(idx, state);
+    }
+
+    /* Reconstruct the declaration that was sent to the kernel for the given item. */
+    declaration get_declaration(check_item const & item) const {
+        constant_info const & info = item.m_infos[0];
+        switch (info.kind()) {
+        case constant_info_kind::Axiom: case constant_info_kind::Definition:
+        case constant_info_kind::Theorem: case constant_info_kind::Opaque:
+            /* The first four constructors of `ConstantInfo` and `Declaration` coincide */
+            return declaration(mk_cnstr(static_cast<unsigned>(info.kind()), cnstr_get_ref(info, 0)));
+        case constant_info_kind::Quot:
+            return declaration(box(static_cast<unsigned>(declaration_kind::Quot)));
+        default:
+            break;
+        }
+        name_hash_map<constant_info> infos;
+        for (constant_info const & info : item.m_infos)
+            infos.insert(mk_pair(info.get_name(), info));
+        inductive_val const & ind = infos.find(item.m_name)->second.to_inductive_val();
+        buffer<inductive_type> types;
+        for (name const & n : ind.get_all()) {
+            inductive_val const & val = infos.find(n)->second.to_inductive_val();
+            buffer<constructor> cnstrs;
+            for (name const & c : val.get_cnstrs())
+                cnstrs.push_back(constructor(c, infos.find(c)->second.get_type()));
+            types.push_back(inductive_type(n, infos.find(n)->second.get_type(), constructors(cnstrs)));
+        }
+        return mk_inductive_decl(info.get_lparams(), nat(ind.get_nparams()), inductive_types(types), ind.is_unsafe());
+    }
+
+public:
+    checker(buffer<name> const & mods, unsigned trust_lvl):m_env(trust_lvl) {
+        for (name const & mod : mods)
+            import_module(mod);
+        for (unsigned i = 0; i < m_module_data.size(); i++)
+            add_module_items(i);
+    }
+
+    unsigned num_modules() const { return m_modules.size(); }
+    unsigned num_items() const { return m_items.size(); }
+
+    void spawn_checks();
+    int report(std::ostream & out, options const & opts, double threshold_ms);
+};
+
+/* Return true iff the imported constant `a` is structurally equal to the constant `b` generated by the kernel. */
+static bool is_same_constant(constant_info const & a, constant_info const & b) {
+    if (a.kind() != b.kind() || a.get_name() != b.get_name() || a.get_lparams() != b.get_lparams() ||
+        !is_bi_equal(a.get_type(), b.get_type()) || a.is_unsafe() != b.is_unsafe())
+        return false;
+    switch (a.kind()) {
+    case constant_info_kind::Quot:
+        return a.to_quot_val().get_quot_kind() == b.to_quot_val().get_quot_kind();
+    case constant_info_kind::Inductive: {
+        inductive_val const & v1 = a.to_inductive_val();
+        inductive_val const & v2 = b.to_inductive_val();
+        return
+            v1.get_nparams() == v2.get_nparams() && v1.get_nindices() == v2.get_nindices() &&
+            v1.get_all() == v2.get_all() && v1.get_cnstrs() == v2.get_cnstrs() && v1.is_rec() == v2.is_rec() &&
+            v1.is_reflexive() == v2.is_reflexive() && v1.is_nested() == v2.is_nested();
+    }
+    case constant_info_kind::Constructor: {
+        constructor_val const & v1 = a.to_constructor_val();
+        constructor_val const & v2 = b.to_constructor_val();
+        return
+            v1.get_induct() == v2.get_induct() && v1.get_cidx() == v2.get_cidx() &&
+            v1.get_nparams() == v2.get_nparams() && v1.get_nfields() == v2.get_nfields();
+    }
+    case constant_info_kind::Recursor: {
+        recursor_val const & v1 = a.to_recursor_val();
+        recursor_val const & v2 = b.to_recursor_val();
+        if (v1.get_all() != v2.get_all() || v1.get_nparams() != v2.get_nparams() ||
+            v1.get_nindices() != v2.get_nindices() || v1.get_nmotives() != v2.get_nmotives() ||
+            v1.get_nminors() != v2.get_nminors() || v1.is_k() != v2.is_k() ||
+            length(v1.get_rules()) != length(v2.get_rules()))
+            return false;
+        recursor_rules rs = v2.get_rules();
+        for (recursor_rule const & r : v1.get_rules()) {
+            recursor_rule const & r2 = head(rs);
+            if (r.get_cnstr() != r2.get_cnstr() || r.get_nfields() != r2.get_nfields() ||
+                !is_bi_equal(r.get_rhs(), r2.get_rhs()))
+                return false;
+            rs = tail(rs);
+        }
+        return true;
+    }
+    default:
+        /* Other constants are added as they are given to the kernel, and `get_declaration` builds the declaration
+           from the imported constant. */
+        return true;
+    }
+}
+
+/* Check that adding the declaration of an item to the kernel produced exactly its imported constants. In particular,
+   the recursors, constructors and `Quot` constants stored in the `.olean` file must be the ones the kernel generates. */
+static void check_added_constants(environment const & env, list_ref<constant_info> const & infos) {
+    for (constant_info const & info : infos) {
+        optional<constant_info> added = env.find(info.get_name());
+        if (!added)
+            throw kernel_exception(env, sstream() << "imported constant '" << info.get_name() << "' is not generated by the kernel");
+        if (!is_same_constant(info, *added))
+            throw kernel_exception(env, sstream() << "imported constant '" << info.get_name() << "' differs from the one generated by the kernel");
+    }
+}
+
+/* Closure body of the tasks created by `checker::spawn_checks`.
+   Returns a pair `(Except KernelException Unit) × UInt64` with the elapsed time in nanoseconds. */
+static obj_res check_item_task(obj_arg env, obj_arg d, obj_arg infos, obj_arg unsafe, obj_arg /* unit */) {
+    environment e(env);
+    declaration decl(d);
+    list_ref<constant_info> cinfos(infos);
+    auto start = std::chrono::steady_clock::now();
+    object * r;
+    try {
+        r = catch_kernel_exceptions<object_ref>([&]() {
+                if (unbox(unsafe)) {
+                    /* The declaration is already in `e`, so we do not use `environment::add` here */
+                    constant_info info(decl);
+                    type_checker checker(e, /* safe_only */ false);
+                    check_no_metavar_no_fvar(e, info.get_name(), info.get_type());
+                    checker.ensure_sort(checker.check(info.get_type(), info.get_lparams()), info.get_type());
+                    if (info.has_value(true)) {
+                        expr val = info.get_value(true);
+                        check_no_metavar_no_fvar(e, info.get_name(), val);
+                        expr val_type = checker.check(val, info.get_lparams());
+                        if (!checker.is_def_eq(val_type, info.get_type()))
+                            throw definition_type_mismatch_exception(e, decl, val_type);
+                    }
+                } else {
+                    check_added_constants(e.add(decl), cinfos);
+                }
+                return object_ref(box(0));
+            });
+    } catch (throwable & ex) {
+        // `KernelException.other`, e.g. on deep recursion
+        r = mk_cnstr(0, mk_cnstr(11, string_ref(ex.what()))).steal();
+    }
+    uint64 ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    return mk_cnstr(0, r, box_uint64(ns)).steal();
+}
+
+static void spawn_check(check_item & item, environment const & env, declaration const & decl) {
+    object * c = lean_alloc_closure(reinterpret_cast<void *>(check_item_task), 5, 4);
+    lean_closure_set(c, 0, env.to_obj_arg());
+    lean_closure_set(c, 1, decl.to_obj_arg());
+    lean_closure_set(c, 2, list_ref<constant_info>(item.m_infos.begin(), item.m_infos.end()).steal());
+    lean_closure_set(c, 3, box(item.m_unsafe));
+    item.m_task = object_ref(task_spawn(c));
+}
+
+void checker::spawn_checks() {
+    /* Replay all constants without checking them, checking each declaration against the environment built so far.
+       The constant map is moved to its persistent stage first: the environment captured by each task then shares all
+       but O(log n) nodes with the next one, instead of forcing the next `lean_environment_add` to copy the whole hash
+       map. */
+    environment env(lean_environment_switch_constants(m_env.to_obj_arg()));
+    for (unsigned idx : m_order) {
+        check_item & item = m_items[idx];
+        if (!item.m_unsafe)
+            spawn_check(item, env, get_declaration(item));
+        for (constant_info const & info : item.m_infos)
+            env = environment(lean_environment_add(env.steal(), info.to_obj_arg()));
+        if (item.m_quot)
+            env = environment(lean_environment_mark_quot_init(env.steal()));
+    }
+    for (unsigned idx : m_order) {
+        check_item & item = m_items[idx];
+        if (item.m_unsafe)
+            spawn_check(item, env, get_declaration(item));
+    }
+}
+
+int checker::report(std::ostream & out, options const & opts, double threshold_ms) {
+    unsigned num_failed = 0;
+    double total_ms     = 0;
+    for (unsigned idx : m_order) {
+        check_item const & item = m_items[idx];
+        object * r       = task_get(item.m_task.raw());
+        object * except  = cnstr_get(r, 0);
+        double ms        = static_cast<double>(unbox_uint64(cnstr_get(r, 1))) / 1000000.0;
+        total_ms += ms;
+        if (ms >= threshold_ms)
+            out << std::fixed << std::setprecision(3) << std::setw(12) << ms << " ms  " << item.m_name << "\n";
+        if (cnstr_tag(except) == 0) {
+            num_failed++;
+            object * ex = cnstr_get(except, 0);
+            inc(ex);
+            string_ref msg = get_io_result<string_ref>(lean_kernel_exception_to_string(ex, opts.to_obj_arg(), io_mk_world()));
+            std::cerr << m_modules[item.m_module_idx] << ": error: " << item.m_name << ": " << msg.data() << "\n";
+        }
+    }
+    out << "checked " << m_order.size() << " declarations from " << m_modules.size() << " modules, "
+        << std::fixed << std::setprecision(3) << total_ms << " ms total check time";
+    if (num_failed > 0)
+        out << ", " << num_failed << " failed";
+    out << "\n";
+    return num_failed > 0 ? 1 : 0;
+}
+}
+
+using namespace lean; // NOLINT
+
+static void display_checker_help(std::ostream & out) {
+    out << "Usage: leanchecker [options] Module...\n";
+    out << "Type checks again all declarations of the given modules and their imports\n";
+    out << "  --help -h          display this message\n";
+#if defined(LEAN_MULTI_THREAD)
+    out << "  --threads=num -j   number of threads used to check declarations\n";
+#endif
+    out << "  --threshold=ms -t  only report declarations whose check took at least this many milliseconds\n";
+}
+
+static struct option g_checker_long_options[] = {
+    {"help",         no_argument,       0, 'h'},
+    {"threshold",    required_argument, 0, 't'},
+#if defined(LEAN_MULTI_THREAD)
+    {"threads",      required_argument, 0, 'j'},
+#endif
+    {0, 0, 0, 0}
+};
+
+extern "C" LEAN_EXPORT int lean_checker_main(int argc, char ** argv) {
+    lean::initializer init;
+    unsigned num_threads = 0;
+#if defined(LEAN_MULTI_THREAD)
+    num_threads = hardware_concurrency();
+#endif
+    double threshold_ms = 0;
+    while (true) {
+        int c = getopt_long(argc, argv, "ht:j:", g_checker_long_options, NULL);
+        if (c == -1)
+            break; // end of command line
+        switch (c) {
+        case 'h':
+            display_checker_help(std::cout);
+            return 0;
+        case 't':
+            threshold_ms = atof(optarg);
+            break;
+        case 'j':
+            num_threads = static_cast<unsigned>(atoi(optarg));
+            break;
+        default:
+            display_checker_help(std::cerr);
+            return 1;
+        }
+    }
+    if (optind >= argc) {
+        std::cerr << "Expected at least one module name\n";
+        display_checker_help(std::cerr);
+        return 1;
+    }
+    buffer<name> mods;
+    for (int i = optind; i < argc; i++)
+        mods.push_back(string_to_name(argv[i]));
+
+    scoped_task_manager scope_task_man(num_threads);
+    try {
+        get_io_scalar_result<unsigned>(lean_init_search_path(io_mk_world()));
+        checker chk(mods, /* trust_lvl */ 0);
+        chk.spawn_checks();
+        return chk.report(std::cout, options(), threshold_ms);
+    } catch (lean::throwable & ex) {
+        std::cerr << ex.what() << "\n";
+    } catch (std::bad_alloc & ex) {
+        std::cerr << "out of memory" << std::endl;
+    }
+    return 1;
+}
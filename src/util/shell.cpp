@@ -27,6 +27,7 @@ Author: Leonardo de Moura
 #include "util/option_declarations.h"
 #include "kernel/environment.h"
 #include "kernel/kernel_exception.h"
+#include "kernel/type_checker.h"
 #include "library/formatter.h"
 #include "library/module.h"
 #include "library/time_task.h"
@@ -671,6 +672,7 @@ extern "C" LEAN_EXPORT int lean_main(int argc, char ** argv) {
 
         if (stats) {
             env.display_stats();
+            display_type_checker_cache_stats(std::cout);
         }
 
         if (run && ok) {
@@ -680,7 +682,7 @@ extern "C" LEAN_EXPORT int lean_main(int argc, char ** argv) {
         }
         if (olean_fn && ok) {
             time_task t(".olean serialization", opts);
-            write_module(env, *olean_fn);
+            write_module(env, *olean_fn, opts);
         }
 
         if (c_output && ok) {
@@ -0,0 +1,29 @@
+import Lean
+
+/-
+`instantiate` and `abstract` on large DAG-shaped terms. Every node of layer `k+1` refers to two nodes of
+layer `k`, so the term has a small number of distinct subterms, but exponentially many paths. The traversal
+caches of `replace` must keep the nodes of a whole layer to avoid exponential rework.
+-/
+
+open Lean
+
+def width := 20000
+def depth := 24
+
+def mkLayer (f : Expr) (prev : Array Expr) : Array Expr :=
+  (Array.range prev.size).map fun i => mkApp2 f (prev.get! i) (prev.get! ((i * 7 + 1) % prev.size))
+
+def mkDag (leaf : Nat → Expr) : Expr := Id.run do
+  let f := mkConst `f
+  let mut layer := (Array.range width).map leaf
+  for _ in [0:depth] do
+    layer := mkLayer f layer
+  return mkAppN (mkConst `g) layer
+
+def main : IO Unit := do
+  let x := mkFVar ⟨`x⟩
+  let e := mkDag fun i => mkApp2 (mkConst `h) (mkBVar 0) (mkRawNatLit i)
+  let e' := e.instantiate1 x
+  let e'' := e'.abstract #[x]
+  IO.println s!"{e'.hash} {e''.hash == e.hash}"
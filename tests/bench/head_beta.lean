@@ -0,0 +1,21 @@
+/-
+Elaboration and kernel checking of terms whose weak head normal form is reached through long chains of
+beta-redexes (continuation-passing style), exercising `Expr.headBeta` and `whnf_core`.
+-/
+
+def cps (n : Nat) : (Nat → (Nat → Nat) → Nat) :=
+  fun a k => k (a + n)
+
+def chain : Nat → Nat → (Nat → Nat) → Nat
+  | 0,   a, k => k a
+  | n+1, a, k => cps n a (fun b => chain n b k)
+
+theorem chain_eq : chain 200 0 id = 19900 := by decide
+
+def church (n : Nat) : (α : Type) → (α → α) → α → α :=
+  fun _ f x => Nat.repeat f n x
+
+theorem church_eq : (fun (g : Nat → Nat) (x : Nat) => church 1000 Nat g x) (· + 1) 0 = 1000 := by decide
+
+set_option maxRecDepth 10000 in
+example : (List.range 300).foldr (fun i (k : Nat → Nat) => fun a => k (a + i)) id 0 = 44850 := by decide
@@ -0,0 +1,26 @@
+/-
+Arithmetic-heavy loops for the IR interpreter (`lean --run`): `Nat` and `UInt64` primitives, tail calls and
+join points, with almost no allocation.
+-/
+
+partial def collatzSteps (n : Nat) (acc : Nat) : Nat :=
+  if n ≤ 1 then acc
+  else if n % 2 == 0 then collatzSteps (n / 2) (acc + 1)
+  else collatzSteps (3 * n + 1) (acc + 1)
+
+def mix (x : UInt64) : UInt64 :=
+  let x := x ^^^ (x >>> 33)
+  let x := x * 0xff51afd7ed558ccd
+  x ^^^ (x >>> 33)
+
+def hashLoop : Nat → UInt64 → UInt64
+  | 0,     h => h
+  | n + 1, h => hashLoop n (mix (h + n.toUInt64))
+
+def main (args : List String) : IO Unit := do
+  let n := (args.head? >>= String.toNat?).getD 200000
+  let mut total := 0
+  for i in [1:n] do
+    total := total + collatzSteps i 0
+  IO.println total
+  IO.println (hashLoop (n * 10) 0)
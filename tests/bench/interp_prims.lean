@@ -0,0 +1,33 @@
+/-
+Primitive-heavy loops for the IR interpreter (`lean --run`): `UInt64`, `Float`, `Nat` and `Array` operations that are
+executed as `Prim` instructions. The same program is also compiled, so its interpreted and native times can be
+compared.
+-/
+
+def u64Loop : Nat → UInt64 → UInt64
+  | 0,     acc => acc
+  | n + 1, acc => u64Loop n ((acc * 6364136223846793005 + 1442695040888963407) ^^^ (acc >>> 29))
+
+def floatLoop : Nat → Float → Float → Float
+  | 0,     x, acc => acc
+  | n + 1, x, acc => floatLoop n (x + 0.5) (acc + x * x / (x + 1.0))
+
+def natLoop : Nat → Nat → Nat
+  | 0,     acc => acc
+  | n + 1, acc => natLoop n ((acc + n * 3) % 1000003)
+
+def arrayLoop (n : Nat) : Nat := Id.run do
+  let mut a : Array Nat := #[]
+  for i in [0:n] do
+    a := a.push (i % 97)
+  let mut s := 0
+  for i in [0:a.size] do
+    s := s + a.get! i
+  return s
+
+def main (args : List String) : IO Unit := do
+  let n := (args.head? >>= String.toNat?).getD 2000000
+  IO.println (u64Loop (n * 5) 1)
+  IO.println (floatLoop n 0.0 0.0)
+  IO.println (natLoop (n * 5) 0)
+  IO.println (arrayLoop n)
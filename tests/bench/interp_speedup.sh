@@ -0,0 +1,36 @@
+#!/usr/bin/env bash
+# Compare the IR interpreters (`lean --run`) of two Lean builds on the interpreter benchmarks, e.g. to check the
+# speedup of the bytecode interpreter against a build of its parent commit:
+#   ./interp_speedup.sh <baseline>/bin/lean [<new>/bin/lean] [runs]
+set -euo pipefail
+ulimit -s unlimited
+
+base=$1
+new=${2:-lean}
+runs=${3:-3}
+
+# minimum wall-clock time in seconds of `runs` runs of `$@`
+best_time() {
+  local best=
+  for _ in $(seq "$runs"); do
+    local t
+    t=$( { TIMEFORMAT=%R; time "$@" > /dev/null; } 2>&1 )
+    if [[ -z $best ]] || awk "BEGIN { exit !($t < $best) }"; then best=$t; fi
+  done
+  echo "$best"
+}
+
+printf '%-20s %10s %10s %8s\n' benchmark baseline new speedup
+log_sum=0
+n=0
+for f in interp_arith.lean interp_tree.lean interp_prims.lean *.lean.args; do
+  f=${f%.args}
+  args=()
+  if [[ -f $f.args ]]; then read -ra args < "$f.args" || true; fi
+  tb=$(best_time "$base" --run "$f" "${args[@]}")
+  tn=$(best_time "$new" --run "$f" "${args[@]}")
+  printf '%-20s %9ss %9ss %7sx\n' "${f%.lean}" "$tb" "$tn" "$(awk "BEGIN { printf \"%.2f\", $tb / $tn }")"
+  log_sum=$(awk "BEGIN { print $log_sum + log($tb / $tn) }")
+  n=$((n + 1))
+done
+printf '%-20s %10s %10s %7sx\n' "geometric mean" "" "" "$(awk "BEGIN { printf \"%.2f\", exp($log_sum / $n) }")"
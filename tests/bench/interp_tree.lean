@@ -0,0 +1,36 @@
+/-
+Allocation- and `case`-heavy code for the IR interpreter (`lean --run`): an unbalanced search tree over a
+pseudo-random key sequence, destructed with pattern matching.
+-/
+
+inductive Tree where
+  | leaf
+  | node (l : Tree) (k : Nat) (v : Bool) (r : Tree)
+
+namespace Tree
+
+def insert : Tree → Nat → Bool → Tree
+  | leaf,         k, v => node leaf k v leaf
+  | node l k' v' r, k, v =>
+    if k < k' then node (insert l k v) k' v' r
+    else if k' < k then node l k' v' (insert r k v)
+    else node l k v r
+
+def fold (f : Nat → Bool → Nat → Nat) : Tree → Nat → Nat
+  | leaf,         acc => acc
+  | node l k v r, acc => fold f r (f k v (fold f l acc))
+
+end Tree
+
+def mkTree (n : Nat) : Tree := Id.run do
+  let mut t := Tree.leaf
+  let mut x := 17
+  for _ in [0:n] do
+    x := (x * 1103515245 + 12345) % 2147483648
+    t := t.insert (x % (4 * n)) (x % 3 == 0)
+  return t
+
+def main (args : List String) : IO Unit := do
+  let n := (args.head? >>= String.toNat?).getD 200000
+  let t := mkTree n
+  IO.println (t.fold (fun k v acc => if v then acc + k else acc) 0)
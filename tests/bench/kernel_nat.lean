@@ -0,0 +1,18 @@
+/-
+Kernel reduction of `Nat` primitives on literals.
+Without special support in `type_checker::reduce_nat`, these proofs unfold the
+well-founded/structural definitions of the primitives and do not finish in reasonable time.
+-/
+
+def big1 : Nat := 2^4000 + 1234567
+def big2 : Nat := 3^2500 + 7654321
+
+theorem gcd_big : Nat.gcd (big1 * 1000003) (big2 * 1000003) % 1000003 = 0 := by decide
+theorem land_big : Nat.land big1 big2 < big1 := by decide
+theorem lor_big : Nat.lor big1 big2 ≥ big2 := by decide
+theorem xor_big : Nat.xor (Nat.xor big1 big2) big2 = big1 := by decide
+theorem shift_big : Nat.shiftRight (Nat.shiftLeft big1 5000) 5000 = big1 := by decide
+theorem pow_big : 7^3000 % 10 = 1 := by decide
+theorem log2_big : Nat.log2 big1 = 4000 := by decide
+
+theorem many : (List.range 200).all (fun i => Nat.gcd (2^i * 3) (2^(i+1)) == 2^i) = true := by decide
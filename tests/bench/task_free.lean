@@ -0,0 +1,35 @@
+/-
+Benchmark for freeing objects on a different thread than the one that allocated them.
+Each round, `n` tasks build trees on worker threads, which are then checked and freed
+by the main thread.
+-/
+inductive Tree
+| Nil
+| Node (l r : Tree) : Tree
+open Tree
+
+-- This Function has an extra argument to suppress the
+-- common sub-expression elimination optimization
+partial def make' : UInt32 -> UInt32 -> Tree
+| n, d =>
+  if d = 0 then Node Nil Nil
+  else Node (make' n (d - 1)) (make' (n + 1) (d - 1))
+
+def check : Tree → UInt32
+| Nil => 0
+| Node l r   => 1 + check l + check r
+
+def round (n : Nat) (d : UInt32) : Nat :=
+  let ts := (List.range n).map fun i => Task.spawn fun _ => make' (UInt32.ofNat i) d;
+  ts.foldl (fun s t => s + (check t.get).toNat) 0
+
+def main : List String → IO UInt32
+| [n, d, r] => do
+  let n := n.toNat!;
+  let d := UInt32.ofNat d.toNat!;
+  let mut s := 0;
+  for _ in [0:r.toNat!] do
+    s := s + round n d;
+  IO.println ("checked " ++ toString s ++ " nodes");
+  pure 0
+| _ => pure 1
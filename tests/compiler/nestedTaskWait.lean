@@ -0,0 +1,14 @@
+-- Every task waits for the tasks it spawned; the workers must keep running queued tasks while waiting
+partial def fib (n : Nat) : Nat :=
+  if n < 2 then n
+  else
+    let t₁ := Task.spawn fun _ => fib (n - 1)
+    let t₂ := Task.spawn fun _ => fib (n - 2)
+    t₁.get + t₂.get
+
+def main : IO Unit := do
+  IO.println (fib 20)
+  let t ← IO.asTask do
+    let ts ← (List.range 100).mapM fun i => IO.asTask (pure (fib (i % 15)))
+    ts.foldlM (fun acc t => do return acc + (← IO.ofExcept (← IO.wait t))) 0
+  IO.println (← IO.ofExcept (← IO.wait t))
@@ -0,0 +1,12 @@
+-- `z` is queued while the worker running `x` is blocked in `Task.get`, and waits for `x` in turn.
+-- Running `z` on the stack of that worker would make it wait for itself.
+def main : IO Unit := do
+  let x ← IO.asTask do
+    let y ← IO.asTask (prio := Task.Priority.dedicated) do
+      IO.sleep 100
+      return 1
+    IO.ofExcept (← IO.wait y)
+  IO.sleep 10
+  let z ← IO.asTask do
+    return (← IO.ofExcept (← IO.wait x)) + 1
+  IO.println (← IO.ofExcept (← IO.wait z))
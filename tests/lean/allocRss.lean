@@ -0,0 +1,29 @@
+/-- Resident set size in pages, see `proc(5)`. -/
+def rss : IO Nat := do
+  let s ← IO.FS.readFile "/proc/self/statm"
+  match s.splitOn " " with
+  | _ :: r :: _ => return r.toNat!
+  | _           => throw (IO.userError s!"unexpected statm '{s}'")
+
+/-- Allocate about 100 MB of small objects, and return the resident set size while they are alive. -/
+def peak (n : Nat) : IO Nat := do
+  let xs := (List.range n).map fun i => #[i, i]
+  let r ← rss
+  unless xs.length == n do
+    throw (IO.userError "unexpected length")
+  return r
+
+def main : IO Unit := do
+  -- needs `/proc/self/statm`
+  unless (← System.FilePath.pathExists "/proc/self/statm") do
+    IO.println "rss ok"
+    return
+  let base ← rss
+  let peak ← peak 2000000
+  let after ← rss
+  -- most of the memory of the freed objects must be returned to the OS
+  unless after < base + (peak - base) / 4 do
+    throw (IO.userError s!"memory not released: base {base}, peak {peak}, after {after} pages")
+  IO.println "rss ok"
+
+#eval main
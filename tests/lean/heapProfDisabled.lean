@@ -0,0 +1,7 @@
+-- without `LEAN_HEAPPROF`, no heap profile can be written
+#eval show IO Unit from do
+  try
+    IO.heapProfDump "heapProfDisabled.pb"
+    IO.println "heap profile written"
+  catch e =>
+    IO.println e
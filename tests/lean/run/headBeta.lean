@@ -0,0 +1,51 @@
+import Lean
+
+open Lean
+
+-- `Expr.headBeta` and `Expr.instantiateHeadBeta` are implemented natively, compare them with `Expr.betaRev`
+
+partial def refHeadBeta (e : Expr) : Expr :=
+  let f := e.getAppFn
+  if f.isHeadBetaTargetFn false then refHeadBeta (f.betaRev e.getAppRevArgs) else e
+
+def nat := mkConst ``Nat
+def f := mkConst ``Nat.succ
+def x := mkRawNatLit 1
+def y := mkRawNatLit 2
+
+def check (e : Expr) : IO Unit := do
+  unless e.headBeta == refHeadBeta e do
+    throw <| IO.userError s!"headBeta failed: {e.headBeta} != {refHeadBeta e}"
+
+-- `fun g a => g a`
+def app := mkLambda `g BinderInfo.default (mkForall `a BinderInfo.default nat nat) (mkLambda `a BinderInfo.default nat (mkApp (mkBVar 1) (mkBVar 0)))
+-- `fun a => a`
+def id' := mkLambda `a BinderInfo.default nat (mkBVar 0)
+-- `fun a b => b`
+def snd := mkLambda `a BinderInfo.default nat (mkLambda `b BinderInfo.default nat (mkBVar 0))
+-- `fun a => fun b => Nat.add a (fun c => c) b`
+def add := mkLambda `a BinderInfo.default nat (mkLambda `b BinderInfo.default nat (mkAppN (mkConst ``Nat.add) #[mkBVar 1, mkApp id' (mkBVar 0)]))
+
+#eval check (mkAppN app #[f, x])
+#eval check (mkAppN app #[id', x])
+#eval check (mkAppN app #[app, id', x])
+#eval check (mkAppN app #[mkApp app id', x])
+#eval check (mkAppN snd #[x, y])
+#eval check (mkAppN snd #[x])
+#eval check (mkAppN snd #[x, id', y])
+#eval check (mkAppN (mkMData {} snd) #[x, mkMData {} id', y])
+#eval check (mkAppN add #[x, y])
+#eval check (mkAppN add #[x])
+#eval check (mkApp (mkBVar 3) x)
+#eval check (mkAppN snd #[mkBVar 0, mkBVar 1])
+#eval check (mkAppN (mkLambda `a BinderInfo.default nat (mkApp (mkBVar 1) (mkBVar 0))) #[x, y])
+
+def checkInst (e : Expr) (subst : Array Expr) : IO Unit := do
+  unless e.instantiateHeadBeta subst == (e.instantiate subst).headBeta do
+    throw <| IO.userError s!"instantiateHeadBeta failed: {e.instantiateHeadBeta subst}"
+
+#eval checkInst (mkApp (mkBVar 0) x) #[id']
+#eval checkInst (mkApp (mkBVar 1) (mkBVar 0)) #[y, app]
+#eval checkInst (mkAppN (mkBVar 0) #[mkBVar 2, x]) #[snd]
+#eval checkInst (mkLambda `a BinderInfo.default nat (mkApp (mkBVar 1) (mkBVar 0))) #[f]
+#eval checkInst (mkBVar 1) #[x]
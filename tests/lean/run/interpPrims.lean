@@ -0,0 +1,45 @@
+-- Calls of `lean.h` primitives are executed directly by the interpreter; the results must match the native code.
+def check (b : Bool) : IO Unit :=
+  unless b do throw (IO.userError "check failed")
+
+def natOps (a b : Nat) : List Nat :=
+  [a + b, a - b, b - a, a * b, a / b, a % b, a / 0, a &&& b, a ||| b, a ^^^ b, a <<< 3, a >>> 2]
+
+def u8Ops (a b : UInt8) : List UInt8 :=
+  [a + b, a - b, a * b, a / b, a % b, a / 0, a &&& b, a ||| b, a ^^^ b, a <<< b, a >>> b, ~~~a]
+
+def u64Ops (a b : UInt64) : List UInt64 :=
+  [a + b, a - b, a * b, a / b, a % b, a &&& b, a ||| b, a ^^^ b, a <<< b, a >>> b, ~~~a]
+
+def usizeOps (a b : USize) : List USize :=
+  [a + b, a - b, a * b, a / b, a % b, a <<< b, a >>> b]
+
+def arrOps (n : Nat) : Array Nat := Id.run do
+  let mut a := #[]
+  for i in [0:n] do
+    a := a.push (i * i)
+  a := a.set! 3 100
+  return a.push (a.get! 4 + a.size)
+
+#eval check (natOps 1000000000000000000000 37 == [1000000000000000000037, 999999999999999999963, 0, 37000000000000000000000,
+  27027027027027027027, 1, 0, 0, 1000000000000000000037, 1000000000000000000037, 8000000000000000000000,
+  250000000000000000000])
+#eval check (u8Ops 200 9 == [209, 191, 8, 22, 2, 0, 8, 201, 193, 144, 100, 55])
+#eval check (u64Ops 0xFFFFFFFFFFFFFFFF 3 == [2, 0xFFFFFFFFFFFFFFFC, 0xFFFFFFFFFFFFFFFD, 0x5555555555555555, 0, 3,
+  0xFFFFFFFFFFFFFFFF, 0xFFFFFFFFFFFFFFFC, 0xFFFFFFFFFFFFFFF8, 0x1FFFFFFFFFFFFFFF, 0])
+#eval check (usizeOps 100 3 == [103, 97, 300, 33, 1, 800, 12])
+#eval check ((UInt32.ofNat 70000).toNat == 70000 && (UInt16.ofNat 70000).toNat == 4464 && (300 : UInt64) < 301)
+#eval check (arrOps 8 == #[0, 1, 4, 100, 16, 25, 36, 49, 24])
+#eval check ((2.5 : Float) * 4 - 1 == 9 && -(1.5 : Float) + 3 / 2 == 0)
+#eval check (("ab" ++ "cdé").length == 5 && "é".utf8ByteSize == 2)
+
+-- primitives are found by the C function implementing an `@[extern]` declaration, so declarations of this module are
+-- executed in place even though their (inline) C functions cannot be looked up as native symbols
+@[extern "lean_nat_add"]
+constant myAdd (a b : @& Nat) : Nat
+
+-- the irrelevant parameter `α` is dropped
+@[extern "lean_array_get_size"]
+constant mySize {α : Type} (a : @& Array α) : Nat
+
+#eval check (myAdd 2 3 == 5 && mySize #[1, 2, 3] == 3)
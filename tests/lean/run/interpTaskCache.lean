@@ -0,0 +1,36 @@
+-- Interpreted closures called from tasks and from compiled code reuse the interpreter caches
+-- of imported declarations, but must still see the declarations of the current module.
+import Lean
+
+def double (n : Nat) : Nat := n * 2
+
+def table : Array Nat := (List.range 50).toArray.map double
+
+def sumTasks (k : Nat) : Nat :=
+  let ts := (List.range k).map fun i => Task.spawn fun _ => (table.map (· + i)).foldl (· + ·) 0
+  ts.foldl (fun acc t => acc + t.get) 0
+
+#eval sumTasks 8
+
+theorem ex : sumTasks 8 = sumTasks 8 := rfl
+
+#eval (List.range 10).map (fun i => (Task.spawn fun _ => double i + table.size).get)
+
+def main : IO Unit := do
+  let t ← IO.asTask (pure (table.foldl (· + ·) 0))
+  match t.get with
+  | Except.ok v    => IO.println v
+  | Except.error e => throw e
+
+#eval main
+
+-- every task runs in a new interpreter, which finds the entries of `Array.map` etc. created by the first one
+def checkReuse : IO Unit := do
+  let before ← Lean.IR.getInterpreterSharedCacheHits
+  let ts := (List.range 4).map fun i => Task.spawn fun _ => (table.map (· + i)).foldl (· + ·) 0
+  let s := ts.foldl (fun acc t => acc + t.get) 0
+  let after ← Lean.IR.getInterpreterSharedCacheHits
+  unless s == 4 * 2450 + 50 * 6 && after > before do
+    throw (IO.userError s!"shared interpreter cache not reused: {before} {after} {s}")
+
+#eval checkReuse
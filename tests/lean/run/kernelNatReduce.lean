@@ -0,0 +1,13 @@
+-- The kernel and `whnf` reduce these `Nat` primitives on literals using GMP instead of unfolding them
+
+theorem ex1 : Nat.gcd (123456789012345678901234567890 * 97) (987654321098765432109876543210 * 97) = 873000000087300000008730 := rfl
+theorem ex2 : Nat.land (2^200 + 12345) (3^120 + 7) = 40 := rfl
+theorem ex3 : Nat.lor (2^200 + 12345) (3^120 + 7) = 1608735054558904706752375272170672207561934469410330686420089 := rfl
+theorem ex4 : Nat.xor (2^200 + 12345) (3^120 + 7) = 1608735054558904706752375272170672207561934469410330686420049 := rfl
+theorem ex5 : Nat.shiftLeft (2^200 + 12345) 100 = 2037035976334486086268445688409378161051468393665936250651789596014198791724813507253764096 := rfl
+theorem ex6 : Nat.shiftRight (2^200 + 12345) 150 = 1125899906842624 := rfl
+theorem ex7 : 3^100 = 515377520732011331036461129765621272702107522001 := rfl
+theorem ex8 : Nat.log2 (10^50) = 166 := rfl
+theorem ex9 : Nat.gcd 0 5 = 5 ∧ Nat.log2 0 = 0 ∧ Nat.shiftRight 5 (2^70) = 0 := by decide
+
+example : Nat.gcd 1000000007 998244353 = 1 := by decide
@@ -0,0 +1,43 @@
+import Lean
+
+-- `whnf` and `infer_type` results for closed terms over imported constants are shared between declarations.
+-- Terms mentioning local constants must not be served from the shared caches.
+
+def f (n : Nat) : Nat := n + 1
+
+theorem ex1 : (10 : Nat) < 20 := by decide
+theorem ex2 : (10 : Nat) < 20 := by decide
+theorem ex3 : [1, 2, 3].length = 3 := rfl
+theorem ex4 : [1, 2, 3].length = 3 := rfl
+theorem ex5 : f 2 = 3 := rfl
+
+namespace Foo
+def f (n : Nat) : Nat := n + 2
+theorem ex6 : f 2 = 4 := rfl
+end Foo
+
+theorem ex7 : (fun x => f x) 2 = 3 := rfl
+
+def big : Nat := (List.range 100).foldl (· + ·) 0
+theorem ex8 : (List.range 100).foldl (· + ·) 0 = 4950 := by decide
+theorem ex9 : big = 4950 := by decide
+
+-- closed terms with the same structure but different imported constants must not be confused
+theorem ex10 : Nat.add 2 3 = 5 := rfl
+theorem ex11 : Nat.mul 2 3 = 6 := rfl
+theorem ex12 : Nat.sub 2 3 = 0 := rfl
+theorem ex13 : (List.replicate 3 0).length = 3 := rfl
+theorem ex14 : (List.range 3).length = 3 := rfl
+theorem ex15 : (List.range 3).reverse = [2, 1, 0] := rfl
+theorem ex16 : (List.iota 3) = [3, 2, 1] := rfl
+
+-- checking a closed theorem again reuses the results stored in the shared caches
+open Lean in
+#eval show CoreM Unit from do
+  let info ← getConstInfo ``ex3
+  let hits ← Kernel.getSharedCacheHits
+  match (← getEnv).addDecl (Declaration.thmDecl { name := `ex3', levelParams := [], type := info.type, value := info.value! }) with
+  | Except.ok _    => pure ()
+  | Except.error _ => throwError "failed to check ex3'"
+  unless (← Kernel.getSharedCacheHits) > hits do
+    throwError "shared kernel caches were not used"
@@ -0,0 +1,45 @@
+import Lean
+
+open Lean
+
+-- The kernel reduces `String` primitives on literals without converting them into `List Char`
+
+def bigStr : String := String.mk (List.replicate 20000 'a')
+
+def kernelWhnf (e : Expr) : CoreM Expr := do
+  return Kernel.whnf (← getEnv) {} e
+
+def checkDefEq (a b : Expr) : CoreM Unit := do
+  unless Kernel.isDefEq (← getEnv) {} a b do
+    throwError "{a} =?= {b} failed"
+
+#eval show CoreM Unit from do
+  let s := mkStrLit bigStr
+  let t := mkStrLit (bigStr ++ "b")
+  checkDefEq (mkApp (mkConst ``String.length) s) (mkRawNatLit 20000)
+  checkDefEq (mkApp (mkConst ``String.utf8ByteSize) (mkStrLit "αβγ")) (mkRawNatLit 6)
+  checkDefEq (mkApp (mkConst ``String.length) (mkStrLit "αβγ")) (mkRawNatLit 3)
+  checkDefEq (mkApp2 (mkConst ``String.append) s (mkStrLit "b")) t
+  let r ← kernelWhnf (mkApp2 (mkConst ``String.decEq) s t)
+  unless r.isAppOf ``Decidable.isFalse do throwError "unexpected {r}"
+  let r ← kernelWhnf (mkApp2 (mkConst ``String.decEq) t t)
+  unless r.isAppOf ``Decidable.isTrue do throwError "unexpected {r}"
+  -- literals are only expanded partially
+  let r ← kernelWhnf (mkProj ``String 0 s)
+  unless r.isAppOf ``List.cons do throwError "unexpected {r}"
+  -- walking a long literal expands it chunk by chunk
+  checkDefEq (mkStrLit (String.mk (List.replicate 2000 'a'))) (mkApp (mkConst ``String.mk) (toExpr (List.replicate 2000 'a')))
+  IO.println "ok"
+
+theorem ex1 : "hello" ++ " world" = "hello world" := by decide
+theorem ex2 : "hello".length = 5 := by decide
+theorem ex3 : "hello" ≠ "hellO" := by decide
+theorem ex4 : "αβγ".utf8ByteSize = 6 := rfl
+theorem ex5 : "abc" = String.mk ['a', 'b', 'c'] := rfl
+theorem ex6 : "".data = [] := rfl
+
+def firstChar : String → Char
+  | ⟨c :: _⟩ => c
+  | _        => ' '
+
+theorem ex7 : firstChar "xyz" = 'x' := rfl
@@ -0,0 +1,35 @@
+import Lean
+
+set_option kernel.parallelTheorems true
+
+theorem ex1 : 2 + 2 = 4 := rfl
+
+theorem ex2 (n : Nat) : n + 0 = n := rfl
+
+theorem ex3 (p q : Prop) (hp : p) (hq : q) : p ∧ q := ⟨hp, hq⟩
+
+-- later declarations may use the theorems before their values have been checked
+theorem ex4 : (2 + 2 = 4) ∧ True := ⟨ex1, trivial⟩
+
+def f (n : Nat) : Nat := n + 0
+
+theorem ex5 (n : Nat) : f n = n := ex2 n
+
+-- auxiliary theorems of `example`s are added in `withoutModifyingEnv`
+example (n : Nat) : f n = n ∧ True := ⟨ex2 n, trivial⟩
+
+open Lean Elab Command in
+/- Add a theorem whose value does not have its type, which only the deferred check detects, and expect the kernel
+   error to be reported. -/
+elab "#check_bad_theorem_rejected" : command => do
+  addDecl <| Declaration.thmDecl { name := `bad, levelParams := [], type := mkConst ``False, value := mkConst ``True.intro }
+  -- the header is valid, so the theorem is added right away
+  unless (← getEnv).contains `bad do
+    throwError "theorem 'bad' was not added"
+  waitTheoremChecks
+  unless (← get).messages.hasErrors do
+    throwError "the kernel accepted the value of theorem 'bad'"
+  -- the error is expected
+  modify fun s => { s with messages := {} }
+
+#check_bad_theorem_rejected
@@ -0,0 +1,25 @@
+-- Tasks spawned from tasks are pushed onto the local queue of the worker and may be stolen by other workers
+
+def leaf (i : Nat) : Nat :=
+  (List.range i).foldl (· + ·) 0
+
+def spawner (n : Nat) (prio : Task.Priority) : Task (List (Task Nat)) :=
+  Task.spawn (prio := prio) fun _ =>
+    (List.range n).map fun i => Task.spawn (prio := i % (Task.Priority.max + 1)) fun _ => leaf i
+
+def chain (t : Task Nat) : Nat → Task Nat
+  | 0   => t
+  | k+1 => chain (t.map (· + 1)) k
+
+def tst : IO Unit := do
+  let ss := (List.range 20).map fun j =>
+    let prio := if j % 10 == 0 then Task.Priority.dedicated else j % (Task.Priority.max + 1)
+    spawner 50 prio
+  let expected := (List.range 50).foldl (fun acc i => acc + leaf i) 0
+  for s in ss do
+    let r := (s.get.map (chain · 5)).foldl (fun acc t => acc + t.get) 0
+    unless r == expected + 5 * 50 do
+      throw <| IO.userError s!"unexpected result {r}"
+  IO.println "ok"
+
+#eval tst
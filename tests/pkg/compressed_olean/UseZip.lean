@@ -0,0 +1,3 @@
+import Zip
+
+#eval IO.println s!"{zipGreeting} {zipSum}"
@@ -0,0 +1,5 @@
+def zipGreeting : String := "zip ok"
+
+def zipSum : Nat := (List.range 1000).foldl (· + ·) 0
+
+theorem zipSum_eq : zipSum = 499500 := by decide
@@ -0,0 +1,26 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+rm -rf build
+mkdir -p build
+export LEAN_PATH=build
+
+# round trip: a compressed `.olean` file can be imported
+if ! lean -Dolean.compress=true -o build/Zip.olean Zip.lean > build/out.txt 2>&1; then
+  # Lean was built without zlib
+  grep 'built without zlib' build/out.txt
+  exit 0
+fi
+head -c 8 build/Zip.olean | grep -q oleanzip
+lean UseZip.lean | grep 'zip ok 499500'
+
+# corrupted input: a modified byte in the chunk data is detected
+cp build/Zip.olean build/Zip.olean.orig
+printf '\377' | dd of=build/Zip.olean bs=1 seek=200 count=1 conv=notrunc 2> /dev/null
+if lean UseZip.lean > build/out.txt 2>&1; then exit 1; fi
+grep 'corrupted chunk' build/out.txt
+
+# truncated input
+head -c 300 build/Zip.olean.orig > build/Zip.olean
+if lean UseZip.lean > build/out.txt 2>&1; then exit 1; fi
+grep 'corrupted chunk' build/out.txt
@@ -0,0 +1,12 @@
+/-- Build a large list that is shared with a task, and thus becomes multi-threaded, together with an external object. -/
+def round (i : Nat) : IO Nat := do
+  let xs := List.range (10000 + i)
+  let h ← IO.FS.Handle.mk "Main.lean" .read
+  let t := Task.spawn fun _ => (xs, h).1.length
+  return t.get
+
+def main : IO Unit := do
+  let mut sum := 0
+  for i in [0:100] do
+    sum := sum + (← round i)
+  IO.println s!"deferred free ok {sum}"
@@ -0,0 +1,10 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+rm -rf build
+mkdir -p build
+
+# free dead multi-threaded objects in the background after the first 16 objects of each graph
+LEAN_DEFERRED_FREE=16 LEAN_DEFERRED_FREE_STATS=1 lean --run Main.lean > build/out.txt 2>&1
+grep 'deferred free ok 1004950' build/out.txt
+grep -E 'deferred free: [1-9][0-9]* batches, [1-9][0-9]* objects reclaimed' build/out.txt
@@ -0,0 +1,7 @@
+def build (n : Nat) : List (Array Nat) :=
+  (List.range n).map fun i => #[i, i + 1, i + 2]
+
+def main : IO Unit := do
+  let xs := build 100000
+  IO.heapProfDump "build/heap.pb"
+  IO.println s!"heapprof ok {xs.length}"
@@ -0,0 +1,9 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+rm -rf build
+mkdir -p build
+
+# `IO.heapProfDump` writes a non-empty pprof profile
+LEAN_HEAPPROF=64 lean --run Main.lean | grep 'heapprof ok 100000'
+test -s build/heap.pb
@@ -0,0 +1,4 @@
+import Good
+import Missing
+
+def bad : Nat := good + missing
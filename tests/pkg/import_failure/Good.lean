@@ -0,0 +1 @@
+def good : Nat := 42
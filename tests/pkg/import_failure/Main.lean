@@ -0,0 +1,21 @@
+import Lean
+open Lean
+
+/-- Number of memory mappings of the `.olean` files of this test. -/
+def mappedOLeans : IO Nat := do
+  let maps ← IO.FS.readFile "/proc/self/maps"
+  return maps.splitOn "\n" |>.filter (fun l => l.endsWith "/Good.olean" || l.endsWith "/Bad.olean") |>.length
+
+def main : IO Unit := do
+  for _ in [0:10] do
+    try
+      discard <| importModules [{ module := `Bad }] {}
+      throw <| IO.userError "import of `Bad` succeeded"
+    catch ex =>
+      unless (toString ex).startsWith "unknown package 'Missing'" do
+        throw ex
+  -- the regions of the modules read before the failure must have been freed
+  let n ← mappedOLeans
+  unless n == 0 do
+    throw <| IO.userError s!"{n} mappings left after failed imports"
+  IO.println "import failure ok"
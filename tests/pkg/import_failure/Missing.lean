@@ -0,0 +1 @@
+def missing : Nat := 0
@@ -0,0 +1,15 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+rm -rf build
+mkdir -p build
+export LEAN_PATH=build
+
+lean -o build/Good.olean Good.lean
+lean -o build/Missing.olean Missing.lean
+lean -o build/Bad.olean Bad.lean
+rm build/Missing.olean
+
+# needs `/proc/self/maps`
+if [ ! -r /proc/self/maps ]; then exit 0; fi
+lean --run Main.lean | grep 'import failure ok'
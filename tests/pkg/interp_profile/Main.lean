@@ -0,0 +1,32 @@
+-- The interpreter records per-declaration statistics while `profiler` is set, including for recursive functions,
+-- closures, and calls that throw.
+def fib : Nat → Nat
+  | 0 => 0
+  | 1 => 1
+  | n+2 => fib n + fib (n+1)
+
+def mkList (n : Nat) : List Nat := (List.range n).map (· * 2)
+
+def mayFail (n : Nat) : IO Nat := do
+  if n > 5 then throw (IO.userError "too big")
+  pure n
+
+-- allocates a pair and a list cell per recursive call
+def pairs : Nat → List (Nat × Nat)
+  | 0 => []
+  | n+1 => (n, n) :: pairs n
+
+-- 1973 calls of `fib`
+set_option profiler true in
+#eval fib 15
+
+-- 20 * (1 + 3 + 9 + 25 + 67) = 2100 calls of `fib`, from a closure
+set_option profiler true in
+#eval (mkList 100).foldl (fun acc x => acc + fib (x % 10)) 0
+
+set_option profiler true in
+#eval (mayFail 10).toBaseIO
+
+-- 2001 calls and 4000 allocations
+set_option profiler true in
+#eval (pairs 2000).length
@@ -0,0 +1,20 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+rm -rf build
+mkdir -p build
+
+LEAN_PROFILE_FLAMEGRAPH=build/stacks.txt lean Main.lean > build/out.txt 2>&1
+
+# calls and allocations of the interpreted declarations, with the times masked
+sed -n '/^cumulative interpreter profile/,/^[^\t]/p' build/out.txt |
+  awk '$1 == "fib" || $1 == "pairs" { print $1, "<self>", "<total>", $4, $5 }' | sort > build/produced.out
+diff -u expected.out build/produced.out
+
+# folded stacks: `;`-separated functions, outermost first, and the self time in microseconds
+grep -F "interpreter profile written to 'build/stacks.txt'" build/out.txt
+if grep -Ev '^[^ ;]+(;[^ ;]+)* [0-9]+$' build/stacks.txt; then
+  echo "unexpected line in build/stacks.txt"
+  exit 1
+fi
+grep -E '(^|;)fib [0-9]+$' build/stacks.txt
@@ -0,0 +1,11 @@
+-- definitional unfolding and `Nat` literal reductions in the kernel
+def fib : Nat → Nat
+  | 0     => 0
+  | 1     => 1
+  | n + 2 => fib n + fib (n + 1)
+
+theorem fib15 : fib 15 = 610 := rfl
+
+theorem len : (List.replicate 200 0).length = 200 := rfl
+
+theorem sum : (List.range 50).foldl (· + ·) 0 = 1225 := rfl
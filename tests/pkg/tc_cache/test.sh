@@ -0,0 +1,14 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+rm -rf build
+mkdir -p build
+
+# the caches are used, and their hit rates are reported
+lean --stats Heavy.lean > build/out.txt
+grep -E 'whnf_core: [1-9][0-9]* hits, [0-9]+ misses, [0-9]+ evictions, hit rate [0-9]+%' build/out.txt
+
+# with a tiny capacity, entries are evicted, but the declarations are still checked
+LEAN_TYPE_CHECKER_CACHE_CAPACITY=8 lean --stats Heavy.lean > build/out.txt
+grep -E 'type checker caches \(capacity 8\)' build/out.txt
+grep -E 'whnf_core: [0-9]+ hits, [0-9]+ misses, [1-9][0-9]* evictions' build/out.txt